@@ -0,0 +1,85 @@
+#ifndef ASYNC_MQTT_TRANSPORT_H
+#define ASYNC_MQTT_TRANSPORT_H
+
+#include <Arduino.h>
+#include <AsyncMqttClient.h>
+#include "MqttTransport.h"
+#include "CommandQueue.h"
+
+// MqttTransport over AsyncMqttClient. The TCP connect, DNS lookup and
+// socket writes run on the AsyncTCP task, so no call here waits on the
+// network: publishes are queued by the client and sent as the socket
+// drains. Received messages are copied into a ring on the AsyncTCP task
+// and handed to the callback from loop().
+class AsyncMqttTransport : public MqttTransport {
+public:
+    static constexpr size_t INBOX_DEPTH = 8;
+    static constexpr size_t MAX_TOPIC_LENGTH = 127;
+
+    // maxPayload is the largest incoming message that is delivered,
+    // maxPublish the largest streamed publish that is sent
+    AsyncMqttTransport(uint16_t maxPayload, size_t maxPublish);
+    ~AsyncMqttTransport() override;
+
+    void begin(const char* host, uint16_t port, MessageCallback callback) override;
+    bool connect(const char* clientId, const char* user, const char* password,
+                 const char* willTopic, const char* willPayload) override;
+    bool connected() override { return _client.connected(); }
+    bool connecting() override { return _connecting; }
+    void loop() override;
+
+    bool subscribe(const char* topic) override;
+    bool publish(const char* topic, const char* payload, bool retained) override;
+
+    bool beginPublish(const char* topic, size_t length, bool retained) override;
+    size_t write(const uint8_t* data, size_t len) override;
+    bool endPublish() override;
+
+    int state() override { return _lastDisconnectReason; }
+
+    // Messages dropped because the inbox was full or they were too large
+    uint32_t droppedMessages() const { return _droppedMessages; }
+
+private:
+    struct InboundMessage {
+        char topic[MAX_TOPIC_LENGTH + 1];
+        uint16_t length;
+        uint8_t* payload;   // Points into _payloads for this slot
+        bool complete;      // False for a slot handed back undelivered
+    };
+
+    AsyncMqttClient _client;
+    MessageCallback _callback = nullptr;
+    volatile bool _connecting = false;
+    volatile int _lastDisconnectReason = 0;
+    volatile uint32_t _droppedMessages = 0;
+
+    // AsyncMqttClient keeps pointers to these, so they live here
+    char _clientId[48] = {};
+    char _user[64] = {};
+    char _password[64] = {};
+    char _willTopic[64] = {};
+    char _willPayload[16] = {};
+
+    // Inbox: filled on the AsyncTCP task, drained by loop(). Slots only
+    // travel AsyncTCP -> loop() through _inbox and back through _freeSlots,
+    // so each ring keeps a single producer.
+    uint16_t _maxPayload;
+    uint8_t* _payloads = nullptr;       // INBOX_DEPTH * _maxPayload, allocated once in begin()
+    SpscRing<uint8_t, INBOX_DEPTH> _inbox;     // Slot indices to deliver or free, from the AsyncTCP task
+    SpscRing<uint8_t, INBOX_DEPTH> _freeSlots; // Slot indices free for the AsyncTCP task, from loop()
+    InboundMessage _messages[INBOX_DEPTH] = {};
+    int _filling = -1;                  // Slot being assembled from fragments
+
+    // Streamed publish being assembled
+    char _publishTopic[MAX_TOPIC_LENGTH + 1] = {};
+    bool _publishRetained = false;
+    uint8_t* _publishBuffer = nullptr;  // _publishSize bytes, allocated once in begin()
+    size_t _publishLength = 0;
+    size_t _publishSize;
+
+    void onMessage(char* topic, char* payload, size_t len, size_t index, size_t total);
+    void discardFilling();
+};
+
+#endif // ASYNC_MQTT_TRANSPORT_H
@@ -0,0 +1,44 @@
+#ifndef BED_LINK_H
+#define BED_LINK_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// =============================================================================
+// Transport to one bed's MotoSleep characteristic
+// (service 0000ffe0, characteristic 0000ffe1). MotoSleepBed only talks to
+// the bed through this interface, so the ESP32 BLE stack can be swapped for
+// a simulated peripheral in a host build. No Arduino dependencies.
+// =============================================================================
+class BedLink {
+public:
+    // Where the time went in the last successful connect()
+    struct ConnectTiming {
+        uint32_t linkUs;        // Link establishment
+        uint32_t discoveryUs;   // Service and characteristic lookup
+        bool cachedHandle;      // Discovery skipped in favour of a known handle
+    };
+
+    virtual ~BedLink() {}
+
+    // Connect and locate the command characteristic. With a known handle the
+    // characteristic lookup is skipped; the first write of the connection
+    // checks the handle and rediscovers if the bed rejects it.
+    virtual bool connect(const uint8_t address[6]) = 0;
+    virtual void disconnect() = 0;
+    virtual bool isConnected() const = 0;
+    virtual ConnectTiming lastConnectTiming() const = 0;
+
+    // Write to the command characteristic, without response once the handle
+    // is confirmed
+    virtual bool write(const uint8_t* data, size_t len) = 0;
+
+    // Value handle of the command characteristic, 0 if not known yet
+    virtual uint16_t getHandle() const = 0;
+    virtual void setHandle(uint16_t handle) = 0;
+
+    // Monotonic clock in us that the link's timings are taken on
+    virtual int64_t nowUs() const = 0;
+};
+
+#endif // BED_LINK_H
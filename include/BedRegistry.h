@@ -0,0 +1,170 @@
+#ifndef BED_REGISTRY_H
+#define BED_REGISTRY_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include "ConfigDefaults.h"
+
+// =============================================================================
+// Runtime bed registry
+// Beds live in a fixed number of slots. A bed keeps its slot, and so its
+// index into every per-bed array (queues, holds, stats), for as long as it
+// is registered, and its strings are stored in the slot, so beds can be
+// added, renamed and removed without allocating. Beds are configured with
+// retained messages on motosleep/config/beds/{bed_id}, payload
+// "ble_name,Friendly Name" (an empty payload removes the bed).
+// No Arduino dependencies.
+// =============================================================================
+
+#define MOTOSLEEP_BED_CONFIG_PREFIX "motosleep/config/beds/"
+#define MOTOSLEEP_BED_CONFIG_FILTER MOTOSLEEP_BED_CONFIG_PREFIX "+"
+
+struct BedEntry {
+    char id[24];
+    char bleName[24];
+    char friendlyName[32];
+};
+
+enum class RegistryResult : uint8_t {
+    ADDED,
+    UPDATED,
+    UNCHANGED,
+    REMOVED,
+    NOT_FOUND,
+    FULL,
+    INVALID                     // Bad ID, or a name that doesn't fit
+};
+
+inline const char* registryResultName(RegistryResult result) {
+    switch (result) {
+        case RegistryResult::ADDED:     return "added";
+        case RegistryResult::UPDATED:   return "updated";
+        case RegistryResult::UNCHANGED: return "unchanged";
+        case RegistryResult::REMOVED:   return "removed";
+        case RegistryResult::NOT_FOUND: return "not found";
+        case RegistryResult::FULL:      return "registry full";
+        case RegistryResult::INVALID:   return "invalid";
+    }
+    return "?";
+}
+
+// Parse "ble_name,Friendly Name" for the bed with this ID. The friendly name
+// defaults to the ID. Returns false if a field is empty or too long.
+inline bool parseBedEntry(const char* id, size_t idLength, const char* payload, size_t length, BedEntry& entry) {
+    const char* comma = static_cast<const char*>(memchr(payload, ',', length));
+    size_t bleLength = comma ? static_cast<size_t>(comma - payload) : length;
+    const char* name = comma ? comma + 1 : id;
+    size_t nameLength = comma ? length - bleLength - 1 : idLength;
+    while (nameLength && *name == ' ') {
+        name++;
+        nameLength--;
+    }
+
+    if (!idLength || idLength >= sizeof(entry.id) || !bleLength || bleLength >= sizeof(entry.bleName) ||
+        !nameLength || nameLength >= sizeof(entry.friendlyName)) {
+        return false;
+    }
+
+    memcpy(entry.id, id, idLength);
+    entry.id[idLength] = '\0';
+    memcpy(entry.bleName, payload, bleLength);
+    entry.bleName[bleLength] = '\0';
+    memcpy(entry.friendlyName, name, nameLength);
+    entry.friendlyName[nameLength] = '\0';
+    return true;
+}
+
+// Topic-safe IDs: lowercase letters, digits and underscores
+inline bool validBedId(const char* id) {
+    if (!*id) return false;
+    for (const char* p = id; *p; p++) {
+        if (!((*p >= 'a' && *p <= 'z') || (*p >= '0' && *p <= '9') || *p == '_')) return false;
+    }
+    return strcmp(id, "config") != 0;
+}
+
+template <size_t Slots>
+class BedRegistry {
+public:
+    // Register a bed, or update the one with the same ID in place
+    RegistryResult set(const BedEntry& entry, size_t& slot) {
+        if (!validBedId(entry.id)) return RegistryResult::INVALID;
+
+        slot = find(entry.id, strlen(entry.id));
+        if (slot < Slots) {
+            BedEntry& current = _entries[slot];
+            if (strcmp(current.bleName, entry.bleName) == 0 &&
+                strcmp(current.friendlyName, entry.friendlyName) == 0) {
+                return RegistryResult::UNCHANGED;
+            }
+            current = entry;
+            return RegistryResult::UPDATED;
+        }
+
+        for (slot = 0; slot < Slots; slot++) {
+            if (!_used[slot]) {
+                restore(slot, entry);
+                return RegistryResult::ADDED;
+            }
+        }
+        return RegistryResult::FULL;
+    }
+
+    // Put a persisted bed back in its old slot
+    void restore(size_t slot, const BedEntry& entry) {
+        if (slot >= Slots) return;
+        _entries[slot] = entry;
+        _used[slot] = true;
+        _configs[slot] = {_entries[slot].bleName, _entries[slot].friendlyName, _entries[slot].id};
+    }
+
+    RegistryResult remove(const char* id, size_t len, size_t& slot) {
+        slot = find(id, len);
+        if (slot == Slots) return RegistryResult::NOT_FOUND;
+        _used[slot] = false;
+        _configs[slot] = {};
+        return RegistryResult::REMOVED;
+    }
+
+    // Slot of the bed with this ID (not necessarily null-terminated), or Slots
+    size_t find(const char* id, size_t len) const {
+        for (size_t slot = 0; slot < Slots; slot++) {
+            if (_used[slot] && strlen(_entries[slot].id) == len && memcmp(_entries[slot].id, id, len) == 0) {
+                return slot;
+            }
+        }
+        return Slots;
+    }
+
+    bool used(size_t slot) const { return slot < Slots && _used[slot]; }
+
+    // Strings point into the slot and change when the bed is updated
+    const BedConfig& config(size_t slot) const { return _configs[slot]; }
+    const BedEntry& entry(size_t slot) const { return _entries[slot]; }
+
+    size_t count() const {
+        size_t n = 0;
+        for (size_t slot = 0; slot < Slots; slot++) {
+            if (_used[slot]) n++;
+        }
+        return n;
+    }
+
+    // Registered beds packed in slot order, e.g. for a discovery pass. Valid
+    // until the next change.
+    size_t list(BedConfig* out) const {
+        size_t n = 0;
+        for (size_t slot = 0; slot < Slots; slot++) {
+            if (_used[slot]) out[n++] = _configs[slot];
+        }
+        return n;
+    }
+
+private:
+    BedEntry _entries[Slots] = {};
+    BedConfig _configs[Slots] = {};
+    bool _used[Slots] = {};
+};
+
+#endif // BED_REGISTRY_H
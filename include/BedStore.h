@@ -0,0 +1,44 @@
+#ifndef BED_STORE_H
+#define BED_STORE_H
+
+#include <Arduino.h>
+#include "BedRegistry.h"
+
+// Per-bed data persisted in NVS, keyed by BedConfig::bleName, so a reboot
+// doesn't have to wait for a BLE scan before serving commands
+namespace BedStore {
+
+// Load a cached BLE address; returns false if none is stored
+bool loadAddress(const char* bleName, uint8_t address[6]);
+
+// Store a BLE address (no-op if it is already stored). A new address drops
+// the cached handle, since it may belong to a different controller.
+void saveAddress(const char* bleName, const uint8_t address[6]);
+
+// Load the cached command characteristic value handle; 0 if none is stored
+uint16_t loadHandle(const char* bleName);
+
+// Store the characteristic handle alongside the address (no-op if unchanged)
+void saveHandle(const char* bleName, uint16_t handle);
+
+// Load calibrated travel times, up then down for each actuator; returns
+// false if the bed has never been calibrated
+bool loadTravel(const char* bleName, uint32_t* travelMs, size_t count);
+
+// Store calibrated travel times (count values, as for loadTravel)
+void saveTravel(const char* bleName, const uint32_t* travelMs, size_t count);
+
+// Drop everything stored for a bed
+void forget(const char* bleName);
+
+// Registry slots. Until the registry has been saved once, setup() seeds it
+// from BEDS[].
+bool registrySaved();
+bool loadRegistrySlot(size_t slot, BedEntry& entry);
+
+// Store a registry slot (nullptr clears it) and mark the registry saved
+void saveRegistrySlot(size_t slot, const BedEntry* entry);
+
+} // namespace BedStore
+
+#endif // BED_STORE_H
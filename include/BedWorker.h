@@ -0,0 +1,194 @@
+#ifndef BED_WORKER_H
+#define BED_WORKER_H
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+#include "BedLink.h"
+#include "CircuitBreaker.h"
+#include "CommandQueue.h"
+#include "ConfigDefaults.h"
+#include "ConnectionPool.h"
+#include "HeapStats.h"
+#include "LatencyHistogram.h"
+#include "MacroEngine.h"
+#include "MotoSleepBed.h"
+#include "MotorHold.h"
+#include "PositionModel.h"
+#include "TopicRouter.h"
+#include "WorkerPlatform.h"
+
+// Calibration: home the actuator, then time a full rise that the user ends
+// with STOP at the top. Phase and rise start belong to the BLE worker; the
+// results are read by publishPositions().
+enum class CalibrationPhase : uint8_t {
+    IDLE,
+    HOMING,
+    RISING
+};
+
+struct Calibration {
+    CalibrationPhase phase = CalibrationPhase::IDLE;
+    uint32_t riseStartMs = 0;
+    std::atomic<bool> done{false};          // A run finished since boot
+    std::atomic<int16_t> errorPermille{0};  // Estimate at the top minus full travel, before the run
+    std::atomic<uint32_t> upMs{0};
+    std::atomic<uint32_t> downMs{0};
+};
+
+// =============================================================================
+// BLE worker command path
+// Everything between a command topic and the bed: routing and queuing in the
+// MQTT callback, then, on the BLE worker, stops ahead of every queued
+// command, round-robin draining, group fan-out, connects through the circuit
+// breaker and the connection pool, motor holds, macros and position
+// estimates. The firmware's worker task and the host simulation both run
+// this; what differs between them is behind WorkerPlatform.
+//
+// onCommand() is the only call made from the MQTT side. attachBed() and
+// detachBed() are for whoever changes the bed slots while the worker is
+// parked; everything else runs on the worker. Stats accessors are safe from
+// any task.
+// =============================================================================
+class BedWorker {
+public:
+    // 256 wheel slots cover 2.56 s per revolution at a 10 ms tick
+    typedef MacroEngine<MAX_BEDS, 256> Macros;
+
+    // beds and links have MAX_BEDS entries, nullptr for an empty slot
+    BedWorker(MotoSleepBed** beds, BedLink** links, WorkerPlatform& platform);
+
+    // Hold and breaker timing, group routes and MACROS[], before the worker starts
+    void begin();
+
+    // A bed object and link were built in slot i, with its cached address if
+    // any: route its topics and restore its handle and travel times from NVS
+    void attachBed(size_t i);
+
+    // Slot i is about to be torn down: end its hold, macro and calibration
+    // and drop anything still queued for it
+    void detachBed(size_t i);
+
+    // MQTT callback: route a command topic and queue it for the worker.
+    // Never blocks on BLE I/O.
+    void onCommand(const char* topic, const uint8_t* payload, unsigned int length);
+
+    // Worker, before it sleeps: stops, idle links, due macro steps and hold
+    // repeats, position estimates and trial connects. Returns ms until
+    // something is next due (or maxWaitMs).
+    unsigned long service(unsigned long maxWaitMs);
+
+    // Worker, once woken: run everything queued, round-robin across beds and groups
+    void drain();
+
+    // Anything queued and not yet run
+    bool pending() const;
+
+    // A motor hold is running, as of the worker's last pass over them. Safe
+    // from any task; loop() holds off restarts on it.
+    bool anyHoldActive() const { return _holdActive.load(std::memory_order_relaxed); }
+
+    // ---- Stats, safe from any task ----
+    CommandQueueStats queueStats(size_t i) const { return _commandQueues[i].getStats(); }
+    CommandQueueStats stopStats(size_t i) const { return _stopQueues[i].getStats(); }
+    CommandQueueStats groupStats(size_t g) const { return _groupQueues[g].getStats(); }
+    uint32_t bleWrites(size_t i) const { return _bleWrites[i].load(std::memory_order_relaxed); }
+    MotorHoldStats holdStats(size_t i) const { return _motorHolds[i].getStats(); }
+    StageLatencies& latencies(size_t i) { return _latencies[i]; }
+    LatencyHistogram& groupSkew(size_t g) { return _groupSkew[g]; }
+    ConnectionPool& pool() { return _pool; }
+    CircuitBreaker& breaker(size_t i) { return _breakers[i]; }
+    Macros& macros() { return _macroEngine; }
+    CommandHeapStats heapStats() const { return _commandHeap.getStats(); }
+    unsigned long firstCommandMs() const { return _firstCommandMs; }
+
+    // position | uncertainty << 10 | direction << 20
+    uint32_t positionState(size_t i, size_t a) const { return _positionStates[i][a].load(std::memory_order_relaxed); }
+    const Calibration& calibration(size_t i, size_t a) const { return _calibrations[i][a]; }
+
+private:
+    MotoSleepBed** _beds;
+    BedLink** _links;
+    WorkerPlatform& _platform;
+
+    // Maps command topics to bed slots; indices from MAX_BEDS on are groups
+    TopicRouter<MAX_BEDS + BED_GROUP_COUNT> _router;
+
+    // Per-bed and per-group command queues, filled by onCommand() and drained by the worker
+    CommandQueue<COMMAND_QUEUE_DEPTH> _commandQueues[MAX_BEDS];
+    CommandQueue<COMMAND_QUEUE_DEPTH> _groupQueues[BED_GROUP_COUNT];
+
+    // Stop-class commands (massage stop and off, and the STOP payloads of
+    // holds, macros and covers) skip the queues above: the worker serves them
+    // before every queued command. A group's stop is queued for each member.
+    CommandQueue<STOP_QUEUE_DEPTH> _stopQueues[MAX_BEDS];
+
+    // Set by a stop so motion commands queued before it are skipped; cleared
+    // once the bed's queues have been drained
+    bool _stopPending[MAX_BEDS] = {};
+    uint32_t _stopEnqueuedUs[MAX_BEDS] = {};
+
+    // Warm bed connections, and a breaker per bed that fails commands at once
+    // while its connects keep failing
+    ConnectionPool _pool;
+    CircuitBreaker _breakers[MAX_BEDS];
+    uint16_t _storedHandles[MAX_BEDS] = {};     // Characteristic handle last written to NVS
+
+    // Streaming motor holds, and every write issued to each bed: single
+    // commands, hold repeats and macro steps
+    MotorHold _motorHolds[MAX_BEDS];
+    std::atomic<uint32_t> _bleWrites[MAX_BEDS] = {};
+    std::atomic<bool> _holdActive{false};
+
+    // Per-bed, per-stage command path latencies, and the first-to-last write
+    // spread of each group command
+    StageLatencies _latencies[MAX_BEDS];
+    LatencyHistogram _groupSkew[BED_GROUP_COUNT];
+
+    // MACROS[] parsed at boot, and the engine running them
+    MacroProgram<MACRO_MAX_STEPS> _macroPrograms[MACRO_COUNT ? MACRO_COUNT : 1];
+    Macros _macroEngine;
+
+    // Head/feet dead-reckoning estimates, packed into _positionStates for loop()
+    ActuatorEstimate _positions[MAX_BEDS][ACTUATOR_COUNT];
+    std::atomic<uint32_t> _positionStates[MAX_BEDS][ACTUATOR_COUNT] = {};
+    char _trackedHolds[MAX_BEDS] = {0};    // Hold the estimates last saw running (0 = none)
+    Calibration _calibrations[MAX_BEDS][ACTUATOR_COUNT];
+
+    // Heap blocks left allocated by each command, and when the first one went out
+    CommandHeapTracker _commandHeap;
+    unsigned long _firstCommandMs = 0;
+
+    uint32_t registeredBeds() const;
+    void persistHandle(size_t i);
+    void updatePin(size_t i);
+    bool handleMacroControl(size_t i, const QueuedCommand& cmd);
+    bool handleHoldControl(size_t i, const QueuedCommand& cmd);
+    bool acquireBed(size_t i);
+    bool writeBed(size_t i, char cmdChar);
+    void commandWritten(size_t i, const QueuedCommand& cmd, uint32_t burstUs);
+    bool preemptedByStop(size_t i, const QueuedCommand& cmd) const;
+    void runStop(size_t i, const QueuedCommand& cmd);
+    void serviceStops();
+    void runCommand(size_t i, QueuedCommand cmd);
+    void runGroupCommand(size_t g, const QueuedCommand& cmd);
+    unsigned long serviceBreakers(unsigned long maxWaitMs);
+    unsigned long serviceMotorHolds(unsigned long maxWaitMs);
+    void publishHoldState();
+    bool runMacroStep(size_t i, const MacroStep& step);
+    unsigned long serviceMacros(unsigned long maxWaitMs);
+    void serviceDue();
+
+    // Position estimates and calibration
+    void noteCommand(size_t i, char cmdChar);
+    bool driveActuator(size_t i, size_t a, MotorDirection dir, uint32_t runMs);
+    void startCalibrationRise(size_t i, size_t a);
+    void calibrationHoldEnded(size_t i, size_t a);
+    void trackMotion(size_t i);
+    void stopActuator(size_t i, size_t a);
+    void finishCalibration(size_t i, size_t a);
+    bool handlePositionControl(size_t i, const QueuedCommand& cmd);
+    unsigned long updatePositions(unsigned long maxWaitMs);
+};
+
+#endif // BED_WORKER_H
@@ -0,0 +1,160 @@
+#ifndef CIRCUIT_BREAKER_H
+#define CIRCUIT_BREAKER_H
+
+#include <atomic>
+#include <stdint.h>
+
+// =============================================================================
+// Per-bed connect circuit breaker
+// A bed that fails threshold connects in a row is taken out of service: its
+// commands fail straight away instead of each waiting out a connect timeout.
+// After a while one trial connect is let through (half-open); success puts the
+// bed back in service, failure takes it out again for twice as long, up to a
+// limit. Each wait is jittered by +/-25% so beds unplugged together don't
+// retry together. Hearing the bed advertise lets the trial through early.
+// Driven by the BLE worker with the current time; times are in ms.
+// No Arduino dependencies.
+// =============================================================================
+
+enum class BreakerState : uint8_t {
+    CLOSED,         // In service
+    OPEN,           // Failing fast until the wait runs out
+    HALF_OPEN       // One trial connect allowed
+};
+
+inline const char* breakerStateName(BreakerState state) {
+    switch (state) {
+        case BreakerState::CLOSED:    return "closed";
+        case BreakerState::OPEN:      return "open";
+        case BreakerState::HALF_OPEN: return "half_open";
+    }
+    return "?";
+}
+
+// Snapshot of breaker counters, safe to read from any task
+struct BreakerStats {
+    BreakerState state;
+    uint32_t opens;             // CLOSED -> OPEN
+    uint32_t halfOpens;         // OPEN -> HALF_OPEN (trial connects)
+    uint32_t closes;            // HALF_OPEN -> CLOSED
+    uint32_t fastFails;         // Commands refused while open
+    uint32_t openMs;            // Length of the current (or last) wait
+};
+
+class CircuitBreaker {
+public:
+    void setTiming(uint8_t threshold, uint32_t openMinMs, uint32_t openMaxMs) {
+        _threshold = threshold ? threshold : 1;
+        _openMinMs = openMinMs;
+        _openMaxMs = openMaxMs > openMinMs ? openMaxMs : openMinMs;
+        _backoffMs = openMinMs;
+    }
+
+    // Back in service with fresh counters (a new bed in the slot)
+    void reset() {
+        _failures = 0;
+        _backoffMs = _openMinMs;
+        _state.store(BreakerState::CLOSED, std::memory_order_relaxed);
+        _opens.store(0, std::memory_order_relaxed);
+        _halfOpens.store(0, std::memory_order_relaxed);
+        _closes.store(0, std::memory_order_relaxed);
+        _fastFails.store(0, std::memory_order_relaxed);
+        _openMs.store(0, std::memory_order_relaxed);
+    }
+
+    // Whether a connect may be tried now. heardMs is when the bed last
+    // advertised (0 = never); an advertisement since the breaker opened
+    // ends the wait.
+    bool allow(uint32_t nowMs, uint32_t heardMs) {
+        if (_state.load(std::memory_order_relaxed) != BreakerState::OPEN) return true;
+
+        if (untilTrialMs(nowMs, heardMs)) {
+            _fastFails.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+
+        _state.store(BreakerState::HALF_OPEN, std::memory_order_relaxed);
+        _halfOpens.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+
+    // ms until allow() lets a trial connect through (0 = now, or not open)
+    uint32_t untilTrialMs(uint32_t nowMs, uint32_t heardMs) const {
+        if (_state.load(std::memory_order_relaxed) != BreakerState::OPEN) return 0;
+        if (heardMs && static_cast<int32_t>(heardMs - _openedAtMs) > 0) return 0;
+        uint32_t elapsed = nowMs - _openedAtMs;
+        uint32_t openMs = _openMs.load(std::memory_order_relaxed);
+        return elapsed < openMs ? openMs - elapsed : 0;
+    }
+
+    // The trial allow() let through was never tried (no connection slot was
+    // free): open again with the wait already over, so the next chance to
+    // connect makes the trial
+    void cancelTrial() {
+        if (_state.load(std::memory_order_relaxed) != BreakerState::HALF_OPEN) return;
+        _state.store(BreakerState::OPEN, std::memory_order_relaxed);
+        _halfOpens.fetch_sub(1, std::memory_order_relaxed);
+    }
+
+    void success() {
+        _failures = 0;
+        _backoffMs = _openMinMs;
+        if (_state.load(std::memory_order_relaxed) != BreakerState::CLOSED) {
+            _state.store(BreakerState::CLOSED, std::memory_order_relaxed);
+            _closes.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    // A connect failed. random is any 32-bit random value (esp_random()),
+    // used for the jitter.
+    void failure(uint32_t nowMs, uint32_t random) {
+        if (_failures < UINT8_MAX) _failures++;
+
+        BreakerState state = _state.load(std::memory_order_relaxed);
+        if (state == BreakerState::HALF_OPEN) {
+            // The trial failed: wait longer this time
+            _backoffMs = _backoffMs > _openMaxMs / 2 ? _openMaxMs : _backoffMs * 2;
+        } else if (state != BreakerState::CLOSED || _failures < _threshold) {
+            return;
+        } else {
+            _backoffMs = _openMinMs;
+            _opens.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        uint32_t spread = _backoffMs / 2;
+        _openMs.store(_backoffMs - spread / 2 + (spread ? random % (spread + 1) : 0), std::memory_order_relaxed);
+        _openedAtMs = nowMs;
+        _state.store(BreakerState::OPEN, std::memory_order_relaxed);
+    }
+
+    BreakerState state() const { return _state.load(std::memory_order_relaxed); }
+
+    BreakerStats getStats() const {
+        return {
+            _state.load(std::memory_order_relaxed),
+            _opens.load(std::memory_order_relaxed),
+            _halfOpens.load(std::memory_order_relaxed),
+            _closes.load(std::memory_order_relaxed),
+            _fastFails.load(std::memory_order_relaxed),
+            _openMs.load(std::memory_order_relaxed)
+        };
+    }
+
+private:
+    // Owned by the BLE worker
+    uint8_t _threshold = 3;
+    uint8_t _failures = 0;      // Connects failed in a row
+    uint32_t _openMinMs = 5000;
+    uint32_t _openMaxMs = 300000;
+    uint32_t _backoffMs = 5000; // Wait before jitter; doubles after each failed trial
+    uint32_t _openedAtMs = 0;
+
+    std::atomic<BreakerState> _state{BreakerState::CLOSED};
+    std::atomic<uint32_t> _opens{0};
+    std::atomic<uint32_t> _halfOpens{0};
+    std::atomic<uint32_t> _closes{0};
+    std::atomic<uint32_t> _fastFails{0};
+    std::atomic<uint32_t> _openMs{0};
+};
+
+#endif // CIRCUIT_BREAKER_H
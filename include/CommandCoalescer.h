@@ -0,0 +1,86 @@
+#ifndef COMMAND_COALESCER_H
+#define COMMAND_COALESCER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "CommandQueue.h"
+#include "MotoSleepCommands.h"
+
+// =============================================================================
+// Burst coalescing
+// Tapping a button repeatedly queues one press per tap. Before the BLE worker
+// sends a press it folds in the presses queued right behind it:
+//   - repeated motor presses become one press counted N times, which the
+//     worker sends as a timed hold of N write intervals
+//   - light toggles cancel in pairs
+//   - a preset followed by another preset is skipped for the newer one
+// Only presses that arrived within windowUs of the one before them are
+// merged, and merging stops at the first command that doesn't fit, so the
+// order of everything else is kept. No Arduino dependencies.
+// =============================================================================
+
+enum class CoalesceKind : uint8_t {
+    NONE,           // Sent as-is
+    REPEAT,         // Motor: N presses move N times as far
+    TOGGLE,         // Two presses undo each other
+    SUPERSEDE       // Only the newest matters
+};
+
+inline CoalesceKind coalesceKind(char cmdChar) {
+    using namespace MotoSleep;
+    switch (cmdChar) {
+        case Motor::HEAD_UP:
+        case Motor::HEAD_DOWN:
+        case Motor::FEET_UP:
+        case Motor::FEET_DOWN:
+        case Motor::NECK_UP:
+        case Motor::NECK_DOWN:
+        case Motor::LUMBAR2_UP:
+        case Motor::LUMBAR2_DOWN:
+            return CoalesceKind::REPEAT;
+        case Light::TOGGLE:
+            return CoalesceKind::TOGGLE;
+        case Preset::HOME:
+        case Preset::MEMORY_1:
+        case Preset::MEMORY_2:
+        case Preset::ANTI_SNORE:
+        case Preset::TV:
+        case Preset::ZERO_G:
+            return CoalesceKind::SUPERSEDE;
+        default:
+            return CoalesceKind::NONE;
+    }
+}
+
+// Merge the presses queued behind cmd into it, removing them from the queue
+// and counting them as coalesced. cmd becomes the newest preset if one was
+// superseded. Returns the number of presses cmd now stands for; 0 means
+// the presses cancelled out and nothing needs to be sent (cmd itself is
+// then the caller's to count).
+template <size_t N>
+uint32_t coalesce(CommandQueue<N>& queue, QueuedCommand& cmd, uint32_t windowUs) {
+    if (cmd.action != CommandAction::PRESS) return 1;
+
+    CoalesceKind kind = coalesceKind(cmd.cmdChar);
+    if (kind == CoalesceKind::NONE) return 1;
+
+    uint32_t presses = 1;
+    uint32_t lastUs = cmd.enqueuedUs;
+    QueuedCommand next;
+    while (queue.peek(next) && next.action == CommandAction::PRESS && next.enqueuedUs - lastUs <= windowUs) {
+        if (kind == CoalesceKind::SUPERSEDE) {
+            if (coalesceKind(next.cmdChar) != CoalesceKind::SUPERSEDE) break;
+            cmd = next;
+        } else {
+            if (next.cmdChar != cmd.cmdChar) break;
+            presses++;
+        }
+        lastUs = next.enqueuedUs;
+        queue.dequeue(next);
+        queue.recordCoalesced();
+    }
+
+    return kind == CoalesceKind::TOGGLE ? presses % 2 : presses;
+}
+
+#endif // COMMAND_COALESCER_H
@@ -0,0 +1,197 @@
+#ifndef COMMAND_QUEUE_H
+#define COMMAND_QUEUE_H
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+
+// =============================================================================
+// Bounded single-producer / single-consumer ring buffer
+// Storage is inline, so pushing and popping never allocates. Exactly one
+// thread may push and exactly one thread may pop. No Arduino dependencies,
+// so this builds for a host target as well as the ESP32.
+// =============================================================================
+template <typename T, size_t N>
+class SpscRing {
+    static_assert(N >= 2 && (N & (N - 1)) == 0, "SpscRing capacity must be a power of two");
+
+public:
+    static constexpr size_t CAPACITY = N;
+
+    // Producer side. Returns false if the ring is full.
+    bool push(const T& item) {
+        const size_t head = _head.load(std::memory_order_relaxed);
+        if (head - _tail.load(std::memory_order_acquire) == N) {
+            return false;
+        }
+        _slots[head & (N - 1)] = item;
+        _head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer side. Returns false if the ring is empty.
+    bool pop(T& item) {
+        const size_t tail = _tail.load(std::memory_order_relaxed);
+        if (tail == _head.load(std::memory_order_acquire)) {
+            return false;
+        }
+        item = _slots[tail & (N - 1)];
+        _tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer side. Copies the oldest item without removing it; false if empty.
+    bool peek(T& item) const {
+        const size_t tail = _tail.load(std::memory_order_relaxed);
+        if (tail == _head.load(std::memory_order_acquire)) {
+            return false;
+        }
+        item = _slots[tail & (N - 1)];
+        return true;
+    }
+
+    // Safe to call from either side; the value may be stale by the time it is used
+    size_t size() const {
+        return _head.load(std::memory_order_acquire) - _tail.load(std::memory_order_acquire);
+    }
+
+    bool empty() const { return size() == 0; }
+
+private:
+    T _slots[N];
+    std::atomic<size_t> _head{0};  // Written by producer only
+    std::atomic<size_t> _tail{0};  // Written by consumer only
+};
+
+// =============================================================================
+// Per-bed BLE command queue
+// The MQTT callback enqueues, the BLE worker task dequeues and writes.
+// Timestamps are passed in by the caller (micros() on the ESP32) so the
+// queue itself stays clock-agnostic.
+// =============================================================================
+enum class CommandAction : uint8_t {
+    PRESS,              // Single write
+    HOLD_START,         // Start (or refresh) a repeating motor hold
+    HOLD_STOP,          // End the motor hold
+    MACRO_RUN,          // Start a macro; cmdChar carries the macro index
+    MACRO_STOP,         // Cancel the running macro; cmdChar carries the macro index
+    POSITION_SET,       // Drive an actuator (index in cmdChar) to arg percent
+    POSITION_STOP,      // Stop an actuator driven by a position command or hold
+    CALIBRATE_START,    // Home an actuator, then time a full rise
+    CALIBRATE_STOP      // The rising actuator reached the top
+};
+
+struct QueuedCommand {
+    char cmdChar;
+    CommandAction action;
+    uint8_t arg;            // POSITION_SET target percent
+    uint32_t enqueuedUs;
+};
+
+// Snapshot of queue counters, safe to read from any task
+struct CommandQueueStats {
+    uint32_t enqueued;
+    uint32_t written;
+    uint32_t failed;
+    uint32_t dropped;
+    uint32_t coalesced;         // Merged into another command instead of being sent
+    uint32_t preempted;         // Skipped because a stop overtook it
+    uint32_t depth;
+    uint32_t highWater;
+    uint32_t lastLatencyUs;
+    uint32_t maxLatencyUs;
+    uint32_t avgLatencyUs;
+};
+
+template <size_t N>
+class CommandQueue {
+public:
+    // Producer side (MQTT callback). Returns false and counts a drop if full.
+    bool enqueue(char cmdChar, uint32_t nowUs, CommandAction action = CommandAction::PRESS, uint8_t arg = 0) {
+        if (!_ring.push(QueuedCommand{cmdChar, action, arg, nowUs})) {
+            _dropped.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        _enqueued.fetch_add(1, std::memory_order_relaxed);
+
+        uint32_t depth = _ring.size();
+        if (depth > _highWater.load(std::memory_order_relaxed)) {
+            _highWater.store(depth, std::memory_order_relaxed);
+        }
+        return true;
+    }
+
+    // Consumer side (BLE worker)
+    bool dequeue(QueuedCommand& cmd) {
+        return _ring.pop(cmd);
+    }
+
+    bool peek(QueuedCommand& cmd) const {
+        return _ring.peek(cmd);
+    }
+
+    // Consumer side: call once the command has been written to the bed
+    void recordWrite(const QueuedCommand& cmd, uint32_t nowUs) {
+        uint32_t latency = nowUs - cmd.enqueuedUs;
+        _written.fetch_add(1, std::memory_order_relaxed);
+        _lastLatencyUs.store(latency, std::memory_order_relaxed);
+        _totalLatencyUs.fetch_add(latency, std::memory_order_relaxed);
+        if (latency > _maxLatencyUs.load(std::memory_order_relaxed)) {
+            _maxLatencyUs.store(latency, std::memory_order_relaxed);
+        }
+    }
+
+    // Consumer side: call when the bed could not be reached
+    void recordFailure() {
+        _failed.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // Consumer side: call for a command made redundant by another
+    void recordCoalesced() {
+        _coalesced.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // Consumer side: call for a command cancelled by a later stop
+    void recordPreempted() {
+        _preempted.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    size_t depth() const { return _ring.size(); }
+    bool empty() const { return _ring.empty(); }
+
+    CommandQueueStats getStats() const {
+        CommandQueueStats stats;
+        stats.enqueued = _enqueued.load(std::memory_order_relaxed);
+        stats.written = _written.load(std::memory_order_relaxed);
+        stats.failed = _failed.load(std::memory_order_relaxed);
+        stats.dropped = _dropped.load(std::memory_order_relaxed);
+        stats.coalesced = _coalesced.load(std::memory_order_relaxed);
+        stats.preempted = _preempted.load(std::memory_order_relaxed);
+        stats.depth = _ring.size();
+        stats.highWater = _highWater.load(std::memory_order_relaxed);
+        stats.lastLatencyUs = _lastLatencyUs.load(std::memory_order_relaxed);
+        stats.maxLatencyUs = _maxLatencyUs.load(std::memory_order_relaxed);
+        uint64_t total = _totalLatencyUs.load(std::memory_order_relaxed);
+        stats.avgLatencyUs = stats.written ? static_cast<uint32_t>(total / stats.written) : 0;
+        return stats;
+    }
+
+private:
+    SpscRing<QueuedCommand, N> _ring;
+
+    // Producer-owned counters
+    std::atomic<uint32_t> _enqueued{0};
+    std::atomic<uint32_t> _dropped{0};
+    std::atomic<uint32_t> _highWater{0};
+
+    // Consumer-owned counters
+    std::atomic<uint32_t> _written{0};
+    std::atomic<uint32_t> _failed{0};
+    std::atomic<uint32_t> _coalesced{0};
+    std::atomic<uint32_t> _preempted{0};
+    std::atomic<uint32_t> _lastLatencyUs{0};
+    std::atomic<uint32_t> _maxLatencyUs{0};
+    std::atomic<uint64_t> _totalLatencyUs{0};
+};
+
+#endif // COMMAND_QUEUE_H
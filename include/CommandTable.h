@@ -0,0 +1,137 @@
+#ifndef COMMAND_TABLE_H
+#define COMMAND_TABLE_H
+
+#include <string.h>
+#include "MotoSleepCommands.h"
+
+// =============================================================================
+// Command lookup by name
+// A perfect hash over Command::name, generated at compile time from the
+// command tables in MotoSleepCommands.h. A lookup hashes the name once,
+// indexes a 64-slot table and confirms with a single memcmp. No heap
+// allocation, no string copies, no Arduino dependencies. The tables are
+// inline, so every source file that looks commands up shares one copy.
+// =============================================================================
+
+namespace MotoSleep {
+
+struct CommandEntry {
+    const Command* command;
+    Category category;
+    Priority priority;
+    uint8_t nameLength;
+};
+
+namespace detail {
+
+constexpr size_t length(const char* s) {
+    size_t len = 0;
+    while (s[len]) len++;
+    return len;
+}
+
+// FNV-1a with a searchable offset basis
+constexpr uint32_t hash(const char* s, size_t len, uint32_t seed) {
+    uint32_t h = 2166136261u ^ seed;
+    for (size_t i = 0; i < len; i++) {
+        h ^= static_cast<uint8_t>(s[i]);
+        h *= 16777619u;
+    }
+    return h ^ (h >> 16);
+}
+
+constexpr CommandEntry entry(const Command& cmd, Category category) {
+    return CommandEntry{&cmd, category, priorityOf(category, cmd.cmdChar), static_cast<uint8_t>(length(cmd.name))};
+}
+
+inline constexpr CommandEntry COMMANDS[] = {
+    entry(MOTOR_COMMANDS[0], Category::MOTOR),
+    entry(MOTOR_COMMANDS[1], Category::MOTOR),
+    entry(MOTOR_COMMANDS[2], Category::MOTOR),
+    entry(MOTOR_COMMANDS[3], Category::MOTOR),
+    entry(MOTOR_COMMANDS[4], Category::MOTOR),
+    entry(MOTOR_COMMANDS[5], Category::MOTOR),
+    entry(PRESET_COMMANDS[0], Category::PRESET),
+    entry(PRESET_COMMANDS[1], Category::PRESET),
+    entry(PRESET_COMMANDS[2], Category::PRESET),
+    entry(PRESET_COMMANDS[3], Category::PRESET),
+    entry(PRESET_COMMANDS[4], Category::PRESET),
+    entry(PRESET_COMMANDS[5], Category::PRESET),
+    entry(PROGRAM_COMMANDS[0], Category::PROGRAM),
+    entry(PROGRAM_COMMANDS[1], Category::PROGRAM),
+    entry(PROGRAM_COMMANDS[2], Category::PROGRAM),
+    entry(PROGRAM_COMMANDS[3], Category::PROGRAM),
+    entry(PROGRAM_COMMANDS[4], Category::PROGRAM),
+    entry(MASSAGE_COMMANDS[0], Category::MASSAGE),
+    entry(MASSAGE_COMMANDS[1], Category::MASSAGE),
+    entry(MASSAGE_COMMANDS[2], Category::MASSAGE),
+    entry(MASSAGE_COMMANDS[3], Category::MASSAGE),
+    entry(MASSAGE_COMMANDS[4], Category::MASSAGE),
+    entry(LIGHT_COMMANDS[0], Category::LIGHT),
+};
+constexpr size_t COMMAND_COUNT = sizeof(COMMANDS) / sizeof(COMMANDS[0]);
+
+static_assert(COMMAND_COUNT == MOTOR_COMMAND_COUNT + PRESET_COMMAND_COUNT + PROGRAM_COMMAND_COUNT +
+                               MASSAGE_COMMAND_COUNT + LIGHT_COMMAND_COUNT,
+              "COMMANDS must list every entry of the command tables");
+
+constexpr size_t TABLE_SIZE = 64;  // Power of two, comfortably above COMMAND_COUNT
+static_assert(COMMAND_COUNT < 128, "Slot indices are stored as int8_t");
+
+constexpr bool isPerfect(uint32_t seed) {
+    bool used[TABLE_SIZE] = {};
+    for (size_t i = 0; i < COMMAND_COUNT; i++) {
+        size_t slot = hash(COMMANDS[i].command->name, COMMANDS[i].nameLength, seed) & (TABLE_SIZE - 1);
+        if (used[slot]) return false;
+        used[slot] = true;
+    }
+    return true;
+}
+
+constexpr uint32_t findSeed() {
+    for (uint32_t seed = 0; seed < 100000; seed++) {
+        if (isPerfect(seed)) return seed;
+    }
+    return UINT32_MAX;
+}
+
+constexpr uint32_t SEED = findSeed();
+static_assert(SEED != UINT32_MAX, "No perfect hash seed found; grow TABLE_SIZE");
+
+struct SlotTable {
+    int8_t slots[TABLE_SIZE];
+};
+
+constexpr SlotTable buildSlots() {
+    SlotTable table{};
+    for (size_t i = 0; i < TABLE_SIZE; i++) {
+        table.slots[i] = -1;
+    }
+    for (size_t i = 0; i < COMMAND_COUNT; i++) {
+        size_t slot = hash(COMMANDS[i].command->name, COMMANDS[i].nameLength, SEED) & (TABLE_SIZE - 1);
+        table.slots[slot] = static_cast<int8_t>(i);
+    }
+    return table;
+}
+
+inline constexpr SlotTable SLOTS = buildSlots();
+
+} // namespace detail
+
+// Look up a command by name (not necessarily null-terminated).
+// Returns nullptr if the name is not a known command.
+inline const CommandEntry* findCommand(const char* name, size_t len) {
+    size_t slot = detail::hash(name, len, detail::SEED) & (detail::TABLE_SIZE - 1);
+    int8_t index = detail::SLOTS.slots[slot];
+    if (index < 0) return nullptr;
+
+    const CommandEntry& entry = detail::COMMANDS[index];
+    if (entry.nameLength != len || memcmp(entry.command->name, name, len) != 0) {
+        return nullptr;
+    }
+    return &entry;
+}
+
+} // namespace MotoSleep
+
+#endif // COMMAND_TABLE_H
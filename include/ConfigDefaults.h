@@ -0,0 +1,199 @@
+#ifndef CONFIG_DEFAULTS_H
+#define CONFIG_DEFAULTS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "config.h"
+
+// =============================================================================
+// Settings defaults
+// A config.h copied from an older config.h.template still builds: each
+// setting it lacks takes the template's value here. Sources include this
+// instead of config.h. Log.h defaults its own settings.
+// =============================================================================
+
+// BLE worker task and per-bed command queues
+#ifndef COMMAND_QUEUE_DEPTH
+#define COMMAND_QUEUE_DEPTH 8
+#endif
+#ifndef STOP_QUEUE_DEPTH
+#define STOP_QUEUE_DEPTH 4
+#endif
+#ifndef BLE_WORKER_STACK_SIZE
+#define BLE_WORKER_STACK_SIZE 8192
+#endif
+#ifndef BLE_WORKER_PRIORITY
+#define BLE_WORKER_PRIORITY 2
+#endif
+#ifndef BLE_WORKER_CORE
+#define BLE_WORKER_CORE 0
+#endif
+#ifndef BED_EVENT_RING_SIZE
+#define BED_EVENT_RING_SIZE 16
+#endif
+#ifndef SCAN_RESULT_RING_SIZE
+#define SCAN_RESULT_RING_SIZE 8
+#endif
+#ifndef STATS_PUBLISH_INTERVAL
+#define STATS_PUBLISH_INTERVAL 60000
+#endif
+
+// Connection pool. BLE_STAY_CONNECTED (true/false) became BLE_IDLE_TIMEOUT;
+// an older config.h keeps its behaviour: never disconnect, or disconnect
+// after every command.
+#ifdef BLE_STAY_CONNECTED
+#ifdef BLE_IDLE_TIMEOUT
+#error "BLE_STAY_CONNECTED has been replaced by BLE_IDLE_TIMEOUT; remove it from config.h"
+#endif
+#define BLE_IDLE_TIMEOUT (BLE_STAY_CONNECTED ? 0xFFFFFFFFUL : 0UL)
+#endif
+#ifndef BLE_IDLE_TIMEOUT
+#define BLE_IDLE_TIMEOUT 30000
+#endif
+#ifndef BLE_MAX_CONNECTIONS
+#define BLE_MAX_CONNECTIONS 3
+#endif
+
+// Motor hold streaming
+#ifndef MOTOR_HOLD_INTERVAL
+#define MOTOR_HOLD_INTERVAL 100
+#endif
+#ifndef MOTOR_HOLD_DEADMAN
+#define MOTOR_HOLD_DEADMAN 3000
+#endif
+#ifndef COALESCE_WINDOW_MS
+#define COALESCE_WINDOW_MS 1000
+#endif
+
+// Home Assistant discovery
+#ifndef HA_DISCOVERY_DEVICE_MODE
+#define HA_DISCOVERY_DEVICE_MODE true
+#endif
+
+// MQTT
+#ifndef MQTT_BUFFER_SIZE
+#define MQTT_BUFFER_SIZE 256
+#endif
+#ifndef MQTT_ASYNC
+#define MQTT_ASYNC true
+#endif
+#ifndef MQTT_PUBLISH_BUFFER_SIZE
+#define MQTT_PUBLISH_BUFFER_SIZE 10240
+#endif
+
+// Latency metrics
+#ifndef METRICS_PUBLISH_INTERVAL
+#define METRICS_PUBLISH_INTERVAL 60000
+#endif
+
+// A config.h from before groups and macros (no CONFIG_VERSION) gets the
+// "all" group and no macros
+#if !defined(CONFIG_VERSION) || CONFIG_VERSION < 2
+struct BedGroupConfig {
+    const char* id;
+    const char* friendlyName;
+    uint32_t members;
+};
+
+#define BED_GROUP_ALL 0xFFFFFFFFu
+
+const BedGroupConfig BED_GROUPS[] = {
+    {"all", "All Beds", BED_GROUP_ALL},
+};
+
+const size_t BED_GROUP_COUNT = sizeof(BED_GROUPS) / sizeof(BED_GROUPS[0]);
+
+struct MacroConfig {
+    const char* id;
+    const char* friendlyName;
+    const char* steps;
+};
+
+const MacroConfig MACROS[] = {
+    {"", "", ""},
+};
+
+const size_t MACRO_COUNT = 0;
+#endif
+
+// Macros
+#ifndef MACRO_MAX_STEPS
+#define MACRO_MAX_STEPS 16
+#endif
+#ifndef MACRO_TICK_MS
+#define MACRO_TICK_MS 10
+#endif
+
+// Logging
+#ifndef LOG_MQTT_MIRROR_INTERVAL
+#define LOG_MQTT_MIRROR_INTERVAL 1000
+#endif
+
+// WiFi reconnect
+#ifndef WIFI_CONNECT_TIMEOUT
+#define WIFI_CONNECT_TIMEOUT 20000
+#endif
+#ifndef WIFI_BACKOFF_MIN
+#define WIFI_BACKOFF_MIN 1000
+#endif
+#ifndef WIFI_BACKOFF_MAX
+#define WIFI_BACKOFF_MAX 60000
+#endif
+#ifndef WIFI_RESTART_AFTER
+#define WIFI_RESTART_AFTER 1800000
+#endif
+#ifndef LOOP_STALL_THRESHOLD
+#define LOOP_STALL_THRESHOLD 100
+#endif
+
+// Head/feet position estimate
+#ifndef HEAD_TRAVEL_UP_MS
+#define HEAD_TRAVEL_UP_MS 25000
+#endif
+#ifndef HEAD_TRAVEL_DOWN_MS
+#define HEAD_TRAVEL_DOWN_MS 22000
+#endif
+#ifndef FEET_TRAVEL_UP_MS
+#define FEET_TRAVEL_UP_MS 20000
+#endif
+#ifndef FEET_TRAVEL_DOWN_MS
+#define FEET_TRAVEL_DOWN_MS 18000
+#endif
+#ifndef POSITION_PUBLISH_INTERVAL
+#define POSITION_PUBLISH_INTERVAL 500
+#endif
+
+// Bed registry
+#ifndef MAX_BEDS
+#define MAX_BEDS 4
+#endif
+
+// BLE scanning
+#ifndef BLE_SCAN_GAP_MIN
+#define BLE_SCAN_GAP_MIN 5000
+#endif
+#ifndef BLE_SCAN_GAP_MAX
+#define BLE_SCAN_GAP_MAX 300000
+#endif
+#ifndef BLE_PRESENCE_SCAN_INTERVAL
+#define BLE_PRESENCE_SCAN_INTERVAL 600000
+#endif
+#ifndef BLE_RESCAN_AFTER_FAILURES
+#define BLE_RESCAN_AFTER_FAILURES 3
+#endif
+
+// BLE connects and the per-bed circuit breaker
+#ifndef BLE_CONNECT_TIMEOUT
+#define BLE_CONNECT_TIMEOUT 5000
+#endif
+#ifndef BLE_BREAKER_THRESHOLD
+#define BLE_BREAKER_THRESHOLD 3
+#endif
+#ifndef BLE_RECONNECT_INTERVAL
+#define BLE_RECONNECT_INTERVAL 30000
+#endif
+#ifndef BLE_RECONNECT_INTERVAL_MAX
+#define BLE_RECONNECT_INTERVAL_MAX 300000
+#endif
+
+#endif // CONFIG_DEFAULTS_H
@@ -0,0 +1,77 @@
+#ifndef CONNECTION_POOL_H
+#define CONNECTION_POOL_H
+
+#include <Arduino.h>
+#include <atomic>
+#include "MotoSleepBed.h"
+#include "ConfigDefaults.h"
+
+// Per-bed connection counters, safe to read from any task
+struct ConnectionStats {
+    uint32_t warmSends;     // Command sent over an already-open link
+    uint32_t coldSends;     // Command needed a fresh connect
+    uint32_t connectFailures;
+    uint32_t idleEvictions;
+    uint32_t lruEvictions;
+};
+
+// Outcome of acquire(). A refusal for want of a slot never tried the bed.
+enum class AcquireResult : uint8_t {
+    CONNECTED,          // Linked, warm or freshly connected
+    NO_SLOT,            // Pool full of pinned beds; no connect was tried
+    CONNECT_FAILED      // The connect was tried and failed
+};
+
+// Keeps bed links open for an idle window after the last command and
+// enforces the controller's concurrent-connection limit by evicting the
+// least recently used bed. Empty (null) bed slots are skipped. Only the
+// BLE worker task may call acquire(), release() and evictIdle().
+class ConnectionPool {
+public:
+    ConnectionPool(MotoSleepBed** beds, size_t count);
+
+    // Ensure the bed is connected, evicting the LRU bed if the pool is full
+    AcquireResult acquire(size_t index);
+
+    // Mark the bed as used just now; starts its idle window
+    void release(size_t index);
+
+    // A pinned bed is never evicted (e.g. while a motor hold is streaming)
+    void setPinned(size_t index, bool pinned) { _slots[index].pinned = pinned; }
+
+    // Disconnect beds whose idle window has expired.
+    // Returns ms until the next bed is due to expire (or maxWaitMs).
+    unsigned long evictIdle(unsigned long maxWaitMs);
+
+    // Idle window after the last command (0 = disconnect right after sending)
+    void setIdleTimeout(unsigned long ms) { _idleTimeoutMs = ms; }
+    unsigned long getIdleTimeout() const { return _idleTimeoutMs; }
+
+    size_t connectedCount() const;
+    ConnectionStats getStats(size_t index) const;
+
+private:
+    struct Slot {
+        unsigned long lastUsed = 0;
+        bool pinned = false;
+        std::atomic<uint32_t> warmSends{0};
+        std::atomic<uint32_t> coldSends{0};
+        std::atomic<uint32_t> connectFailures{0};
+        std::atomic<uint32_t> idleEvictions{0};
+        std::atomic<uint32_t> lruEvictions{0};
+    };
+
+    MotoSleepBed** _beds;
+    size_t _count;
+    Slot _slots[MAX_BEDS];
+    volatile unsigned long _idleTimeoutMs = BLE_IDLE_TIMEOUT;
+
+    // Minimum time between the last write and a disconnect, so a
+    // write-without-response has left the radio before the link drops
+    static constexpr unsigned long WRITE_SETTLE_MS = 100;
+
+    unsigned long expiryDelay() const;
+    bool evictLeastRecentlyUsed(size_t except);
+};
+
+#endif // CONNECTION_POOL_H
@@ -0,0 +1,61 @@
+#ifndef ESP32_BLE_LINK_H
+#define ESP32_BLE_LINK_H
+
+#include <Arduino.h>
+#include <esp_timer.h>
+#include <BLEDevice.h>
+#include <BLEClient.h>
+#include <BLEUtils.h>
+#include <esp_gattc_api.h>
+#include "BedLink.h"
+#include "MotoSleepCommands.h"
+
+class Esp32BleLink;
+
+// Callback class for BLE client connection events
+class BedClientCallback : public BLEClientCallbacks {
+public:
+    BedClientCallback(Esp32BleLink* link) : _link(link) {}
+
+    void onConnect(BLEClient* client) override;
+    void onDisconnect(BLEClient* client) override;
+
+private:
+    Esp32BleLink* _link;
+};
+
+// BedLink over the ESP32 Arduino BLE client. The client and its callbacks
+// are created once and reused for every connection, so reconnecting doesn't
+// touch the heap beyond what the BLE stack does itself.
+class Esp32BleLink : public BedLink {
+public:
+    // name is only used for log messages and must outlive the link
+    explicit Esp32BleLink(const char* name);
+    ~Esp32BleLink() override;
+
+    bool connect(const uint8_t address[6]) override;
+    void disconnect() override;
+    bool isConnected() const override;
+    ConnectTiming lastConnectTiming() const override { return _timing; }
+    bool write(const uint8_t* data, size_t len) override;
+    uint16_t getHandle() const override { return _handle; }
+    void setHandle(uint16_t handle) override { _handle = handle; }
+    int64_t nowUs() const override { return esp_timer_get_time(); }
+
+private:
+    static constexpr uint32_t WRITE_RESPONSE_TIMEOUT_MS = 1000;
+
+    const char* _name;
+    BLEClient* _client = nullptr;          // Created on the first connect, kept until the link is destroyed
+    BedClientCallback _callbacks{this};
+    BLERemoteCharacteristic* _characteristic = nullptr;
+    ConnectTiming _timing = {};
+    uint16_t _handle = 0;
+    bool _handleChecked = false;          // The bed accepted a write through _handle on this connection
+
+    bool discover();
+    bool writeChecked(const uint8_t* data, size_t len, bool& rejected);
+    void cleanup();
+};
+
+#endif // ESP32_BLE_LINK_H
@@ -2,18 +2,55 @@
 #define HA_DISCOVERY_H
 
 #include <Arduino.h>
-#include <PubSubClient.h>
-#include <ArduinoJson.h>
-#include "config.h"
+#include "ConfigDefaults.h"
 #include "MotoSleepCommands.h"
+#include "JsonWriter.h"
+#include "LatencyHistogram.h"
+#include "MqttTransport.h"
+
+#define MOTOSLEEP_SW_VERSION "1.0.0"
+
+// Home Assistant publishes "online" here when it (re)starts
+#define HA_STATUS_TOPIC HA_DISCOVERY_PREFIX "/status"
+
+// Cost of the most recent discovery pass
+struct DiscoveryStats {
+    uint32_t publishes;
+    uint32_t bytes;
+    uint32_t durationMs;
+};
+
+// Discovery passes published vs skipped because nothing changed
+struct DiscoveryPassCounts {
+    uint32_t published;
+    uint32_t skipped;
+};
 
 class HADiscovery {
 public:
-    HADiscovery(PubSubClient& mqtt);
+    HADiscovery(MqttTransport& mqtt);
+
+    // Start a pass publishing controller discovery plus discovery for every
+    // bed and group, and record its cost. Skipped if the rendered configs
+    // hash the same as the last pass that reached the broker, unless force
+    // is set. The arrays must outlive the pass.
+    void startPass(const BedConfig* beds, size_t count,
+                   const BedGroupConfig* groups, size_t groupCount, bool force = false);
+
+    // Publish the next device of the pass in progress, so a pass is spread
+    // across loop() iterations. Returns false once there is nothing left.
+    bool servicePass();
+    bool passActive() const { return _passActive; }
+
+    const DiscoveryStats& getLastPassStats() const { return _lastPass; }
+    const DiscoveryPassCounts& getPassCounts() const { return _passCounts; }
 
     // Publish discovery configs for a bed
     void publishBedDiscovery(const BedConfig& bed);
 
+    // Publish discovery configs for a group: its buttons, without covers or diagnostics
+    void publishGroupDiscovery(const BedGroupConfig& group);
+
     // Remove discovery configs for a bed
     void removeBedDiscovery(const BedConfig& bed);
 
@@ -21,19 +58,66 @@ public:
     void publishControllerDiscovery();
 
 private:
-    PubSubClient& _mqtt;
+    MqttTransport& _mqtt;
+    DiscoveryStats _pass = {};
+    DiscoveryStats _lastPass = {};
+    DiscoveryPassCounts _passCounts = {};
+    bool _passFailed = false;
+
+    // Pass in progress: step 0 is the controller, then beds, then groups
+    bool _passActive = false;
+    size_t _passStep = 0;
+    uint32_t _passHash = 0;
+    unsigned long _passStart = 0;
+    const BedConfig* _passBeds = nullptr;
+    size_t _passBedCount = 0;
+    const BedGroupConfig* _passGroups = nullptr;
+    size_t _passGroupCount = 0;
+
+    // While set, publishStreamed() hashes topic and payload instead of sending
+    HashingPrint* _hashSink = nullptr;
+
+    uint32_t computeHash(const BedConfig* beds, size_t count,
+                         const BedGroupConfig* groups, size_t groupCount);
+    uint32_t loadStoredHash();
+    void storeHash(uint32_t hash);
 
     // Helper to publish a button entity
-    void publishButton(const BedConfig& bed, const MotoSleep::Command& cmd);
+    void publishButton(const BedConfig& bed, const MotoSleep::Command& cmd, bool group);
+
+    // Helper to publish a diagnostic latency sensor for one command path stage
+    void publishLatencySensor(const BedConfig& bed, size_t stage);
+
+    // Helper to publish an actuator's position cover and calibration button
+    void publishCover(const BedConfig& bed, size_t actuator);
+
+    // Device-based discovery: one payload per bed with every button, cover
+    // and latency sensor as a component. Groups get the buttons only.
+    void publishBedDevice(const BedConfig& bed, bool group);
+
+    // Buttons (and, for beds, covers and latency sensors) in either discovery mode
+    void publishEntities(const BedConfig& bed, bool group);
+
+    // Render a payload with JsonWriter and stream it to the broker as a
+    // retained message, counted towards the current pass
+    template <typename Render>
+    bool publishStreamed(const char* topic, Render render);
 
-    // Helper to publish device info
-    void addDeviceInfo(JsonObject& device, const BedConfig& bed);
-    void addControllerDeviceInfo(JsonObject& device);
+    // Payload fragments
+    void writeButton(JsonWriter& json, const BedConfig& bed, const MotoSleep::Command& cmd);
+    void writeLatencySensor(JsonWriter& json, const BedConfig& bed, size_t stage);
+    void writeCover(JsonWriter& json, const BedConfig& bed, size_t actuator);
+    void writeCalibrateButton(JsonWriter& json, const BedConfig& bed, size_t actuator);
+    void writeDeviceInfo(JsonWriter& json, const BedConfig& bed, bool group);
+    void writeControllerDeviceInfo(JsonWriter& json);
+    void writeAvailability(JsonWriter& json, const BedConfig& bed, bool group);
 
-    // Build topic strings
-    String getDiscoveryTopic(const char* component, const BedConfig& bed, const char* entityId);
-    String getCommandTopic(const BedConfig& bed, const char* entityId);
-    String getStateTopic(const BedConfig& bed);
+    // Build topic strings into caller-provided buffers
+    void formatDiscoveryTopic(char* buffer, size_t size, const char* component, const BedConfig& bed, const char* entityId);
+    void formatDeviceDiscoveryTopic(char* buffer, size_t size, const BedConfig& bed);
+    void formatStateTopic(char* buffer, size_t size, const BedConfig& bed);
+    void formatLatencyEntityId(char* buffer, size_t size, size_t stage);
+    void formatActuatorEntityId(char* buffer, size_t size, size_t actuator, const char* suffix);
 };
 
 #endif // HA_DISCOVERY_H
@@ -0,0 +1,61 @@
+#ifndef HEAP_STATS_H
+#define HEAP_STATS_H
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+
+// =============================================================================
+// Per-command heap accounting
+// The BLE worker samples the number of allocated heap blocks before and after
+// each command it runs. In steady state a command should leave the count
+// where it found it; a positive net count across many commands is a leak.
+// Other tasks allocate too, so a single sample is noisy, but the running
+// total stays near zero unless something on the command path keeps memory.
+// No Arduino dependencies.
+// =============================================================================
+
+// Snapshot of command heap counters, safe to read from any task
+struct CommandHeapStats {
+    uint32_t commands;          // Commands sampled
+    int32_t netBlocks;          // Blocks left allocated, summed over every command
+    int32_t lastBlocks;         // Net blocks of the most recent command
+    int32_t maxBlocks;          // Largest net blocks of a single command
+    uint32_t growingCommands;   // Commands that left more blocks allocated than they found
+};
+
+class CommandHeapTracker {
+public:
+    // Record one command from the allocated block counts around it
+    void record(size_t blocksBefore, size_t blocksAfter) {
+        int32_t net = static_cast<int32_t>(blocksAfter) - static_cast<int32_t>(blocksBefore);
+        _commands.fetch_add(1, std::memory_order_relaxed);
+        _netBlocks.fetch_add(net, std::memory_order_relaxed);
+        _lastBlocks.store(net, std::memory_order_relaxed);
+        if (net > 0) _growingCommands.fetch_add(1, std::memory_order_relaxed);
+
+        // Single writer (the BLE worker), so no compare-exchange needed
+        if (net > _maxBlocks.load(std::memory_order_relaxed)) {
+            _maxBlocks.store(net, std::memory_order_relaxed);
+        }
+    }
+
+    CommandHeapStats getStats() const {
+        return {
+            _commands.load(std::memory_order_relaxed),
+            _netBlocks.load(std::memory_order_relaxed),
+            _lastBlocks.load(std::memory_order_relaxed),
+            _maxBlocks.load(std::memory_order_relaxed),
+            _growingCommands.load(std::memory_order_relaxed)
+        };
+    }
+
+private:
+    std::atomic<uint32_t> _commands{0};
+    std::atomic<int32_t> _netBlocks{0};
+    std::atomic<int32_t> _lastBlocks{0};
+    std::atomic<int32_t> _maxBlocks{0};
+    std::atomic<uint32_t> _growingCommands{0};
+};
+
+#endif // HEAP_STATS_H
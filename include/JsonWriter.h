@@ -0,0 +1,149 @@
+#ifndef JSON_WRITER_H
+#define JSON_WRITER_H
+
+#include <Arduino.h>
+
+// =============================================================================
+// Streaming JSON writer
+// Writes objects and string fields straight to a Print, escaping as it goes,
+// so a payload never has to exist in memory as a whole. String values can be
+// assembled from several parts with beginString()/append()/endString().
+// =============================================================================
+class JsonWriter {
+public:
+    explicit JsonWriter(Print& out) : _out(out) {}
+
+    // Open an object; pass a key when nested inside another object
+    void beginObject(const char* key = nullptr) {
+        if (key) writeKey(key);
+        else separator();
+        _out.write('{');
+        push();
+    }
+
+    void endObject() {
+        _out.write('}');
+        pop();
+    }
+
+    // Open an array; its elements are objects opened without a key
+    void beginArray(const char* key) {
+        writeKey(key);
+        _out.write('[');
+        push();
+    }
+
+    void endArray() {
+        _out.write(']');
+        pop();
+    }
+
+    void beginString(const char* key) {
+        writeKey(key);
+        _out.write('"');
+    }
+
+    // Append escaped text to the open string value
+    void append(const char* text) {
+        for (const char* p = text; *p; p++) {
+            char c = *p;
+            if (c == '"' || c == '\\') {
+                _out.write('\\');
+                _out.write(c);
+            } else if (static_cast<uint8_t>(c) < 0x20) {
+                _out.printf("\\u%04x", c);
+            } else {
+                _out.write(c);
+            }
+        }
+    }
+
+    void endString() { _out.write('"'); }
+
+    void field(const char* key, const char* value) {
+        beginString(key);
+        append(value);
+        endString();
+    }
+
+    // Write a pre-formatted JSON value (number, true/false) as-is
+    void rawField(const char* key, const char* value) {
+        writeKey(key);
+        _out.write(value);
+    }
+
+private:
+    static constexpr uint8_t MAX_DEPTH = 8;
+
+    Print& _out;
+    bool _hasMember[MAX_DEPTH] = {};
+    uint8_t _depth = 0;
+
+    void push() {
+        if (_depth < MAX_DEPTH - 1) _depth++;
+        _hasMember[_depth] = false;
+    }
+
+    void pop() {
+        if (_depth > 0) _depth--;
+    }
+
+    void separator() {
+        if (_hasMember[_depth]) _out.write(',');
+        _hasMember[_depth] = true;
+    }
+
+    void writeKey(const char* key) {
+        separator();
+        _out.write('"');
+        _out.write(key);
+        _out.write("\":");
+    }
+};
+
+// Counts bytes instead of writing them; used to size a streamed publish
+class CountingPrint : public Print {
+public:
+    using Print::write;
+
+    size_t write(uint8_t) override {
+        _count++;
+        return 1;
+    }
+
+    size_t write(const uint8_t*, size_t len) override {
+        _count += len;
+        return len;
+    }
+
+    size_t count() const { return _count; }
+
+private:
+    size_t _count = 0;
+};
+
+// FNV-1a hash of everything written; used to detect changed payloads
+class HashingPrint : public Print {
+public:
+    using Print::write;
+
+    size_t write(uint8_t c) override {
+        _hash ^= c;
+        _hash *= 16777619u;
+        return 1;
+    }
+
+    size_t write(const uint8_t* data, size_t len) override {
+        for (size_t i = 0; i < len; i++) {
+            write(data[i]);
+        }
+        return len;
+    }
+
+    uint32_t hash() const { return _hash; }
+
+private:
+    uint32_t _hash = 2166136261u;
+};
+
+#endif // JSON_WRITER_H
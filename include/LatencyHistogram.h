@@ -0,0 +1,127 @@
+#ifndef LATENCY_HISTOGRAM_H
+#define LATENCY_HISTOGRAM_H
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+
+// =============================================================================
+// Fixed-bucket latency histogram
+// 64 buckets, two per power of two (about +/-25% resolution), covering
+// 0 us to 2^32 us. Recording is one relaxed atomic increment, so any task can
+// record while another takes snapshots. A snapshot drains the buckets, which
+// makes each published snapshot cover the interval since the previous one.
+// No Arduino dependencies.
+// =============================================================================
+
+struct LatencySnapshot {
+    uint32_t count;
+    uint32_t p50Us;
+    uint32_t p95Us;
+    uint32_t p99Us;
+    uint32_t maxUs;
+};
+
+class LatencyHistogram {
+public:
+    static constexpr size_t BUCKETS = 64;
+
+    void record(uint32_t us) {
+        _buckets[bucketFor(us)].fetch_add(1, std::memory_order_relaxed);
+
+        uint32_t max = _maxUs.load(std::memory_order_relaxed);
+        while (us > max && !_maxUs.compare_exchange_weak(max, us, std::memory_order_relaxed)) {
+        }
+    }
+
+    // Read and reset. Percentiles are reported as the upper bound of their
+    // bucket, capped at the largest sample seen.
+    LatencySnapshot takeSnapshot() {
+        uint32_t counts[BUCKETS];
+        LatencySnapshot snapshot = {};
+
+        for (size_t i = 0; i < BUCKETS; i++) {
+            counts[i] = _buckets[i].exchange(0, std::memory_order_relaxed);
+            snapshot.count += counts[i];
+        }
+        snapshot.maxUs = _maxUs.exchange(0, std::memory_order_relaxed);
+        if (!snapshot.count) return snapshot;
+
+        snapshot.p50Us = percentile(counts, snapshot.count, 50, snapshot.maxUs);
+        snapshot.p95Us = percentile(counts, snapshot.count, 95, snapshot.maxUs);
+        snapshot.p99Us = percentile(counts, snapshot.count, 99, snapshot.maxUs);
+        return snapshot;
+    }
+
+    static size_t bucketFor(uint32_t us) {
+        if (us < 2) return us;
+        uint32_t msb = 31 - __builtin_clz(us);
+        return 2 * msb + ((us >> (msb - 1)) & 1);
+    }
+
+    static uint32_t bucketUpperBound(size_t bucket) {
+        if (bucket < 2) return bucket;
+        uint32_t msb = bucket / 2;
+        uint32_t half = 1u << (msb - 1);
+        uint32_t lower = (1u << msb) + (bucket & 1) * half;
+        return lower + (half - 1);
+    }
+
+private:
+    std::atomic<uint32_t> _buckets[BUCKETS] = {};
+    std::atomic<uint32_t> _maxUs{0};
+
+    static uint32_t percentile(const uint32_t* counts, uint32_t total, uint32_t pct, uint32_t maxUs) {
+        // Rank of the sample at this percentile, rounded up
+        uint64_t rank = (static_cast<uint64_t>(total) * pct + 99) / 100;
+        uint64_t seen = 0;
+        size_t bucket = 0;
+        while (bucket < BUCKETS - 1) {
+            seen += counts[bucket];
+            if (seen >= rank) break;
+            bucket++;
+        }
+        uint32_t bound = bucketUpperBound(bucket);
+        return bound < maxUs ? bound : maxUs;
+    }
+};
+
+// =============================================================================
+// Command path stages, timed per bed
+// =============================================================================
+enum class LatencyStage : uint8_t {
+    PARSE,          // mqttCallback: topic routing and enqueue
+    QUEUE,          // Waiting in the bed's command queue
+    CONNECT,        // BLE link establishment
+    DISCOVERY,      // GATT service/characteristic discovery
+    WRITE,          // Characteristic write
+    DISCONNECT,     // Link teardown
+    FIRST_WRITE_CACHED,     // Connect start to first write, cached handle
+    FIRST_WRITE_DISCOVERED, // Connect start to first write, full discovery
+    COUNT
+};
+
+constexpr size_t LATENCY_STAGE_COUNT = static_cast<size_t>(LatencyStage::COUNT);
+
+// Names used in the metrics payload and HA sensor IDs
+inline const char* latencyStageName(size_t stage) {
+    static const char* const NAMES[LATENCY_STAGE_COUNT] = {
+        "parse", "queue", "connect", "discovery", "write", "disconnect",
+        "first_write_cached", "first_write_discovered"
+    };
+    return stage < LATENCY_STAGE_COUNT ? NAMES[stage] : "unknown";
+}
+
+class StageLatencies {
+public:
+    void record(LatencyStage stage, uint32_t us) {
+        _stages[static_cast<size_t>(stage)].record(us);
+    }
+
+    LatencyHistogram& operator[](size_t stage) { return _stages[stage]; }
+
+private:
+    LatencyHistogram _stages[LATENCY_STAGE_COUNT];
+};
+
+#endif // LATENCY_HISTOGRAM_H
@@ -0,0 +1,104 @@
+#ifndef LOG_H
+#define LOG_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "config.h"
+
+// =============================================================================
+// Non-blocking logging
+// LOG_* calls format a fixed-size record into a lock-free ring and return; a
+// low-priority task writes the records to Serial. When the ring is full the
+// record is dropped and counted rather than stalling the caller. Each
+// subsystem has a compile-time level, so disabled calls compile away.
+// =============================================================================
+
+#define LOG_LEVEL_OFF   0
+#define LOG_LEVEL_ERROR 1
+#define LOG_LEVEL_WARN  2
+#define LOG_LEVEL_INFO  3
+#define LOG_LEVEL_DEBUG 4
+
+#ifndef LOG_LEVEL
+#define LOG_LEVEL LOG_LEVEL_INFO
+#endif
+#ifndef LOG_RING_SIZE
+#define LOG_RING_SIZE 32
+#endif
+#ifndef LOG_MQTT_MIRROR
+#define LOG_MQTT_MIRROR false
+#endif
+
+// Per-subsystem levels; override any of these in config.h
+#ifndef LOG_LEVEL_WIFI
+#define LOG_LEVEL_WIFI LOG_LEVEL
+#endif
+#ifndef LOG_LEVEL_MQTT
+#define LOG_LEVEL_MQTT LOG_LEVEL
+#endif
+#ifndef LOG_LEVEL_BLE
+#define LOG_LEVEL_BLE LOG_LEVEL
+#endif
+#ifndef LOG_LEVEL_BED
+#define LOG_LEVEL_BED LOG_LEVEL
+#endif
+#ifndef LOG_LEVEL_POOL
+#define LOG_LEVEL_POOL LOG_LEVEL
+#endif
+#ifndef LOG_LEVEL_HA
+#define LOG_LEVEL_HA LOG_LEVEL
+#endif
+#ifndef LOG_LEVEL_NVS
+#define LOG_LEVEL_NVS LOG_LEVEL
+#endif
+
+// Tag printed in front of each subsystem's messages
+#define LOG_TAG_WIFI "WiFi"
+#define LOG_TAG_MQTT "MQTT"
+#define LOG_TAG_BLE  "BLE"
+#define LOG_TAG_BED  "Bed"
+#define LOG_TAG_POOL "Pool"
+#define LOG_TAG_HA   "HA"
+#define LOG_TAG_NVS  "NVS"
+
+#define LOG_WRITE(level, sub, tag, ...) \
+    do { if ((level) <= LOG_LEVEL_##sub) Log::write(tag, __VA_ARGS__); } while (0)
+
+// LOG_INFO(BLE, "Found bed: %s", name) prints "[BLE] Found bed: ..."
+#define LOG_ERROR(sub, ...) LOG_WRITE(LOG_LEVEL_ERROR, sub, LOG_TAG_##sub, __VA_ARGS__)
+#define LOG_WARN(sub, ...)  LOG_WRITE(LOG_LEVEL_WARN, sub, LOG_TAG_##sub, __VA_ARGS__)
+#define LOG_INFO(sub, ...)  LOG_WRITE(LOG_LEVEL_INFO, sub, LOG_TAG_##sub, __VA_ARGS__)
+#define LOG_DEBUG(sub, ...) LOG_WRITE(LOG_LEVEL_DEBUG, sub, LOG_TAG_##sub, __VA_ARGS__)
+
+// Same, with a runtime tag such as a bed name in place of the subsystem tag
+#define LOG_ERROR_TAG(sub, tag, ...) LOG_WRITE(LOG_LEVEL_ERROR, sub, tag, __VA_ARGS__)
+#define LOG_WARN_TAG(sub, tag, ...)  LOG_WRITE(LOG_LEVEL_WARN, sub, tag, __VA_ARGS__)
+#define LOG_INFO_TAG(sub, tag, ...)  LOG_WRITE(LOG_LEVEL_INFO, sub, tag, __VA_ARGS__)
+#define LOG_DEBUG_TAG(sub, tag, ...) LOG_WRITE(LOG_LEVEL_DEBUG, sub, tag, __VA_ARGS__)
+
+// One formatted line, without the trailing newline
+struct LogRecord {
+    static constexpr size_t TEXT_SIZE = 120;
+
+    uint16_t length;
+    char text[TEXT_SIZE];
+};
+
+namespace Log {
+
+// Start the task that writes queued records to Serial; call once Serial is up
+void begin();
+
+// Queue "[tag] message"; lines longer than LogRecord::TEXT_SIZE are truncated
+void write(const char* tag, const char* format, ...) __attribute__((format(printf, 2, 3)));
+
+// Records lost because the ring was full
+uint32_t dropped();
+
+// With LOG_MQTT_MIRROR, records already written to Serial wait here to be
+// published in batches. Consumer side; call from one task only.
+bool popMirrored(LogRecord& record);
+
+} // namespace Log
+
+#endif // LOG_H
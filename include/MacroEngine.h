@@ -0,0 +1,245 @@
+#ifndef MACRO_ENGINE_H
+#define MACRO_ENGINE_H
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+#include "CommandTable.h"
+#include "LatencyHistogram.h"
+#include "TimerWheel.h"
+
+// =============================================================================
+// On-device macros
+// A macro is a short sequence of MotoSleep command chars, each started a
+// relative delay after the previous step ends, with motor steps optionally
+// held for a duration. Macros are written as text and parsed once at boot:
+//
+//   [+delay_ms ]command[:hold_ms], ...
+//
+// e.g. "feet_up:4000, +500 massage_head_step, +600000 light_toggle".
+// Running macros are driven by a hashed timer wheel; each step is scheduled
+// from the previous step's due time, so a late step doesn't push back the
+// ones after it. No Arduino dependencies.
+// =============================================================================
+
+struct MacroStep {
+    char cmdChar;
+    uint32_t delayMs;           // After the previous step (including its hold) ends
+    uint32_t holdMs;            // Motor commands only: repeat for this long (0 = single press)
+};
+
+enum class MacroParseError : uint8_t {
+    NONE,
+    EMPTY,
+    UNKNOWN_COMMAND,
+    BAD_NUMBER,
+    HOLD_NOT_MOTOR,             // Only motor commands can be held
+    TOO_MANY_STEPS
+};
+
+inline const char* macroParseErrorName(MacroParseError error) {
+    switch (error) {
+        case MacroParseError::NONE:            return "ok";
+        case MacroParseError::EMPTY:           return "no steps";
+        case MacroParseError::UNKNOWN_COMMAND: return "unknown command";
+        case MacroParseError::BAD_NUMBER:      return "bad number";
+        case MacroParseError::HOLD_NOT_MOTOR:  return "hold on a non-motor command";
+        case MacroParseError::TOO_MANY_STEPS:  return "too many steps";
+    }
+    return "?";
+}
+
+// A parsed macro with room for MaxSteps steps
+template <size_t MaxSteps>
+struct MacroProgram {
+    MacroStep steps[MaxSteps];
+    size_t count = 0;
+
+    // Parse text into steps. On error count is 0 and errorAt points at the
+    // offending step.
+    MacroParseError parse(const char* text, const char** errorAt = nullptr) {
+        count = 0;
+        const char* p = text;
+
+        while (*p) {
+            p = skipSpaces(p);
+            if (!*p) break;
+            if (errorAt) *errorAt = p;
+            if (count == MaxSteps) return fail(MacroParseError::TOO_MANY_STEPS);
+
+            MacroStep& step = steps[count];
+            step.delayMs = 0;
+            step.holdMs = 0;
+
+            if (*p == '+') {
+                if (!parseNumber(++p, step.delayMs)) return fail(MacroParseError::BAD_NUMBER);
+                p = skipSpaces(p);
+            }
+
+            const char* name = p;
+            while (*p && *p != ':' && *p != ',' && *p != ' ') p++;
+            const MotoSleep::CommandEntry* entry = MotoSleep::findCommand(name, p - name);
+            if (!entry) return fail(MacroParseError::UNKNOWN_COMMAND);
+            step.cmdChar = entry->command->cmdChar;
+
+            if (*p == ':') {
+                if (entry->category != MotoSleep::Category::MOTOR) return fail(MacroParseError::HOLD_NOT_MOTOR);
+                if (!parseNumber(++p, step.holdMs)) return fail(MacroParseError::BAD_NUMBER);
+            }
+
+            p = skipSpaces(p);
+            if (*p == ',') {
+                p++;
+            } else if (*p) {
+                return fail(MacroParseError::UNKNOWN_COMMAND);
+            }
+            count++;
+        }
+
+        return count ? MacroParseError::NONE : MacroParseError::EMPTY;
+    }
+
+private:
+    MacroParseError fail(MacroParseError error) {
+        count = 0;
+        return error;
+    }
+
+    static const char* skipSpaces(const char* p) {
+        while (*p == ' ') p++;
+        return p;
+    }
+
+    static bool parseNumber(const char*& p, uint32_t& value) {
+        if (*p < '0' || *p > '9') return false;
+        uint64_t v = 0;
+        while (*p >= '0' && *p <= '9') {
+            v = v * 10 + (*p++ - '0');
+            if (v > UINT32_MAX) return false;
+        }
+        value = static_cast<uint32_t>(v);
+        return true;
+    }
+};
+
+// Macro run counters, safe to read from any task
+struct MacroStats {
+    uint32_t started;
+    uint32_t completed;
+    uint32_t cancelled;         // Stopped, or replaced by another macro on the same bed
+    uint32_t failed;            // A step could not be written
+    uint32_t steps;
+};
+
+// Runs at most one macro per bed. Only the BLE worker task calls start(),
+// cancel() and service().
+template <size_t Beds, size_t Slots>
+class MacroEngine {
+public:
+    explicit MacroEngine(uint32_t tickUs) : _wheel(tickUs) {}
+
+    void begin(uint64_t nowUs) { _wheel.begin(nowUs); }
+
+    // Start a macro on a bed, replacing any macro already running there.
+    // The steps must outlive the run.
+    void start(size_t bed, const MacroStep* steps, size_t count, uint64_t nowUs) {
+        if (bed >= Beds || !count) return;
+        cancel(bed);
+
+        Run& run = _runs[bed];
+        run.steps = steps;
+        run.count = count;
+        run.next = 0;
+        _started.fetch_add(1, std::memory_order_relaxed);
+        _wheel.schedule(run.timer, nowUs + steps[0].delayMs * 1000ULL);
+    }
+
+    void cancel(size_t bed) {
+        if (bed >= Beds || !active(bed)) return;
+        _wheel.cancel(_runs[bed].timer);
+        _runs[bed].steps = nullptr;
+        _cancelled.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    bool active(size_t bed) const { return bed < Beds && _runs[bed].steps; }
+
+    // Run every step that is due. runStep(bed, step) writes the step and
+    // returns false if the bed could not be reached, which ends the macro.
+    template <typename F>
+    void service(uint64_t nowUs, F runStep) {
+        _wheel.advance(nowUs, [this, nowUs, &runStep](WheelTimer& timer) {
+            size_t bed = bedFor(timer);
+            Run& run = _runs[bed];
+            uint64_t dueUs = timer.dueUs();
+
+            // Steps with nothing to wait for run back-to-back
+            for (;;) {
+                const MacroStep& step = run.steps[run.next];
+
+                // Scheduling accuracy: how far past its due time the step started
+                _lateness.record(static_cast<uint32_t>(nowUs - dueUs));
+                _steps.fetch_add(1, std::memory_order_relaxed);
+
+                if (!runStep(bed, step)) {
+                    run.steps = nullptr;
+                    _failed.fetch_add(1, std::memory_order_relaxed);
+                    return;
+                }
+
+                if (++run.next == run.count) {
+                    run.steps = nullptr;
+                    _completed.fetch_add(1, std::memory_order_relaxed);
+                    return;
+                }
+
+                dueUs += (step.holdMs + (uint64_t)run.steps[run.next].delayMs) * 1000ULL;
+                if (dueUs > nowUs) {
+                    _wheel.schedule(timer, dueUs);
+                    return;
+                }
+            }
+        });
+    }
+
+    // Microseconds until service() next has something to do (UINT32_MAX if idle)
+    uint32_t untilNextUs(uint64_t nowUs) const { return _wheel.untilNextUs(nowUs); }
+
+    // Step start lateness since the last call
+    LatencySnapshot takeLatenessSnapshot() { return _lateness.takeSnapshot(); }
+
+    MacroStats getStats() const {
+        MacroStats stats;
+        stats.started = _started.load(std::memory_order_relaxed);
+        stats.completed = _completed.load(std::memory_order_relaxed);
+        stats.cancelled = _cancelled.load(std::memory_order_relaxed);
+        stats.failed = _failed.load(std::memory_order_relaxed);
+        stats.steps = _steps.load(std::memory_order_relaxed);
+        return stats;
+    }
+
+private:
+    struct Run {
+        WheelTimer timer;
+        const MacroStep* steps = nullptr;   // Null when idle
+        size_t count = 0;
+        size_t next = 0;
+    };
+
+    TimerWheel<Slots> _wheel;
+    Run _runs[Beds];
+    LatencyHistogram _lateness;
+
+    std::atomic<uint32_t> _started{0};
+    std::atomic<uint32_t> _completed{0};
+    std::atomic<uint32_t> _cancelled{0};
+    std::atomic<uint32_t> _failed{0};
+    std::atomic<uint32_t> _steps{0};
+
+    size_t bedFor(const WheelTimer& timer) const {
+        size_t bed = 0;
+        while (&_runs[bed].timer != &timer) bed++;
+        return bed;
+    }
+};
+
+#endif // MACRO_ENGINE_H
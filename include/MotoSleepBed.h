@@ -1,12 +1,12 @@
 #ifndef MOTOSLEEP_BED_H
 #define MOTOSLEEP_BED_H
 
-#include <Arduino.h>
-#include <BLEDevice.h>
-#include <BLEClient.h>
-#include <BLEUtils.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "BedLink.h"
+#include "LatencyHistogram.h"
 #include "MotoSleepCommands.h"
-#include "config.h"
+#include "ConfigDefaults.h"
 
 class MotoSleepBed {
 public:
@@ -17,7 +17,8 @@ public:
         ERROR
     };
 
-    MotoSleepBed(const BedConfig& config);
+    // The link carries all BLE traffic for this bed and must outlive it
+    MotoSleepBed(const BedConfig& config, BedLink& link);
     ~MotoSleepBed();
 
     // Connection management
@@ -27,10 +28,14 @@ public:
     State getState() const { return _state; }
 
     // Set the BLE address after scanning
-    void setAddress(BLEAddress* address);
-    bool hasAddress() const { return _address != nullptr; }
+    void setAddress(const uint8_t address[6]);
+    bool hasAddress() const { return _hasAddress; }
+    const uint8_t* getAddress() const { return _address; }
 
-    // Send a command to the bed
+    // Record connect, discovery, write and disconnect times here (optional)
+    void setLatencies(StageLatencies* latencies) { _latencies = latencies; }
+
+    // Send a command over the open connection; fails if not connected
     bool sendCommand(char cmdChar);
     bool sendCommand(const uint8_t* data, size_t len);
 
@@ -39,32 +44,20 @@ public:
     const char* getFriendlyName() const { return _config.friendlyName; }
     const char* getId() const { return _config.id; }
 
-    // For reconnection timing
-    unsigned long getLastConnectAttempt() const { return _lastConnectAttempt; }
-    void setLastConnectAttempt(unsigned long time) { _lastConnectAttempt = time; }
-
 private:
     BedConfig _config;
-    BLEAddress* _address = nullptr;
-    BLEClient* _client = nullptr;
-    BLERemoteCharacteristic* _characteristic = nullptr;
+    BedLink& _link;
+    uint8_t _address[6] = {};
+    volatile bool _hasAddress = false;
     State _state = State::DISCONNECTED;
-    unsigned long _lastConnectAttempt = 0;
+    StageLatencies* _latencies = nullptr;
 
-    bool connectToServer();
-    void cleanup();
-};
+    // Connect-to-first-write timing for the current connection
+    int64_t _connectStartUs = 0;
+    bool _firstWritePending = false;
+    bool _connectedByHandle = false;
 
-// Callback class for BLE client connection events
-class BedClientCallback : public BLEClientCallbacks {
-public:
-    BedClientCallback(MotoSleepBed* bed) : _bed(bed) {}
-
-    void onConnect(BLEClient* client) override;
-    void onDisconnect(BLEClient* client) override;
-
-private:
-    MotoSleepBed* _bed;
+    void recordLatency(LatencyStage stage, int64_t startUs);
 };
 
 #endif // MOTOSLEEP_BED_H
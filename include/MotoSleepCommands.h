@@ -1,7 +1,8 @@
 #ifndef MOTOSLEEP_COMMANDS_H
 #define MOTOSLEEP_COMMANDS_H
 
-#include <Arduino.h>
+#include <stddef.h>
+#include <stdint.h>
 
 // =============================================================================
 // MotoSleep BLE Service/Characteristic UUIDs
@@ -77,6 +78,29 @@ namespace Light {
     constexpr char TOGGLE     = 'A';  // Toggle under-bed lights
 }
 
+// Command categories, matching Command::category
+enum class Category : uint8_t {
+    MOTOR,
+    PRESET,
+    PROGRAM,
+    MASSAGE,
+    LIGHT
+};
+
+// Command classes, most urgent first. Stop-class commands skip every queue.
+enum class Priority : uint8_t {
+    STOP,           // Massage stop and off: the bed's safety commands
+    NORMAL
+};
+
+// Priority follows the category; within massage, the stop and off
+// commands outrank the intensity steps
+constexpr Priority priorityOf(Category category, char cmdChar) {
+    return category == Category::MASSAGE &&
+           (cmdChar == Massage::STOP || cmdChar == Massage::HEAD_OFF || cmdChar == Massage::FOOT_OFF)
+        ? Priority::STOP : Priority::NORMAL;
+}
+
 // Command structure
 struct Command {
     const char* name;           // Command name for MQTT/HA
@@ -87,7 +111,7 @@ struct Command {
 };
 
 // Motor commands (these are "hold" commands - send continuously while button held)
-const Command MOTOR_COMMANDS[] = {
+inline constexpr Command MOTOR_COMMANDS[] = {
     {"head_up",    "Head Up",    Motor::HEAD_UP,    "motor", "mdi:arrow-up-bold"},
     {"head_down",  "Head Down",  Motor::HEAD_DOWN,  "motor", "mdi:arrow-down-bold"},
     {"feet_up",    "Feet Up",    Motor::FEET_UP,    "motor", "mdi:arrow-up-bold"},
@@ -98,7 +122,7 @@ const Command MOTOR_COMMANDS[] = {
 constexpr size_t MOTOR_COMMAND_COUNT = sizeof(MOTOR_COMMANDS) / sizeof(MOTOR_COMMANDS[0]);
 
 // Preset commands (single press)
-const Command PRESET_COMMANDS[] = {
+inline constexpr Command PRESET_COMMANDS[] = {
     {"preset_home",       "Flat/Home",    Preset::HOME,       "preset", "mdi:bed"},
     {"preset_memory_1",   "Memory 1",     Preset::MEMORY_1,   "preset", "mdi:numeric-1-box"},
     {"preset_memory_2",   "Memory 2",     Preset::MEMORY_2,   "preset", "mdi:numeric-2-box"},
@@ -109,7 +133,7 @@ const Command PRESET_COMMANDS[] = {
 constexpr size_t PRESET_COMMAND_COUNT = sizeof(PRESET_COMMANDS) / sizeof(PRESET_COMMANDS[0]);
 
 // Program commands (save current position to preset)
-const Command PROGRAM_COMMANDS[] = {
+inline constexpr Command PROGRAM_COMMANDS[] = {
     {"program_memory_1",   "Save Memory 1",     Program::MEMORY_1,   "config", "mdi:content-save"},
     {"program_memory_2",   "Save Memory 2",     Program::MEMORY_2,   "config", "mdi:content-save"},
     {"program_anti_snore", "Save Anti-Snore",   Program::ANTI_SNORE, "config", "mdi:content-save"},
@@ -119,7 +143,7 @@ const Command PROGRAM_COMMANDS[] = {
 constexpr size_t PROGRAM_COMMAND_COUNT = sizeof(PROGRAM_COMMANDS) / sizeof(PROGRAM_COMMANDS[0]);
 
 // Massage commands
-const Command MASSAGE_COMMANDS[] = {
+inline constexpr Command MASSAGE_COMMANDS[] = {
     {"massage_head_step", "Head Massage",   Massage::HEAD_STEP, "massage", "mdi:vibrate"},
     {"massage_foot_step", "Foot Massage",   Massage::FOOT_STEP, "massage", "mdi:vibrate"},
     {"massage_head_off",  "Head Massage Off", Massage::HEAD_OFF, "massage", "mdi:vibrate-off"},
@@ -129,7 +153,7 @@ const Command MASSAGE_COMMANDS[] = {
 constexpr size_t MASSAGE_COMMAND_COUNT = sizeof(MASSAGE_COMMANDS) / sizeof(MASSAGE_COMMANDS[0]);
 
 // Light commands
-const Command LIGHT_COMMANDS[] = {
+inline constexpr Command LIGHT_COMMANDS[] = {
     {"light_toggle", "Under-Bed Lights", Light::TOGGLE, "light", "mdi:lightbulb"},
 };
 constexpr size_t LIGHT_COMMAND_COUNT = sizeof(LIGHT_COMMANDS) / sizeof(LIGHT_COMMANDS[0]);
@@ -0,0 +1,147 @@
+#ifndef MOTOR_HOLD_H
+#define MOTOR_HOLD_H
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+
+// =============================================================================
+// Motor hold streaming
+// Motor commands only move the bed while they are repeated. A hold re-sends
+// one motor char on a fixed cadence until it is stopped, or until the
+// dead-man timer expires because no START refreshed it. The schedule is
+// anchored to the first write, so a late write doesn't push back the ones
+// after it. Timestamps are passed in by the caller (micros() on the ESP32).
+// =============================================================================
+
+// Snapshot of hold counters, safe to read from any task
+struct MotorHoldStats {
+    uint32_t holds;             // Holds started
+    uint32_t writes;            // Repeated writes issued
+    uint32_t missedDeadlines;   // Cadence slots skipped because a write was too late
+    uint32_t deadmanStops;      // Holds ended by the dead-man timer
+    uint32_t lastJitterUs;
+    uint32_t maxJitterUs;
+    uint32_t avgJitterUs;
+};
+
+class MotorHold {
+public:
+    // Cadence between writes and dead-man window; takes effect on the next write
+    void setTiming(uint32_t intervalUs, uint32_t deadmanUs) {
+        _intervalUs = intervalUs ? intervalUs : 1;
+        _deadmanUs = deadmanUs;
+    }
+
+    // Begin a hold, or refresh the dead-man timer if this char is already held
+    void start(char cmdChar, uint32_t nowUs) {
+        _deadlineUs = nowUs + _deadmanUs;
+        _timed = false;
+        _burst = false;
+        if (_active && _cmdChar == cmdChar) return;
+
+        _cmdChar = cmdChar;
+        _nextDueUs = nowUs;
+        _active = true;
+        _holds.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // Begin a hold that ends by itself after durationUs (a macro step, or
+    // with burst set, a run of merged presses); not counted as a dead-man stop
+    void startTimed(char cmdChar, uint32_t nowUs, uint32_t durationUs, bool burst = false) {
+        start(cmdChar, nowUs);
+        _deadlineUs = nowUs + durationUs;
+        _timed = true;
+        _burst = burst;
+    }
+
+    // Push back the end of a running burst hold of this char. Returns false
+    // (and changes nothing) if no such hold is running.
+    bool extendBurst(char cmdChar, uint32_t durationUs) {
+        if (!_active || !_burst || _cmdChar != cmdChar) return false;
+        _deadlineUs += durationUs;
+        return true;
+    }
+
+    void stop() { _active = false; }
+
+    bool active() const { return _active; }
+    char cmdChar() const { return _cmdChar; }
+
+    // Returns true if a write is due now. Ends the hold when the dead-man
+    // timer has expired.
+    bool poll(uint32_t nowUs) {
+        if (!_active) return false;
+
+        if (static_cast<int32_t>(nowUs - _deadlineUs) >= 0) {
+            _active = false;
+            if (!_timed) {
+                _deadmanStops.fetch_add(1, std::memory_order_relaxed);
+            }
+            return false;
+        }
+
+        int32_t late = static_cast<int32_t>(nowUs - _nextDueUs);
+        if (late < 0) return false;
+
+        // Jitter is measured against the ideal slot for this write
+        uint32_t jitter = static_cast<uint32_t>(late);
+        _lastJitterUs.store(jitter, std::memory_order_relaxed);
+        _totalJitterUs.fetch_add(jitter, std::memory_order_relaxed);
+        if (jitter > _maxJitterUs.load(std::memory_order_relaxed)) {
+            _maxJitterUs.store(jitter, std::memory_order_relaxed);
+        }
+
+        // Skip any slots we were too late for rather than bursting to catch up
+        uint32_t missed = jitter / _intervalUs;
+        if (missed) {
+            _missedDeadlines.fetch_add(missed, std::memory_order_relaxed);
+        }
+        _nextDueUs += (missed + 1) * _intervalUs;
+        _writes.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+
+    // Microseconds until poll() next has something to do (UINT32_MAX if idle)
+    uint32_t untilNextUs(uint32_t nowUs) const {
+        if (!_active) return UINT32_MAX;
+        uint32_t due = _nextDueUs;
+        if (static_cast<int32_t>(_deadlineUs - due) < 0) due = _deadlineUs;
+        int32_t wait = static_cast<int32_t>(due - nowUs);
+        return wait > 0 ? static_cast<uint32_t>(wait) : 0;
+    }
+
+    MotorHoldStats getStats() const {
+        MotorHoldStats stats;
+        stats.holds = _holds.load(std::memory_order_relaxed);
+        stats.writes = _writes.load(std::memory_order_relaxed);
+        stats.missedDeadlines = _missedDeadlines.load(std::memory_order_relaxed);
+        stats.deadmanStops = _deadmanStops.load(std::memory_order_relaxed);
+        stats.lastJitterUs = _lastJitterUs.load(std::memory_order_relaxed);
+        stats.maxJitterUs = _maxJitterUs.load(std::memory_order_relaxed);
+        uint64_t total = _totalJitterUs.load(std::memory_order_relaxed);
+        stats.avgJitterUs = stats.writes ? static_cast<uint32_t>(total / stats.writes) : 0;
+        return stats;
+    }
+
+private:
+    // Owned by the BLE worker
+    uint32_t _intervalUs = 100000;
+    uint32_t _deadmanUs = 3000000;
+    bool _active = false;
+    bool _timed = false;
+    bool _burst = false;
+    char _cmdChar = 0;
+    uint32_t _nextDueUs = 0;
+    uint32_t _deadlineUs = 0;
+
+    std::atomic<uint32_t> _holds{0};
+    std::atomic<uint32_t> _writes{0};
+    std::atomic<uint32_t> _missedDeadlines{0};
+    std::atomic<uint32_t> _deadmanStops{0};
+    std::atomic<uint32_t> _lastJitterUs{0};
+    std::atomic<uint32_t> _maxJitterUs{0};
+    std::atomic<uint64_t> _totalJitterUs{0};
+};
+
+#endif // MOTOR_HOLD_H
@@ -0,0 +1,79 @@
+#ifndef MPSC_RING_H
+#define MPSC_RING_H
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+
+// =============================================================================
+// Bounded multi-producer / single-consumer ring buffer
+// Each slot carries a sequence number, so producers on different tasks claim
+// slots with one compare-and-swap and never wait on each other or on the
+// consumer. Items are built and consumed in place, so a large record is not
+// copied through a temporary. A full ring rejects the item instead of
+// blocking. No Arduino dependencies.
+// =============================================================================
+template <typename T, size_t N>
+class MpscRing {
+    static_assert(N >= 2 && (N & (N - 1)) == 0, "MpscRing capacity must be a power of two");
+
+public:
+    static constexpr size_t CAPACITY = N;
+
+    MpscRing() {
+        for (size_t i = 0; i < N; i++) {
+            _cells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    // Producer side, any task. fill(T&) writes the item into its slot.
+    // Returns false if the ring is full.
+    template <typename Fill>
+    bool emplace(Fill fill) {
+        size_t pos = _head.load(std::memory_order_relaxed);
+        Cell* cell;
+        for (;;) {
+            cell = &_cells[pos & (N - 1)];
+            size_t sequence = cell->sequence.load(std::memory_order_acquire);
+            intptr_t diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos);
+            if (diff == 0) {
+                if (_head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = _head.load(std::memory_order_relaxed);
+            }
+        }
+
+        fill(cell->item);
+        cell->sequence.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer side, one task only. use(const T&) reads the item in its slot.
+    // Returns false if the next item is not ready.
+    template <typename Use>
+    bool consume(Use use) {
+        Cell& cell = _cells[_tail & (N - 1)];
+        if (cell.sequence.load(std::memory_order_acquire) != _tail + 1) {
+            return false;
+        }
+
+        use(static_cast<const T&>(cell.item));
+        cell.sequence.store(_tail + N, std::memory_order_release);
+        _tail++;
+        return true;
+    }
+
+private:
+    struct Cell {
+        std::atomic<size_t> sequence;
+        T item;
+    };
+
+    Cell _cells[N];
+    std::atomic<size_t> _head{0};   // Next slot to claim, shared by producers
+    size_t _tail = 0;               // Consumer only
+};
+
+#endif // MPSC_RING_H
@@ -0,0 +1,48 @@
+#ifndef MQTT_TRANSPORT_H
+#define MQTT_TRANSPORT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// =============================================================================
+// MQTT client abstraction
+// main.cpp and HADiscovery talk to the broker only through this interface,
+// so the blocking PubSubClient backend and the event-driven AsyncMqttClient
+// backend are interchangeable (MQTT_ASYNC in config.h). Incoming messages
+// are always delivered from loop(), whichever task the backend receives on.
+// =============================================================================
+class MqttTransport {
+public:
+    using MessageCallback = void (*)(char* topic, uint8_t* payload, unsigned int length);
+
+    virtual ~MqttTransport() {}
+
+    virtual void begin(const char* host, uint16_t port, MessageCallback callback) = 0;
+
+    // Start a connection with a retained last will. Blocking backends return
+    // the outcome; async backends return true once the attempt is under way
+    // and report success through connected().
+    virtual bool connect(const char* clientId, const char* user, const char* password,
+                         const char* willTopic, const char* willPayload) = 0;
+    virtual bool connected() = 0;
+
+    // True while an async connect is still in flight
+    virtual bool connecting() { return false; }
+
+    // Service the connection and deliver received messages; call from loop()
+    virtual void loop() = 0;
+
+    virtual bool subscribe(const char* topic) = 0;
+    virtual bool publish(const char* topic, const char* payload, bool retained) = 0;
+
+    // Publish a payload of known length in pieces: beginPublish, any number
+    // of write calls totalling length bytes, then endPublish
+    virtual bool beginPublish(const char* topic, size_t length, bool retained) = 0;
+    virtual size_t write(const uint8_t* data, size_t len) = 0;
+    virtual bool endPublish() = 0;
+
+    // Backend-specific state or last disconnect reason, for logs
+    virtual int state() = 0;
+};
+
+#endif // MQTT_TRANSPORT_H
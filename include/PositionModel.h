@@ -0,0 +1,199 @@
+#ifndef POSITION_MODEL_H
+#define POSITION_MODEL_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "MotoSleepCommands.h"
+
+// =============================================================================
+// Dead-reckoning actuator positions
+// The bed reports no position, but the controller knows when each motor
+// runs. An estimate integrates run time against calibrated full-travel
+// times, in permille of full travel (0 = flat, 1000 = fully raised). Every
+// start and stop adds some uncertainty, since the motor keeps going until
+// the repeated writes stop. Running past an end stop for longer than the
+// accumulated uncertainty puts the actuator at that stop for certain, so
+// the estimate re-syncs there. Timestamps are ms (millis() on the ESP32).
+// No Arduino dependencies.
+// =============================================================================
+
+enum class MotorDirection : int8_t {
+    DOWN = -1,
+    NONE = 0,
+    UP = 1
+};
+
+// Actuators with an estimate, in the order used for indexing
+enum class Actuator : uint8_t {
+    HEAD,
+    FEET,
+    COUNT
+};
+
+constexpr size_t ACTUATOR_COUNT = static_cast<size_t>(Actuator::COUNT);
+
+inline const char* actuatorName(size_t actuator) {
+    static const char* const NAMES[ACTUATOR_COUNT] = {"head", "feet"};
+    return actuator < ACTUATOR_COUNT ? NAMES[actuator] : "?";
+}
+
+inline const char* directionName(MotorDirection dir) {
+    return dir == MotorDirection::UP ? "up" : dir == MotorDirection::DOWN ? "down" : "stop";
+}
+
+// Which actuator and direction a motor command char drives
+inline bool motorForCommand(char cmdChar, size_t& actuator, MotorDirection& dir) {
+    using namespace MotoSleep;
+    switch (cmdChar) {
+        case Motor::HEAD_UP:   actuator = 0; dir = MotorDirection::UP;   return true;
+        case Motor::HEAD_DOWN: actuator = 0; dir = MotorDirection::DOWN; return true;
+        case Motor::FEET_UP:   actuator = 1; dir = MotorDirection::UP;   return true;
+        case Motor::FEET_DOWN: actuator = 1; dir = MotorDirection::DOWN; return true;
+        default: return false;
+    }
+}
+
+inline char commandForMotor(size_t actuator, MotorDirection dir) {
+    using namespace MotoSleep;
+    if (actuator == 0) return dir == MotorDirection::UP ? Motor::HEAD_UP : Motor::HEAD_DOWN;
+    return dir == MotorDirection::UP ? Motor::FEET_UP : Motor::FEET_DOWN;
+}
+
+class ActuatorEstimate {
+public:
+    static constexpr uint16_t FULL = 1000;
+
+    // Extra travel, beyond the uncertainty, when driving to an end stop
+    static constexpr uint16_t END_MARGIN = 50;
+
+    // Full-travel times in each direction
+    void setTravel(uint32_t upMs, uint32_t downMs) {
+        _upMs = upMs ? upMs : 1;
+        _downMs = downMs ? downMs : 1;
+    }
+
+    uint32_t travelMs(MotorDirection dir) const {
+        return dir == MotorDirection::UP ? _upMs : _downMs;
+    }
+
+    // Run time error per start/stop pair (about one repeat interval)
+    void setSlop(uint32_t slopMs) { _slopMs = slopMs; }
+
+    // The motor started. It runs for durationMs, or until stop() if UINT32_MAX.
+    void start(MotorDirection dir, uint32_t nowMs, uint32_t durationMs = UINT32_MAX) {
+        stop(nowMs);
+        if (dir == MotorDirection::NONE) return;
+        _dir = dir;
+        _startMs = nowMs;
+        _durationMs = durationMs;
+    }
+
+    // The motor stopped; fold the run into the estimate
+    void stop(uint32_t nowMs) {
+        if (_dir == MotorDirection::NONE) return;
+        uint32_t elapsed = nowMs - _startMs;
+        if (elapsed > _durationMs) elapsed = _durationMs;
+
+        int32_t raw = rawPosition(elapsed);
+        addUncertainty(static_cast<uint32_t>((uint64_t)_slopMs * FULL / travelMs(_dir)));
+
+        if (raw <= 0) {
+            syncAtEnd(0, static_cast<uint32_t>(-raw));
+        } else if (raw >= FULL) {
+            syncAtEnd(FULL, static_cast<uint32_t>(raw - FULL));
+        } else {
+            _position = static_cast<uint16_t>(raw);
+        }
+        _dir = MotorDirection::NONE;
+    }
+
+    // Fold in a timed run once it has ended
+    void settle(uint32_t nowMs) {
+        if (_dir != MotorDirection::NONE && nowMs - _startMs >= _durationMs) {
+            stop(nowMs);
+        }
+    }
+
+    // A preset drove the actuator somewhere the model can't follow
+    void forget(uint32_t nowMs) {
+        stop(nowMs);
+        _uncertainty = FULL;
+    }
+
+    // Known position, e.g. right after a calibration run
+    void setPosition(uint16_t position) {
+        _dir = MotorDirection::NONE;
+        _position = position > FULL ? FULL : position;
+        _uncertainty = 0;
+    }
+
+    uint16_t position(uint32_t nowMs) const {
+        if (_dir == MotorDirection::NONE) return _position;
+        uint32_t elapsed = nowMs - _startMs;
+        if (elapsed > _durationMs) elapsed = _durationMs;
+        int32_t raw = rawPosition(elapsed);
+        return raw < 0 ? 0 : raw > FULL ? FULL : static_cast<uint16_t>(raw);
+    }
+
+    // Direction of the run in progress; a timed run counts until its end
+    MotorDirection direction(uint32_t nowMs) const {
+        if (_dir == MotorDirection::NONE) return _dir;
+        return nowMs - _startMs < _durationMs ? _dir : MotorDirection::NONE;
+    }
+
+    // Error bound on position() in permille, FULL if the position is unknown
+    uint16_t uncertainty() const { return _uncertainty; }
+
+    // Run time to reach target from the settled estimate. Moves to an end
+    // overrun it by the uncertainty plus END_MARGIN so they re-sync there.
+    // Returns 0 if the actuator is already within one start/stop of target.
+    uint32_t plan(uint16_t target, MotorDirection& dir) const {
+        if (target > FULL) target = FULL;
+
+        int32_t distance = static_cast<int32_t>(target) - _position;
+        if (target == 0 || target == FULL) {
+            if (_uncertainty == 0 && distance == 0) return 0;
+            distance += (target == 0 ? -1 : 1) * static_cast<int32_t>(_uncertainty + END_MARGIN);
+        } else if (static_cast<uint32_t>(distance < 0 ? -distance : distance) <= slopPermille()) {
+            return 0;
+        }
+
+        dir = distance > 0 ? MotorDirection::UP : MotorDirection::DOWN;
+        uint32_t permille = static_cast<uint32_t>(distance < 0 ? -distance : distance);
+        return static_cast<uint32_t>((uint64_t)permille * travelMs(dir) / FULL);
+    }
+
+private:
+    uint32_t _upMs = 1;
+    uint32_t _downMs = 1;
+    uint32_t _slopMs = 0;
+
+    uint16_t _position = 0;
+    uint16_t _uncertainty = FULL;   // Unknown until the first end stop
+    MotorDirection _dir = MotorDirection::NONE;
+    uint32_t _startMs = 0;
+    uint32_t _durationMs = 0;
+
+    int32_t rawPosition(uint32_t elapsedMs) const {
+        int32_t travel = static_cast<int32_t>((uint64_t)elapsedMs * FULL / travelMs(_dir));
+        return _position + (_dir == MotorDirection::UP ? travel : -travel);
+    }
+
+    uint32_t slopPermille() const {
+        uint32_t slowest = _upMs > _downMs ? _upMs : _downMs;
+        return static_cast<uint32_t>((uint64_t)_slopMs * FULL / slowest);
+    }
+
+    void addUncertainty(uint32_t permille) {
+        uint32_t total = _uncertainty + permille;
+        _uncertainty = total > FULL ? FULL : static_cast<uint16_t>(total);
+    }
+
+    // The estimate ran overrun permille past an end stop
+    void syncAtEnd(uint16_t end, uint32_t overrun) {
+        _position = end;
+        if (overrun >= _uncertainty) _uncertainty = 0;
+    }
+};
+
+#endif // POSITION_MODEL_H
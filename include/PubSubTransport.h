@@ -0,0 +1,41 @@
+#ifndef PUBSUB_TRANSPORT_H
+#define PUBSUB_TRANSPORT_H
+
+#include <Arduino.h>
+#include <WiFi.h>
+#include <PubSubClient.h>
+#include "MqttTransport.h"
+
+// MqttTransport over PubSubClient. connect() blocks until the broker answers
+// or the socket times out; messages are delivered from loop().
+class PubSubTransport : public MqttTransport {
+public:
+    // bufferSize only has to hold incoming messages; publishes are streamed
+    explicit PubSubTransport(uint16_t bufferSize);
+
+    void begin(const char* host, uint16_t port, MessageCallback callback) override;
+    bool connect(const char* clientId, const char* user, const char* password,
+                 const char* willTopic, const char* willPayload) override;
+    bool connected() override { return _mqtt.connected(); }
+    void loop() override { _mqtt.loop(); }
+
+    bool subscribe(const char* topic) override { return _mqtt.subscribe(topic); }
+    bool publish(const char* topic, const char* payload, bool retained) override {
+        return _mqtt.publish(topic, payload, retained);
+    }
+
+    bool beginPublish(const char* topic, size_t length, bool retained) override {
+        return _mqtt.beginPublish(topic, length, retained);
+    }
+    size_t write(const uint8_t* data, size_t len) override { return _mqtt.write(data, len); }
+    bool endPublish() override { return _mqtt.endPublish(); }
+
+    int state() override { return _mqtt.state(); }
+
+private:
+    WiFiClient _wifiClient;
+    PubSubClient _mqtt;
+    uint16_t _bufferSize;
+};
+
+#endif // PUBSUB_TRANSPORT_H
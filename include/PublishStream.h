@@ -0,0 +1,43 @@
+#ifndef PUBLISH_STREAM_H
+#define PUBLISH_STREAM_H
+
+#include <Arduino.h>
+#include "MqttTransport.h"
+
+// Buffers the body of a streamed publish (between beginPublish and
+// endPublish) so it reaches the socket in chunks instead of one write per
+// byte. Lives on the stack; nothing is allocated.
+class PublishStream : public Print {
+public:
+    using Print::write;
+
+    explicit PublishStream(MqttTransport& mqtt) : _mqtt(mqtt) {}
+    ~PublishStream() { flush(); }
+
+    size_t write(uint8_t c) override {
+        _buffer[_length++] = c;
+        if (_length == sizeof(_buffer)) flush();
+        return 1;
+    }
+
+    size_t write(const uint8_t* data, size_t len) override {
+        for (size_t i = 0; i < len; i++) {
+            write(data[i]);
+        }
+        return len;
+    }
+
+    void flush() override {
+        if (_length) {
+            _mqtt.write(_buffer, _length);
+            _length = 0;
+        }
+    }
+
+private:
+    MqttTransport& _mqtt;
+    uint8_t _buffer[128];
+    size_t _length = 0;
+};
+
+#endif // PUBLISH_STREAM_H
@@ -0,0 +1,125 @@
+#ifndef SCAN_SCHEDULER_H
+#define SCAN_SCHEDULER_H
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+
+// =============================================================================
+// BLE scan scheduling
+// Scanning shares the radio with WiFi, so it only runs at full duty while a
+// bed is missing, and even then the gap between scans doubles for as long
+// as the bed stays missing. Once every bed is known a short low-duty scan
+// runs now and then, only to refresh signal strength and last-seen times.
+// Driven by the BLE worker with the current time; times are in ms.
+// No Arduino dependencies.
+// =============================================================================
+
+enum class ScanMode : uint8_t {
+    NONE,
+    SEARCH,         // A bed is missing: active scan at full duty
+    PRESENCE        // Every bed is known: low-duty refresh
+};
+
+inline const char* scanModeName(ScanMode mode) {
+    switch (mode) {
+        case ScanMode::NONE:     return "none";
+        case ScanMode::SEARCH:   return "search";
+        case ScanMode::PRESENCE: return "presence";
+    }
+    return "?";
+}
+
+// Snapshot of scan counters, safe to read from any task
+struct ScanStats {
+    uint32_t searches;
+    uint32_t presenceScans;
+    uint32_t gapMs;             // Current wait between searches
+};
+
+// FNV-1a over an advertised name, so advertisements are matched against the
+// beds' names with one compare each
+inline uint32_t bleNameHash(const char* name, size_t len) {
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < len; i++) {
+        h ^= static_cast<uint8_t>(name[i]);
+        h *= 16777619u;
+    }
+    return h;
+}
+
+class ScanScheduler {
+public:
+    // presenceIntervalMs = 0 never scans once every bed is known
+    void setTiming(uint32_t gapMinMs, uint32_t gapMaxMs, uint32_t presenceIntervalMs) {
+        _gapMinMs = gapMinMs;
+        _gapMaxMs = gapMaxMs;
+        _presenceIntervalMs = presenceIntervalMs;
+        _gapMs.store(gapMinMs, std::memory_order_relaxed);
+    }
+
+    // The scan that is due now, if any
+    ScanMode due(bool bedMissing, uint32_t nowMs) const {
+        if (_running != ScanMode::NONE) return ScanMode::NONE;
+        uint32_t idleMs = nowMs - _lastEndMs;
+        if (bedMissing) {
+            return _searchNow || idleMs >= _gapMs.load(std::memory_order_relaxed) ? ScanMode::SEARCH : ScanMode::NONE;
+        }
+        if (_presenceIntervalMs && idleMs >= _presenceIntervalMs) return ScanMode::PRESENCE;
+        return ScanMode::NONE;
+    }
+
+    // A bed just went missing: search on the next check, starting the
+    // backoff over
+    void searchNow() {
+        _searchNow = true;
+        _gapMs.store(_gapMinMs, std::memory_order_relaxed);
+    }
+
+    void started(ScanMode mode) {
+        _running = mode;
+        _searchNow = false;
+        if (mode == ScanMode::SEARCH) _searches.fetch_add(1, std::memory_order_relaxed);
+        if (mode == ScanMode::PRESENCE) _presenceScans.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // The scan ended. A search that ran its full length without finding
+    // every bed backs off; one cut short (for a command) does not.
+    void finished(bool bedMissing, bool cutShort, uint32_t nowMs) {
+        uint32_t gap = _gapMs.load(std::memory_order_relaxed);
+        if (_running == ScanMode::SEARCH && bedMissing && !cutShort) {
+            gap = gap > _gapMaxMs / 2 ? _gapMaxMs : gap * 2;
+        }
+        if (!bedMissing) {
+            gap = _gapMinMs;
+        }
+        _gapMs.store(gap, std::memory_order_relaxed);
+        _running = ScanMode::NONE;
+        _lastEndMs = nowMs;
+    }
+
+    ScanMode running() const { return _running; }
+
+    ScanStats getStats() const {
+        return {
+            _searches.load(std::memory_order_relaxed),
+            _presenceScans.load(std::memory_order_relaxed),
+            _gapMs.load(std::memory_order_relaxed)
+        };
+    }
+
+private:
+    // Owned by the BLE worker
+    uint32_t _gapMinMs = 5000;
+    uint32_t _gapMaxMs = 300000;
+    uint32_t _presenceIntervalMs = 0;
+    uint32_t _lastEndMs = 0;
+    bool _searchNow = true;     // Search as soon as the worker starts
+    ScanMode _running = ScanMode::NONE;
+
+    std::atomic<uint32_t> _gapMs{5000};
+    std::atomic<uint32_t> _searches{0};
+    std::atomic<uint32_t> _presenceScans{0};
+};
+
+#endif // SCAN_SCHEDULER_H
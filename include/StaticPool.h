@@ -0,0 +1,55 @@
+#ifndef STATIC_POOL_H
+#define STATIC_POOL_H
+
+#include <new>
+#include <stddef.h>
+#include <type_traits>
+#include <utility>
+
+// =============================================================================
+// Static object pool
+// Storage for up to N objects of type T, reserved up front and addressed by
+// slot. Objects are constructed and destroyed in place, so they can come and
+// go for the life of the program without touching the heap. Not thread-safe.
+// No Arduino dependencies.
+// =============================================================================
+
+template <typename T, size_t N>
+class StaticPool {
+public:
+    StaticPool() = default;
+    StaticPool(const StaticPool&) = delete;
+    StaticPool& operator=(const StaticPool&) = delete;
+
+    ~StaticPool() {
+        for (size_t slot = 0; slot < N; slot++) {
+            destroy(slot);
+        }
+    }
+
+    // Construct an object in a free slot; nullptr if the slot is taken
+    template <typename... Args>
+    T* create(size_t slot, Args&&... args) {
+        if (slot >= N || _used[slot]) return nullptr;
+        T* object = new (&_storage[slot]) T(std::forward<Args>(args)...);
+        _used[slot] = true;
+        return object;
+    }
+
+    void destroy(size_t slot) {
+        if (slot >= N || !_used[slot]) return;
+        get(slot)->~T();
+        _used[slot] = false;
+    }
+
+    T* get(size_t slot) {
+        if (slot >= N || !_used[slot]) return nullptr;
+        return std::launder(reinterpret_cast<T*>(&_storage[slot]));
+    }
+
+private:
+    typename std::aligned_storage<sizeof(T), alignof(T)>::type _storage[N];
+    bool _used[N] = {};
+};
+
+#endif // STATIC_POOL_H
@@ -0,0 +1,43 @@
+#ifndef TASK_LOAD_H
+#define TASK_LOAD_H
+
+#include <atomic>
+#include <stdint.h>
+
+// =============================================================================
+// Task busy time
+// A task adds the time it spends working (not blocked waiting for work), and
+// the stats reporter turns that into a share of wall time since its last
+// report. Counters are 32-bit microseconds and only their differences are
+// used, so they may wrap as long as reports are less than ~70 minutes apart.
+// Timestamps are passed in by the caller (micros() on the ESP32).
+// No Arduino dependencies.
+// =============================================================================
+class TaskLoad {
+public:
+    // Owning task: count busyUs of work
+    void add(uint32_t busyUs) {
+        _busyUs.fetch_add(busyUs, std::memory_order_relaxed);
+    }
+
+    // Reporter: busy time since the previous call, in permille of wall time
+    uint32_t takePermille(uint32_t nowUs) {
+        uint32_t busy = _busyUs.load(std::memory_order_relaxed);
+        uint32_t busyDelta = busy - _reportedBusyUs;
+        uint32_t elapsed = nowUs - _reportedAtUs;
+        _reportedBusyUs = busy;
+        _reportedAtUs = nowUs;
+        if (!elapsed) return 0;
+        uint64_t permille = static_cast<uint64_t>(busyDelta) * 1000 / elapsed;
+        return permille > 1000 ? 1000 : static_cast<uint32_t>(permille);
+    }
+
+private:
+    std::atomic<uint32_t> _busyUs{0};
+
+    // Reporter only
+    uint32_t _reportedBusyUs = 0;
+    uint32_t _reportedAtUs = 0;
+};
+
+#endif // TASK_LOAD_H
@@ -0,0 +1,149 @@
+#ifndef TIMER_WHEEL_H
+#define TIMER_WHEEL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// =============================================================================
+// Hashed timer wheel
+// Timers hang off one of Slots buckets, chosen by their due tick modulo
+// Slots, so scheduling and cancelling are O(1) however far out a timer is.
+// A timer due more than one revolution ahead stays in its bucket until its
+// full due tick comes round. Timers are intrusive: the owner embeds a Timer
+// and the wheel only links it, so nothing is allocated. Timestamps are
+// passed in by the caller as 64-bit microseconds (esp_timer_get_time() on
+// the ESP32), so tick numbers never wrap. Single-threaded.
+// =============================================================================
+
+class WheelTimer {
+public:
+    bool armed() const { return _armed; }
+
+    // The time the timer was scheduled for, valid while armed and when it fires
+    uint64_t dueUs() const { return _dueUs; }
+
+private:
+    template <size_t> friend class TimerWheel;
+
+    WheelTimer* _next = nullptr;
+    WheelTimer* _prev = nullptr;
+    uint64_t _dueUs = 0;
+    uint32_t _dueTick = 0;
+    bool _armed = false;
+};
+
+template <size_t Slots>
+class TimerWheel {
+    static_assert(Slots >= 2 && (Slots & (Slots - 1)) == 0, "TimerWheel slot count must be a power of two");
+
+public:
+    explicit TimerWheel(uint32_t tickUs) : _tickUs(tickUs ? tickUs : 1) {}
+
+    // Call once before scheduling so the wheel starts at the current time
+    void begin(uint64_t nowUs) {
+        _currentTick = static_cast<uint32_t>(nowUs / _tickUs);
+    }
+
+    // Arm (or re-arm) timer to fire at dueUs. A time already past fires on
+    // the next advance().
+    void schedule(WheelTimer& timer, uint64_t dueUs) {
+        cancel(timer);
+
+        // Round up so a timer never fires before its due time
+        uint32_t dueTick = static_cast<uint32_t>((dueUs + _tickUs - 1) / _tickUs);
+        if (static_cast<int32_t>(dueTick - _currentTick) <= 0) {
+            dueTick = _currentTick + 1;
+        }
+
+        timer._dueUs = dueUs;
+        timer._dueTick = dueTick;
+        timer._armed = true;
+
+        WheelTimer*& head = _slots[dueTick & (Slots - 1)];
+        timer._prev = nullptr;
+        timer._next = head;
+        if (head) head->_prev = &timer;
+        head = &timer;
+        _count++;
+    }
+
+    void cancel(WheelTimer& timer) {
+        if (!timer._armed) return;
+
+        if (timer._prev) {
+            timer._prev->_next = timer._next;
+        } else {
+            _slots[timer._dueTick & (Slots - 1)] = timer._next;
+        }
+        if (timer._next) timer._next->_prev = timer._prev;
+        timer._next = timer._prev = nullptr;
+        timer._armed = false;
+        _count--;
+    }
+
+    // Fire every timer due by nowUs, calling expired(timer) after unlinking
+    // it. expired may schedule timers, including the one that just fired.
+    template <typename F>
+    void advance(uint64_t nowUs, F expired) {
+        uint32_t nowTick = static_cast<uint32_t>(nowUs / _tickUs);
+
+        // After a long gap one revolution visits every bucket
+        uint32_t ticks = nowTick - _currentTick;
+        if (static_cast<int32_t>(ticks) <= 0) return;
+        if (ticks > Slots) ticks = Slots;
+
+        for (uint32_t t = nowTick - ticks + 1; t != nowTick + 1; t++) {
+            // Unlink everything due from this bucket first, so expired() is
+            // free to schedule into it
+            WheelTimer* fired = nullptr;
+            WheelTimer* timer = _slots[t & (Slots - 1)];
+            while (timer) {
+                WheelTimer* next = timer->_next;
+                if (static_cast<int32_t>(timer->_dueTick - nowTick) <= 0) {
+                    cancel(*timer);
+                    timer->_next = fired;
+                    fired = timer;
+                }
+                timer = next;
+            }
+
+            _currentTick = t;
+            while (fired) {
+                WheelTimer* next = fired->_next;
+                fired->_next = nullptr;
+                expired(*fired);
+                fired = next;
+            }
+        }
+        _currentTick = nowTick;
+    }
+
+    // Microseconds until the next timer is due (UINT32_MAX if none), scanning
+    // at most one revolution ahead
+    uint32_t untilNextUs(uint64_t nowUs) const {
+        if (!_count) return UINT32_MAX;
+
+        // A timer fires when advance() reaches the start of its tick
+        uint64_t nowTick = nowUs / _tickUs;
+        for (uint32_t ahead = 0; ahead <= Slots; ahead++) {
+            uint32_t tick = static_cast<uint32_t>(nowTick + ahead);
+            for (WheelTimer* timer = _slots[tick & (Slots - 1)]; timer; timer = timer->_next) {
+                if (static_cast<int32_t>(timer->_dueTick - tick) <= 0) {
+                    return ahead ? static_cast<uint32_t>((nowTick + ahead) * _tickUs - nowUs) : 0;
+                }
+            }
+        }
+        // Nothing within a revolution; check back after one
+        return Slots * _tickUs;
+    }
+
+    size_t size() const { return _count; }
+
+private:
+    WheelTimer* _slots[Slots] = {};
+    uint32_t _tickUs;
+    uint32_t _currentTick = 0;
+    size_t _count = 0;
+};
+
+#endif // TIMER_WHEEL_H
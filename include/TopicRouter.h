@@ -0,0 +1,94 @@
+#ifndef TOPIC_ROUTER_H
+#define TOPIC_ROUTER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include "CommandTable.h"
+
+// =============================================================================
+// MQTT command topic router
+// Resolves motosleep/{bed_id}/{command}/set to a bed index and command entry
+// in a single pass over the topic, in place, without allocating. Tokens in
+// the result point into the caller's topic buffer.
+// =============================================================================
+
+#define MOTOSLEEP_TOPIC_PREFIX "motosleep/"
+#define MOTOSLEEP_COMMAND_FILTER "motosleep/+/+/set"
+
+enum class RouteResult {
+    OK,
+    NOT_COMMAND,      // Not of the form motosleep/{bed_id}/{command}/set
+    UNKNOWN_BED,
+    UNKNOWN_COMMAND
+};
+
+struct TopicRoute {
+    size_t bedIndex;
+    const MotoSleep::CommandEntry* command;
+    const char* bedId;          // Not null-terminated, see bedIdLength
+    size_t bedIdLength;
+    const char* commandName;    // Not null-terminated, see commandLength
+    size_t commandLength;
+};
+
+template <size_t MaxBeds>
+class TopicRouter {
+public:
+    // Register the bed ID for a slot; the string must outlive the router
+    void setBed(size_t index, const char* id) {
+        if (index >= MaxBeds) return;
+        _ids[index] = id;
+        _idLengths[index] = id ? strlen(id) : 0;
+    }
+
+    void clearBed(size_t index) {
+        setBed(index, nullptr);
+    }
+
+    RouteResult route(const char* topic, TopicRoute& route) const {
+        static constexpr size_t PREFIX_LENGTH = sizeof(MOTOSLEEP_TOPIC_PREFIX) - 1;
+        if (strncmp(topic, MOTOSLEEP_TOPIC_PREFIX, PREFIX_LENGTH) != 0) {
+            return RouteResult::NOT_COMMAND;
+        }
+
+        // Split {bed_id}/{command}/set
+        const char* bedId = topic + PREFIX_LENGTH;
+        const char* p = bedId;
+        while (*p && *p != '/') p++;
+        if (*p != '/' || p == bedId) return RouteResult::NOT_COMMAND;
+        route.bedId = bedId;
+        route.bedIdLength = p - bedId;
+
+        const char* commandName = ++p;
+        while (*p && *p != '/') p++;
+        if (*p != '/' || p == commandName) return RouteResult::NOT_COMMAND;
+        route.commandName = commandName;
+        route.commandLength = p - commandName;
+
+        if (strcmp(p + 1, "set") != 0) return RouteResult::NOT_COMMAND;
+
+        route.bedIndex = findBed(route.bedId, route.bedIdLength);
+        if (route.bedIndex == MaxBeds) return RouteResult::UNKNOWN_BED;
+
+        route.command = MotoSleep::findCommand(route.commandName, route.commandLength);
+        if (!route.command) return RouteResult::UNKNOWN_COMMAND;
+
+        return RouteResult::OK;
+    }
+
+private:
+    const char* _ids[MaxBeds] = {};
+    size_t _idLengths[MaxBeds] = {};
+
+    size_t findBed(const char* id, size_t len) const {
+        for (size_t i = 0; i < MaxBeds; i++) {
+            if (_ids[i] && _idLengths[i] == len && memcmp(_ids[i], id, len) == 0) {
+                return i;
+            }
+        }
+        return MaxBeds;
+    }
+};
+
+#endif // TOPIC_ROUTER_H
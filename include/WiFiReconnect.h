@@ -0,0 +1,143 @@
+#ifndef WIFI_RECONNECT_H
+#define WIFI_RECONNECT_H
+
+#include <stdint.h>
+
+// =============================================================================
+// WiFi reconnection state machine
+// Driven from loop() with the current time and whether the station has an
+// IP (tracked from WiFi events). It never blocks: it only tells the caller
+// when to start another connection attempt, backing off exponentially after
+// each failed one, and when an outage has lasted long enough that a restart
+// is the last resort. Times are in ms. No Arduino dependencies.
+// =============================================================================
+
+enum class WiFiAction : uint8_t {
+    NONE,
+    CONNECT,    // Start a connection attempt now
+    RESTART     // Outage exceeded the restart limit
+};
+
+struct WiFiOutageStats {
+    uint32_t outages;           // Link losses after the first connection
+    uint32_t attempts;          // Connection attempts, including the first
+    uint32_t lastOutageMs;
+    uint32_t longestOutageMs;
+    uint32_t totalOutageMs;
+};
+
+class WiFiReconnect {
+public:
+    enum class State : uint8_t {
+        CONNECTING,     // Attempt in progress, waiting for an IP
+        CONNECTED,
+        BACKOFF         // Waiting before the next attempt
+    };
+
+    // restartAfterMs = 0 never asks for a restart
+    void setTiming(uint32_t connectTimeoutMs, uint32_t backoffMinMs, uint32_t backoffMaxMs, uint32_t restartAfterMs) {
+        _connectTimeoutMs = connectTimeoutMs;
+        _backoffMinMs = backoffMinMs;
+        _backoffMaxMs = backoffMaxMs;
+        _restartAfterMs = restartAfterMs;
+        _backoffMs = backoffMinMs;
+    }
+
+    // The first attempt has just been started by the caller
+    void begin(uint32_t nowMs) {
+        _state = State::CONNECTING;
+        _attemptStartMs = nowMs;
+        _outageStartMs = nowMs;
+        _backoffMs = _backoffMinMs;
+        _stats.attempts++;
+    }
+
+    WiFiAction poll(uint32_t nowMs, bool linkUp) {
+        if (linkUp) {
+            if (_state != State::CONNECTED) {
+                if (_everConnected) {
+                    recordOutage(nowMs - _outageStartMs);
+                }
+                _state = State::CONNECTED;
+                _everConnected = true;
+                _backoffMs = _backoffMinMs;
+            }
+            return WiFiAction::NONE;
+        }
+
+        switch (_state) {
+            case State::CONNECTED:
+                // Link lost: retry after the shortest backoff
+                _state = State::BACKOFF;
+                _outageStartMs = nowMs;
+                _retryAtMs = nowMs + _backoffMinMs;
+                _stats.outages++;
+                break;
+
+            case State::CONNECTING:
+                if (nowMs - _attemptStartMs >= _connectTimeoutMs) {
+                    _state = State::BACKOFF;
+                    _retryAtMs = nowMs + _backoffMs;
+                    _backoffMs = _backoffMs * 2 < _backoffMaxMs ? _backoffMs * 2 : _backoffMaxMs;
+                }
+                break;
+
+            case State::BACKOFF:
+                if (static_cast<int32_t>(nowMs - _retryAtMs) >= 0) {
+                    _state = State::CONNECTING;
+                    _attemptStartMs = nowMs;
+                    _stats.attempts++;
+                    return WiFiAction::CONNECT;
+                }
+                break;
+        }
+
+        if (_restartAfterMs && nowMs - _outageStartMs >= _restartAfterMs) {
+            return WiFiAction::RESTART;
+        }
+        return WiFiAction::NONE;
+    }
+
+    State state() const { return _state; }
+    bool connected() const { return _state == State::CONNECTED; }
+
+    // ms until the next attempt while backing off, 0 otherwise
+    uint32_t retryInMs(uint32_t nowMs) const {
+        if (_state != State::BACKOFF) return 0;
+        int32_t remaining = static_cast<int32_t>(_retryAtMs - nowMs);
+        return remaining > 0 ? remaining : 0;
+    }
+
+    // Length of the outage in progress, 0 while connected
+    uint32_t currentOutageMs(uint32_t nowMs) const {
+        return _state == State::CONNECTED ? 0 : nowMs - _outageStartMs;
+    }
+
+    const WiFiOutageStats& getStats() const { return _stats; }
+
+private:
+    State _state = State::CONNECTING;
+    bool _everConnected = false;
+
+    uint32_t _connectTimeoutMs = 20000;
+    uint32_t _backoffMinMs = 1000;
+    uint32_t _backoffMaxMs = 60000;
+    uint32_t _restartAfterMs = 0;
+    uint32_t _backoffMs = 1000;
+
+    uint32_t _attemptStartMs = 0;
+    uint32_t _retryAtMs = 0;
+    uint32_t _outageStartMs = 0;
+
+    WiFiOutageStats _stats = {};
+
+    void recordOutage(uint32_t durationMs) {
+        _stats.lastOutageMs = durationMs;
+        _stats.totalOutageMs += durationMs;
+        if (durationMs > _stats.longestOutageMs) {
+            _stats.longestOutageMs = durationMs;
+        }
+    }
+};
+
+#endif // WIFI_RECONNECT_H
@@ -0,0 +1,41 @@
+#ifndef WORKER_PLATFORM_H
+#define WORKER_PLATFORM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// =============================================================================
+// What the BLE worker needs from the rest of the controller
+// BedWorker runs the command path; waking it, the BLE scanner, advertisement
+// bookkeeping and heap counts belong to the platform around it. main.cpp
+// implements this with FreeRTOS and the ESP32 BLE stack, the host simulation
+// with its virtual clock. No Arduino dependencies.
+// =============================================================================
+class WorkerPlatform {
+public:
+    virtual ~WorkerPlatform() {}
+
+    // Wake the worker; called from the MQTT callback after queuing a command
+    virtual void notify() = 0;
+
+    // Whether a BLE scan is running, and stop it (connecting while scanning
+    // is unreliable)
+    virtual bool scanning() const = 0;
+    virtual void stopScan() = 0;
+
+    // When bed i last advertised (ms, 0 = never heard)
+    virtual uint32_t lastSeenMs(size_t i) const = 0;
+
+    // Outcome of a connect the pool tried for bed i; a failing address may
+    // send the scanner looking for the bed again
+    virtual void connectFailed(size_t i) = 0;
+    virtual void connected(size_t i) = 0;
+
+    // Heap blocks currently allocated, across all tasks
+    virtual size_t allocatedBlocks() const = 0;
+
+    // Monotonic clock in us the macro steps are scheduled on
+    virtual int64_t nowUs() const = 0;
+};
+
+#endif // WORKER_PLATFORM_H
@@ -0,0 +1,176 @@
+#include <Arduino.h>
+#include "ConfigDefaults.h"
+
+#if MQTT_ASYNC
+
+#include "AsyncMqttTransport.h"
+#include "Log.h"
+
+AsyncMqttTransport::AsyncMqttTransport(uint16_t maxPayload, size_t maxPublish)
+    : _maxPayload(maxPayload), _publishSize(maxPublish) {
+}
+
+AsyncMqttTransport::~AsyncMqttTransport() {
+    _client.disconnect(true);
+    free(_payloads);
+    free(_publishBuffer);
+}
+
+void AsyncMqttTransport::begin(const char* host, uint16_t port, MessageCallback callback) {
+    _callback = callback;
+    _client.setServer(host, port);
+
+    // One inbox allocation for the life of the transport; every slot starts
+    // free. Without it no slot is ever free, so every message is dropped.
+    if (!_payloads) {
+        _payloads = static_cast<uint8_t*>(malloc(INBOX_DEPTH * (size_t)_maxPayload));
+        if (_payloads) {
+            for (size_t i = 0; i < INBOX_DEPTH; i++) {
+                _messages[i].payload = _payloads + i * _maxPayload;
+                _freeSlots.push(i);
+            }
+        } else {
+            LOG_ERROR(MQTT, "No memory for the %u byte inbox, commands will be dropped",
+                      (unsigned)(INBOX_DEPTH * _maxPayload));
+        }
+    }
+
+    // Sized for the largest publish up front, so publishing never allocates
+    if (!_publishBuffer) {
+        _publishBuffer = static_cast<uint8_t*>(malloc(_publishSize));
+        if (!_publishBuffer) {
+            LOG_ERROR(MQTT, "No memory for the %u byte publish buffer", (unsigned)_publishSize);
+            _publishSize = 0;
+        }
+    }
+
+    // These run on the AsyncTCP task
+    _client.onConnect([this](bool sessionPresent) {
+        _connecting = false;
+    });
+    _client.onDisconnect([this](AsyncMqttClientDisconnectReason reason) {
+        _connecting = false;
+        _lastDisconnectReason = static_cast<int>(reason);
+    });
+    _client.onMessage([this](char* topic, char* payload, AsyncMqttClientMessageProperties properties,
+                             size_t len, size_t index, size_t total) {
+        onMessage(topic, payload, len, index, total);
+    });
+}
+
+bool AsyncMqttTransport::connect(const char* clientId, const char* user, const char* password,
+                                 const char* willTopic, const char* willPayload) {
+    if (_connecting) return true;
+
+    strlcpy(_clientId, clientId, sizeof(_clientId));
+    strlcpy(_user, user, sizeof(_user));
+    strlcpy(_password, password, sizeof(_password));
+    strlcpy(_willTopic, willTopic, sizeof(_willTopic));
+    strlcpy(_willPayload, willPayload, sizeof(_willPayload));
+
+    _client.setClientId(_clientId);
+    if (_user[0]) {
+        _client.setCredentials(_user, _password);
+    }
+    _client.setWill(_willTopic, 0, true, _willPayload);
+
+    // Returns immediately; onConnect or onDisconnect reports the outcome
+    _connecting = true;
+    _client.connect();
+    return true;
+}
+
+void AsyncMqttTransport::onMessage(char* topic, char* payload, size_t len, size_t index, size_t total) {
+    // Large payloads arrive in fragments; the first one claims a slot
+    if (index == 0) {
+        if (_filling >= 0) {
+            // Previous message never completed
+            discardFilling();
+        }
+
+        uint8_t slot;
+        if (total > _maxPayload || strlen(topic) > MAX_TOPIC_LENGTH || !_freeSlots.pop(slot)) {
+            _droppedMessages++;
+            return;
+        }
+        _filling = slot;
+        strlcpy(_messages[slot].topic, topic, sizeof(_messages[slot].topic));
+        _messages[slot].length = total;
+        _messages[slot].complete = false;
+    }
+    if (_filling < 0) return;
+
+    InboundMessage& message = _messages[_filling];
+    if (index + len > message.length) {
+        discardFilling();
+        _droppedMessages++;
+        return;
+    }
+    memcpy(message.payload + index, payload, len);
+
+    if (index + len == total) {
+        message.complete = true;
+        _inbox.push(_filling);
+        _filling = -1;
+    }
+}
+
+// _freeSlots has one producer, loop(), so a slot given up on the AsyncTCP
+// task goes back through the inbox, marked incomplete, and loop() frees it.
+// Every slot fits in the inbox at once, so the push can't fail.
+void AsyncMqttTransport::discardFilling() {
+    _messages[_filling].complete = false;
+    _inbox.push(_filling);
+    _filling = -1;
+}
+
+void AsyncMqttTransport::loop() {
+    uint8_t slot;
+    while (_inbox.pop(slot)) {
+        InboundMessage& message = _messages[slot];
+        if (message.complete && _callback) {
+            _callback(message.topic, message.payload, message.length);
+        }
+        _freeSlots.push(slot);
+    }
+}
+
+bool AsyncMqttTransport::subscribe(const char* topic) {
+    return _client.subscribe(topic, 0) != 0;
+}
+
+bool AsyncMqttTransport::publish(const char* topic, const char* payload, bool retained) {
+    // The client copies the packet into its outbox and sends it as the socket drains
+    return _client.publish(topic, 0, retained, payload) != 0;
+}
+
+bool AsyncMqttTransport::beginPublish(const char* topic, size_t length, bool retained) {
+    if (!_client.connected() || strlen(topic) > MAX_TOPIC_LENGTH) return false;
+
+    if (length > _publishSize) {
+        LOG_ERROR(MQTT, "%u byte publish to %s exceeds MQTT_PUBLISH_BUFFER_SIZE (%u)",
+                  (unsigned)length, topic, (unsigned)_publishSize);
+        return false;
+    }
+
+    strlcpy(_publishTopic, topic, sizeof(_publishTopic));
+    _publishRetained = retained;
+    _publishLength = 0;
+    return true;
+}
+
+size_t AsyncMqttTransport::write(const uint8_t* data, size_t len) {
+    if (_publishLength + len > _publishSize) {
+        len = _publishSize - _publishLength;
+    }
+    memcpy(_publishBuffer + _publishLength, data, len);
+    _publishLength += len;
+    return len;
+}
+
+bool AsyncMqttTransport::endPublish() {
+    return _client.publish(_publishTopic, 0, _publishRetained,
+                           reinterpret_cast<const char*>(_publishBuffer), _publishLength) != 0;
+}
+
+#endif // MQTT_ASYNC
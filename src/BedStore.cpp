@@ -0,0 +1,162 @@
+#include "BedStore.h"
+#include <Preferences.h>
+#include "Log.h"
+
+static const char* NVS_NAMESPACE = "motosleep_beds";
+static const char* REGISTRY_SAVED_KEY = "reg_saved";
+
+struct BedRecord {
+    uint8_t address[6];
+    uint16_t handle;    // Command characteristic value handle, 0 = unknown
+};
+
+// Records written before the handle was cached hold only the address
+static const size_t LEGACY_RECORD_SIZE = sizeof(BedRecord::address);
+
+// NVS keys are limited to 15 characters, so key by a hash of the BLE name
+static void makeKey(char* key, size_t size, const char* bleName, const char* prefix = "bed") {
+    uint32_t hash = 2166136261u;
+    for (const char* p = bleName; *p; p++) {
+        hash ^= static_cast<uint8_t>(*p);
+        hash *= 16777619u;
+    }
+    snprintf(key, size, "%s_%08lx", prefix, (unsigned long)hash);
+}
+
+static bool loadRecord(const char* bleName, BedRecord& record) {
+    char key[16];
+    makeKey(key, sizeof(key), bleName);
+
+    Preferences prefs;
+    if (!prefs.begin(NVS_NAMESPACE, true)) return false;
+    record = {};
+    size_t length = prefs.getBytesLength(key);
+    bool found = (length == sizeof(record) || length == LEGACY_RECORD_SIZE) &&
+                 prefs.getBytes(key, &record, length) == length;
+    prefs.end();
+    return found;
+}
+
+static void saveRecord(const char* bleName, const BedRecord& record) {
+    char key[16];
+    makeKey(key, sizeof(key), bleName);
+
+    Preferences prefs;
+    if (!prefs.begin(NVS_NAMESPACE, false)) return;
+    prefs.putBytes(key, &record, sizeof(record));
+    prefs.end();
+}
+
+namespace BedStore {
+
+bool loadAddress(const char* bleName, uint8_t address[6]) {
+    BedRecord record;
+    if (!loadRecord(bleName, record)) return false;
+    memcpy(address, record.address, sizeof(record.address));
+    return true;
+}
+
+void saveAddress(const char* bleName, const uint8_t address[6]) {
+    BedRecord record;
+    if (loadRecord(bleName, record) && memcmp(record.address, address, sizeof(record.address)) == 0) {
+        return;  // Unchanged; spare the flash a write
+    }
+
+    memcpy(record.address, address, sizeof(record.address));
+    record.handle = 0;
+    saveRecord(bleName, record);
+    LOG_INFO(NVS, "Cached address for %s", bleName);
+}
+
+uint16_t loadHandle(const char* bleName) {
+    BedRecord record;
+    if (!loadRecord(bleName, record)) return 0;
+    return record.handle;
+}
+
+void saveHandle(const char* bleName, uint16_t handle) {
+    // The handle is only meaningful next to the address it was found on
+    BedRecord record;
+    if (!loadRecord(bleName, record) || record.handle == handle) return;
+
+    record.handle = handle;
+    saveRecord(bleName, record);
+    LOG_INFO(NVS, "Cached handle 0x%04x for %s", handle, bleName);
+}
+
+bool loadTravel(const char* bleName, uint32_t* travelMs, size_t count) {
+    char key[16];
+    makeKey(key, sizeof(key), bleName, "trv");
+
+    Preferences prefs;
+    if (!prefs.begin(NVS_NAMESPACE, true)) return false;
+    size_t length = count * sizeof(uint32_t);
+    bool found = prefs.getBytesLength(key) == length && prefs.getBytes(key, travelMs, length) == length;
+    prefs.end();
+    return found;
+}
+
+void saveTravel(const char* bleName, const uint32_t* travelMs, size_t count) {
+    char key[16];
+    makeKey(key, sizeof(key), bleName, "trv");
+
+    Preferences prefs;
+    if (!prefs.begin(NVS_NAMESPACE, false)) return;
+    prefs.putBytes(key, travelMs, count * sizeof(uint32_t));
+    prefs.end();
+    LOG_INFO(NVS, "Saved travel times for %s", bleName);
+}
+
+void forget(const char* bleName) {
+    char key[16];
+    char travelKey[16];
+    makeKey(key, sizeof(key), bleName);
+    makeKey(travelKey, sizeof(travelKey), bleName, "trv");
+
+    Preferences prefs;
+    if (!prefs.begin(NVS_NAMESPACE, false)) return;
+    prefs.remove(key);
+    prefs.remove(travelKey);
+    prefs.end();
+}
+
+bool registrySaved() {
+    Preferences prefs;
+    if (!prefs.begin(NVS_NAMESPACE, true)) return false;
+    bool saved = prefs.getBool(REGISTRY_SAVED_KEY, false);
+    prefs.end();
+    return saved;
+}
+
+bool loadRegistrySlot(size_t slot, BedEntry& entry) {
+    char key[16];
+    snprintf(key, sizeof(key), "reg_%u", (unsigned)slot);
+
+    Preferences prefs;
+    if (!prefs.begin(NVS_NAMESPACE, true)) return false;
+    bool found = prefs.getBytesLength(key) == sizeof(entry) && prefs.getBytes(key, &entry, sizeof(entry)) == sizeof(entry);
+    prefs.end();
+
+    // Never trust unterminated strings from flash
+    entry.id[sizeof(entry.id) - 1] = '\0';
+    entry.bleName[sizeof(entry.bleName) - 1] = '\0';
+    entry.friendlyName[sizeof(entry.friendlyName) - 1] = '\0';
+    return found;
+}
+
+void saveRegistrySlot(size_t slot, const BedEntry* entry) {
+    char key[16];
+    snprintf(key, sizeof(key), "reg_%u", (unsigned)slot);
+
+    Preferences prefs;
+    if (!prefs.begin(NVS_NAMESPACE, false)) return;
+    if (entry) {
+        prefs.putBytes(key, entry, sizeof(*entry));
+    } else {
+        prefs.remove(key);
+    }
+    prefs.putBool(REGISTRY_SAVED_KEY, true);
+    prefs.end();
+}
+
+} // namespace BedStore
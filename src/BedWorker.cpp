@@ -0,0 +1,1073 @@
+#include "BedWorker.h"
+#include <inttypes.h>
+#include <string.h>
+#include "BedStore.h"
+#include "CommandCoalescer.h"
+#include "Log.h"
+
+static_assert(MAX_BEDS <= 32, "Group member masks hold at most 32 beds");
+static_assert(MACRO_COUNT <= 127, "Macro indices travel in a command char");
+
+BedWorker::BedWorker(MotoSleepBed** beds, BedLink** links, WorkerPlatform& platform)
+    : _beds(beds), _links(links), _platform(platform), _pool(beds, MAX_BEDS),
+      _macroEngine(MACRO_TICK_MS * 1000UL) {
+}
+
+void BedWorker::begin() {
+    for (size_t i = 0; i < MAX_BEDS; i++) {
+        _motorHolds[i].setTiming(MOTOR_HOLD_INTERVAL * 1000UL, MOTOR_HOLD_DEADMAN * 1000UL);
+        _breakers[i].setTiming(BLE_BREAKER_THRESHOLD, BLE_RECONNECT_INTERVAL, BLE_RECONNECT_INTERVAL_MAX);
+    }
+    for (size_t g = 0; g < BED_GROUP_COUNT; g++) {
+        _router.setBed(MAX_BEDS + g, BED_GROUPS[g].id);
+    }
+
+    // Parse macros once; a macro with errors is logged and refuses to run
+    for (size_t m = 0; m < MACRO_COUNT; m++) {
+        const char* errorAt = "";
+        MacroParseError error = _macroPrograms[m].parse(MACROS[m].steps, &errorAt);
+        if (error != MacroParseError::NONE) {
+            LOG_ERROR(BED, "Macro %s: %s at \"%s\"", MACROS[m].id, macroParseErrorName(error), errorAt);
+        }
+    }
+    _macroEngine.begin(_platform.nowUs());
+}
+
+void BedWorker::attachBed(size_t i) {
+    MotoSleepBed* bed = _beds[i];
+    bed->setLatencies(&_latencies[i]);
+    _router.setBed(i, bed->getId());
+    _breakers[i].reset();
+
+    // Skip discovery on the first connect if an earlier one cached the handle
+    if (bed->hasAddress()) {
+        _storedHandles[i] = BedStore::loadHandle(bed->getBleName());
+        _links[i]->setHandle(_storedHandles[i]);
+    }
+
+    // Position estimates start unknown, with calibrated travel times where a
+    // run has stored them (up then down, head then feet)
+    uint32_t travel[ACTUATOR_COUNT * 2] = {
+        HEAD_TRAVEL_UP_MS, HEAD_TRAVEL_DOWN_MS, FEET_TRAVEL_UP_MS, FEET_TRAVEL_DOWN_MS
+    };
+    if (BedStore::loadTravel(bed->getBleName(), travel, ACTUATOR_COUNT * 2)) {
+        LOG_INFO(NVS, "Using calibrated travel times for %s", bed->getFriendlyName());
+    }
+    for (size_t a = 0; a < ACTUATOR_COUNT; a++) {
+        _positions[i][a] = ActuatorEstimate();
+        _positions[i][a].setTravel(travel[a * 2], travel[a * 2 + 1]);
+        _positions[i][a].setSlop(MOTOR_HOLD_INTERVAL);
+        _calibrations[i][a].phase = CalibrationPhase::IDLE;
+        _calibrations[i][a].done = false;
+        _calibrations[i][a].upMs = travel[a * 2];
+        _calibrations[i][a].downMs = travel[a * 2 + 1];
+    }
+}
+
+void BedWorker::detachBed(size_t i) {
+    for (size_t a = 0; a < ACTUATOR_COUNT; a++) {
+        _calibrations[i][a].phase = CalibrationPhase::IDLE;
+    }
+    _macroEngine.cancel(i);
+    _motorHolds[i].stop();
+    trackMotion(i);
+    _pool.setPinned(i, false);
+    _router.clearBed(i);
+
+    // The worker is the queue's consumer, but it is parked meanwhile
+    QueuedCommand stale;
+    while (_commandQueues[i].dequeue(stale)) {
+    }
+    while (_stopQueues[i].dequeue(stale)) {
+    }
+    _stopPending[i] = false;
+    _storedHandles[i] = 0;
+}
+
+// =============================================================================
+// MQTT side
+// =============================================================================
+static bool payloadEquals(const uint8_t* payload, unsigned int length, const char* value) {
+    return strlen(value) == length && memcmp(payload, value, length) == 0;
+}
+
+// Index of the macro with this ID (not necessarily null-terminated), or MACRO_COUNT
+static size_t findMacro(const char* id, size_t len) {
+    for (size_t m = 0; m < MACRO_COUNT; m++) {
+        if (strlen(MACROS[m].id) == len && memcmp(MACROS[m].id, id, len) == 0) {
+            return m;
+        }
+    }
+    return MACRO_COUNT;
+}
+
+// {actuator}_position and {actuator}_calibrate topics. Returns false if name is neither.
+static bool findActuatorTopic(const char* name, size_t len, size_t& actuator, bool& calibrate) {
+    for (size_t a = 0; a < ACTUATOR_COUNT; a++) {
+        size_t nameLen = strlen(actuatorName(a));
+        if (len <= nameLen + 1 || strncmp(name, actuatorName(a), nameLen) != 0 || name[nameLen] != '_') continue;
+
+        const char* suffix = name + nameLen + 1;
+        size_t suffixLen = len - nameLen - 1;
+        if (suffixLen == 8 && strncmp(suffix, "position", 8) == 0) {
+            calibrate = false;
+        } else if (suffixLen == 9 && strncmp(suffix, "calibrate", 9) == 0) {
+            calibrate = true;
+        } else {
+            return false;
+        }
+        actuator = a;
+        return true;
+    }
+    return false;
+}
+
+// Cover payloads: OPEN, CLOSE, STOP or a position 0-100. Returns false if malformed.
+static bool parsePositionPayload(const uint8_t* payload, unsigned int length, CommandAction& action, uint8_t& percent) {
+    if (payloadEquals(payload, length, "STOP")) {
+        action = CommandAction::POSITION_STOP;
+        return true;
+    }
+
+    action = CommandAction::POSITION_SET;
+    if (payloadEquals(payload, length, "OPEN")) {
+        percent = 100;
+        return true;
+    }
+    if (payloadEquals(payload, length, "CLOSE")) {
+        percent = 0;
+        return true;
+    }
+
+    if (!length || length > 3) return false;
+    unsigned value = 0;
+    for (unsigned int i = 0; i < length; i++) {
+        if (payload[i] < '0' || payload[i] > '9') return false;
+        value = value * 10 + (payload[i] - '0');
+    }
+    if (value > 100) return false;
+    percent = static_cast<uint8_t>(value);
+    return true;
+}
+
+// Actions that end motion the worker is running; like the bed's stop
+// commands, they go ahead of everything queued
+static bool haltsMotion(CommandAction action) {
+    switch (action) {
+        case CommandAction::HOLD_STOP:
+        case CommandAction::MACRO_STOP:
+        case CommandAction::POSITION_STOP:
+        case CommandAction::CALIBRATE_STOP:
+            return true;
+        default:
+            return false;
+    }
+}
+
+void BedWorker::onCommand(const char* topic, const uint8_t* payload, unsigned int length) {
+    uint32_t parseStart = micros();
+
+    // Resolve motosleep/{bed_id}/{command}/set in place; nothing here allocates
+    TopicRoute route;
+    size_t macro = MACRO_COUNT;
+    size_t actuator = ACTUATOR_COUNT;
+    bool calibrate = false;
+    switch (_router.route(topic, route)) {
+        case RouteResult::OK:
+            break;
+        case RouteResult::UNKNOWN_BED:
+            LOG_WARN(MQTT, "Unknown bed ID: %.*s", (int)route.bedIdLength, route.bedId);
+            return;
+        case RouteResult::UNKNOWN_COMMAND:
+            // Not a bed command; it may name a macro or an actuator
+            if (findActuatorTopic(route.commandName, route.commandLength, actuator, calibrate)) break;
+            macro = findMacro(route.commandName, route.commandLength);
+            if (macro == MACRO_COUNT) {
+                LOG_WARN(MQTT, "Unknown command: %.*s", (int)route.commandLength, route.commandName);
+                return;
+            }
+            if (!_macroPrograms[macro].count) {
+                LOG_WARN(MQTT, "Macro %s has no valid steps", MACROS[macro].id);
+                return;
+            }
+            break;
+        default:
+            return;
+    }
+
+    char cmdChar;
+    CommandAction action = CommandAction::PRESS;
+    MotoSleep::Priority priority = MotoSleep::Priority::NORMAL;
+    uint8_t arg = 0;
+    if (actuator < ACTUATOR_COUNT) {
+        // Like macros, actuator commands carry an index in place of a command char
+        cmdChar = static_cast<char>(actuator);
+        if (calibrate) {
+            action = payloadEquals(payload, length, "STOP") ? CommandAction::CALIBRATE_STOP : CommandAction::CALIBRATE_START;
+        } else if (!parsePositionPayload(payload, length, action, arg)) {
+            LOG_WARN(MQTT, "Bad %s position: %.*s", actuatorName(actuator), (int)length, (const char*)payload);
+            return;
+        }
+    } else if (macro < MACRO_COUNT) {
+        // Macros share the command queue, with the macro index in place of a command char
+        cmdChar = static_cast<char>(macro);
+        action = payloadEquals(payload, length, "STOP") ? CommandAction::MACRO_STOP : CommandAction::MACRO_RUN;
+    } else {
+        cmdChar = route.command->command->cmdChar;
+        priority = route.command->priority;
+
+        // Motor commands accept START/STOP for continuous movement; anything else is a single press
+        if (route.command->category == MotoSleep::Category::MOTOR) {
+            if (payloadEquals(payload, length, "START")) {
+                action = CommandAction::HOLD_START;
+            } else if (payloadEquals(payload, length, "STOP")) {
+                action = CommandAction::HOLD_STOP;
+            }
+        }
+    }
+
+    bool stop = priority == MotoSleep::Priority::STOP || haltsMotion(action);
+
+    // Groups fan out on the BLE worker; members not yet discovered are skipped there
+    if (route.bedIndex >= MAX_BEDS) {
+        size_t group = route.bedIndex - MAX_BEDS;
+        if (stop) {
+            // Stops skip the fan-out and go straight to each member
+            uint32_t members = BED_GROUPS[group].members & registeredBeds();
+            for (size_t i = 0; i < MAX_BEDS; i++) {
+                if (!(members & (1u << i)) || !_beds[i]->hasAddress()) continue;
+                if (!_stopQueues[i].enqueue(cmdChar, micros(), action, arg)) {
+                    LOG_WARN(MQTT, "Stop queue full for bed %s, dropping '%c'", _beds[i]->getFriendlyName(), cmdChar);
+                }
+            }
+            _platform.notify();
+            return;
+        }
+        if (!_groupQueues[group].enqueue(cmdChar, micros(), action, arg)) {
+            LOG_WARN(MQTT, "Queue full for group %s, dropping '%c'", BED_GROUPS[group].friendlyName, cmdChar);
+            return;
+        }
+        LOG_DEBUG(MQTT, "Queued command '%c' for group %s", cmdChar, BED_GROUPS[group].friendlyName);
+        _platform.notify();
+        return;
+    }
+
+    size_t bedIndex = route.bedIndex;
+    MotoSleepBed* targetBed = _beds[bedIndex];
+    if (!targetBed->hasAddress()) {
+        LOG_WARN(MQTT, "Bed %s not discovered yet", targetBed->getId());
+        return;
+    }
+
+    // Hand the command to the BLE worker; never block the MQTT client on BLE I/O
+    bool queued = stop
+        ? _stopQueues[bedIndex].enqueue(cmdChar, micros(), action, arg)
+        : _commandQueues[bedIndex].enqueue(cmdChar, micros(), action, arg);
+    if (!queued) {
+        LOG_WARN(MQTT, "Queue full for bed %s, dropping '%c'", targetBed->getFriendlyName(), cmdChar);
+        return;
+    }
+    _latencies[bedIndex].record(LatencyStage::PARSE, micros() - parseStart);
+    LOG_DEBUG(MQTT, "Queued command '%c' for bed %s", cmdChar, targetBed->getFriendlyName());
+    _platform.notify();
+}
+
+// =============================================================================
+// Worker
+// =============================================================================
+unsigned long BedWorker::service(unsigned long maxWaitMs) {
+    // Stops first: they may end the holds and macros serviced below
+    serviceStops();
+
+    // Close idle links, run due macro steps, repeat due holds, update
+    // position estimates and retry failing beds
+    unsigned long waitMs = _pool.evictIdle(maxWaitMs);
+    waitMs = serviceMacros(waitMs);
+    waitMs = serviceMotorHolds(waitMs);
+    publishHoldState();
+    waitMs = updatePositions(waitMs);
+    waitMs = serviceBreakers(waitMs);
+
+    // With a bed's queues empty, nothing queued before its last stop is left
+    bool groupsQueued = false;
+    for (size_t g = 0; g < BED_GROUP_COUNT; g++) {
+        if (!_groupQueues[g].empty()) groupsQueued = true;
+    }
+    for (size_t i = 0; i < MAX_BEDS; i++) {
+        if (!groupsQueued && _commandQueues[i].empty()) _stopPending[i] = false;
+    }
+    return waitMs;
+}
+
+void BedWorker::drain() {
+    // Round-robin so one busy bed can't starve the others
+    bool pending = true;
+    while (pending) {
+        pending = false;
+        for (size_t i = 0; i < MAX_BEDS; i++) {
+            serviceDue();
+            QueuedCommand cmd;
+            if (!_commandQueues[i].dequeue(cmd)) continue;
+            pending = true;
+            size_t blocks = _platform.allocatedBlocks();
+            runCommand(i, cmd);
+            _commandHeap.record(blocks, _platform.allocatedBlocks());
+        }
+        for (size_t g = 0; g < BED_GROUP_COUNT; g++) {
+            serviceDue();
+            QueuedCommand cmd;
+            if (!_groupQueues[g].dequeue(cmd)) continue;
+            pending = true;
+            size_t blocks = _platform.allocatedBlocks();
+            runGroupCommand(g, cmd);
+            _commandHeap.record(blocks, _platform.allocatedBlocks());
+        }
+    }
+    publishHoldState();
+}
+
+bool BedWorker::pending() const {
+    for (size_t i = 0; i < MAX_BEDS; i++) {
+        if (!_commandQueues[i].empty() || !_stopQueues[i].empty()) return true;
+    }
+    for (size_t g = 0; g < BED_GROUP_COUNT; g++) {
+        if (!_groupQueues[g].empty()) return true;
+    }
+    return false;
+}
+
+// Bitmask of the slots holding a bed
+uint32_t BedWorker::registeredBeds() const {
+    uint32_t mask = 0;
+    for (size_t i = 0; i < MAX_BEDS; i++) {
+        if (_beds[i]) mask |= 1u << i;
+    }
+    return mask;
+}
+
+// Save the characteristic handle if discovery found a new one (or dropped a stale one)
+void BedWorker::persistHandle(size_t i) {
+    uint16_t handle = _links[i]->getHandle();
+    if (handle != _storedHandles[i]) {
+        _storedHandles[i] = handle;
+        BedStore::saveHandle(_beds[i]->getBleName(), handle);
+    }
+}
+
+// Keep a bed's link open while a motor hold or macro needs it
+void BedWorker::updatePin(size_t i) {
+    _pool.setPinned(i, _motorHolds[i].active() || _macroEngine.active(i));
+}
+
+// Start or cancel a macro. Returns false if cmd is not a macro action.
+bool BedWorker::handleMacroControl(size_t i, const QueuedCommand& cmd) {
+    size_t macro = static_cast<uint8_t>(cmd.cmdChar);
+
+    if (cmd.action == CommandAction::MACRO_RUN) {
+        LOG_INFO(BLE, "Starting macro %s on bed %s", MACROS[macro].friendlyName, _beds[i]->getFriendlyName());
+        _macroEngine.start(i, _macroPrograms[macro].steps, _macroPrograms[macro].count, _platform.nowUs());
+        // Every step goes out over the same connection
+        _pool.setPinned(i, true);
+        return true;
+    }
+
+    if (cmd.action == CommandAction::MACRO_STOP) {
+        if (_macroEngine.active(i)) {
+            LOG_INFO(BLE, "Stopping macro on bed %s", _beds[i]->getFriendlyName());
+            _macroEngine.cancel(i);
+            _motorHolds[i].stop();
+        }
+        updatePin(i);
+        return true;
+    }
+
+    return false;
+}
+
+// Handle hold commands that need no write (STOP, or a START refreshing the
+// running hold). Returns false if cmd still has to be written.
+bool BedWorker::handleHoldControl(size_t i, const QueuedCommand& cmd) {
+    MotorHold& hold = _motorHolds[i];
+
+    if (cmd.action == CommandAction::HOLD_STOP) {
+        // Nothing to write: the motor stops once the repeats stop
+        if (hold.active()) {
+            LOG_INFO(BLE, "Releasing hold '%c' on bed %s", hold.cmdChar(), _beds[i]->getFriendlyName());
+        }
+        hold.stop();
+        updatePin(i);
+        trackMotion(i);
+        return true;
+    }
+
+    // A repeated START for the running hold just refreshes the dead-man timer
+    if (cmd.action == CommandAction::HOLD_START && hold.active() && hold.cmdChar() == cmd.cmdChar) {
+        hold.start(cmd.cmdChar, micros());
+        return true;
+    }
+
+    return false;
+}
+
+// Connect bed i through the pool. Once the bed's breaker opens, commands
+// fail without touching the radio until a trial connect is due; the
+// platform hears about every connect that was tried.
+bool BedWorker::acquireBed(size_t i) {
+    if (!_beds[i]->hasAddress()) {
+        LOG_WARN(BLE, "Bed %s not discovered yet", _beds[i]->getFriendlyName());
+        return false;
+    }
+
+    CircuitBreaker& breaker = _breakers[i];
+    if (!_beds[i]->isConnected() && !breaker.allow(millis(), _platform.lastSeenMs(i))) {
+        LOG_DEBUG(BLE, "Bed %s unavailable, not connecting", _beds[i]->getFriendlyName());
+        return false;
+    }
+
+    // A full pool refuses before connecting; only a connect that was tried
+    // counts against the bed, and a trial that wasn't tried is still due
+    switch (_pool.acquire(i)) {
+        case AcquireResult::CONNECTED:
+            break;
+
+        case AcquireResult::NO_SLOT:
+            breaker.cancelTrial();
+            return false;
+
+        case AcquireResult::CONNECT_FAILED: {
+            BreakerState before = breaker.state();
+            breaker.failure(millis(), esp_random());
+            if (breaker.state() == BreakerState::OPEN && before != BreakerState::OPEN) {
+                LOG_WARN(BLE, "Bed %s unavailable, next try in %" PRIu32 " ms",
+                    _beds[i]->getFriendlyName(), breaker.getStats().openMs);
+            }
+            _platform.connectFailed(i);
+            return false;
+        }
+    }
+
+    if (breaker.state() != BreakerState::CLOSED) {
+        LOG_INFO(BLE, "Bed %s available again", _beds[i]->getFriendlyName());
+    }
+    breaker.success();
+    _platform.connected(i);
+    return true;
+}
+
+// Write to an acquired bed
+bool BedWorker::writeBed(size_t i, char cmdChar) {
+    bool written = _beds[i]->sendCommand(cmdChar);
+    persistHandle(i);
+    if (written) {
+        _bleWrites[i].fetch_add(1, std::memory_order_relaxed);
+        noteCommand(i, cmdChar);
+    }
+    return written;
+}
+
+// Bookkeeping once cmd has been written to bed i. burstUs is the length of
+// the hold a burst of merged presses runs as (0 for a single press).
+void BedWorker::commandWritten(size_t i, const QueuedCommand& cmd, uint32_t burstUs) {
+    _pool.release(i);
+
+    if (!_firstCommandMs) {
+        _firstCommandMs = millis();
+        LOG_INFO(BLE, "First command written %lu ms after boot", _firstCommandMs);
+    }
+
+    if (cmd.action == CommandAction::HOLD_START) {
+        // The write fills the first cadence slot
+        MotorHold& hold = _motorHolds[i];
+        uint32_t now = micros();
+        hold.start(cmd.cmdChar, now);
+        hold.poll(now);
+        _pool.setPinned(i, true);
+        trackMotion(i);
+    } else if (burstUs) {
+        MotorHold& hold = _motorHolds[i];
+        uint32_t now = micros();
+        hold.startTimed(cmd.cmdChar, now, burstUs, true);
+        hold.poll(now);
+        updatePin(i);
+        trackMotion(i);
+    }
+}
+
+// Commands that set the bed moving: motor and preset presses, holds,
+// macros and position drives
+static bool startsMotion(const QueuedCommand& cmd) {
+    switch (cmd.action) {
+        case CommandAction::PRESS: {
+            CoalesceKind kind = coalesceKind(cmd.cmdChar);
+            return kind == CoalesceKind::REPEAT || kind == CoalesceKind::SUPERSEDE;
+        }
+        case CommandAction::HOLD_START:
+        case CommandAction::MACRO_RUN:
+        case CommandAction::POSITION_SET:
+        case CommandAction::CALIBRATE_START:
+            return true;
+        default:
+            return false;
+    }
+}
+
+// True if a STOP that was queued after cmd cancels it
+bool BedWorker::preemptedByStop(size_t i, const QueuedCommand& cmd) const {
+    return _stopPending[i] && static_cast<int32_t>(cmd.enqueuedUs - _stopEnqueuedUs[i]) < 0 && startsMotion(cmd);
+}
+
+// Run a stop-class command. A STOP also ends the bed's hold, macro and
+// calibration run; hold, macro and position stops end theirs without a
+// write. Either way, motion queued before it is cancelled. A write goes
+// over the open link if there is one.
+void BedWorker::runStop(size_t i, const QueuedCommand& cmd) {
+    _latencies[i].record(LatencyStage::QUEUE, micros() - cmd.enqueuedUs);
+
+    if (cmd.action != CommandAction::PRESS) {
+        // The worker ends the hold, macro or drive itself; nothing is written
+        if (!handleMacroControl(i, cmd) && !handlePositionControl(i, cmd)) {
+            handleHoldControl(i, cmd);
+        }
+        _stopPending[i] = true;
+        _stopEnqueuedUs[i] = cmd.enqueuedUs;
+        _stopQueues[i].recordWrite(cmd, micros());
+        return;
+    }
+
+    if (cmd.cmdChar == MotoSleep::Massage::STOP) {
+        _macroEngine.cancel(i);
+        _motorHolds[i].stop();
+        for (size_t a = 0; a < ACTUATOR_COUNT; a++) {
+            _calibrations[i][a].phase = CalibrationPhase::IDLE;
+        }
+        trackMotion(i);
+        updatePin(i);
+        _stopPending[i] = true;
+        _stopEnqueuedUs[i] = cmd.enqueuedUs;
+    }
+
+    _platform.stopScan();
+
+    LOG_INFO(BLE, "Sending stop '%c' to bed %s", cmd.cmdChar, _beds[i]->getFriendlyName());
+    if (!acquireBed(i) || !writeBed(i, cmd.cmdChar)) {
+        _stopQueues[i].recordFailure();
+        return;
+    }
+    _stopQueues[i].recordWrite(cmd, micros());
+    commandWritten(i, cmd, 0);
+}
+
+// Run every queued stop. Called before each queued command and between the
+// connects of a group fan-out, so a stop only ever waits for the one BLE
+// operation already under way.
+void BedWorker::serviceStops() {
+    for (size_t i = 0; i < MAX_BEDS; i++) {
+        QueuedCommand cmd;
+        while (_stopQueues[i].dequeue(cmd)) {
+            runStop(i, cmd);
+        }
+    }
+}
+
+void BedWorker::runCommand(size_t i, QueuedCommand cmd) {
+    _latencies[i].record(LatencyStage::QUEUE, micros() - cmd.enqueuedUs);
+
+    if (preemptedByStop(i, cmd)) {
+        _commandQueues[i].recordPreempted();
+        return;
+    }
+
+    if (handleMacroControl(i, cmd) || handlePositionControl(i, cmd) || handleHoldControl(i, cmd)) {
+        _commandQueues[i].recordWrite(cmd, micros());
+        return;
+    }
+
+    // Fold in the presses queued right behind this one
+    uint32_t presses = coalesce(_commandQueues[i], cmd, COALESCE_WINDOW_MS * 1000UL);
+    if (!presses) {
+        _commandQueues[i].recordCoalesced();
+        return;
+    }
+
+    // Repeated motor presses run as one timed hold, a write interval per
+    // press, and presses that arrive while it runs make it longer. A hold
+    // that is already running for another reason is left alone.
+    uint32_t burstUs = 0;
+    if (coalesceKind(cmd.cmdChar) == CoalesceKind::REPEAT && cmd.action == CommandAction::PRESS) {
+        uint32_t pressesUs = presses * MOTOR_HOLD_INTERVAL * 1000UL;
+        if (_motorHolds[i].extendBurst(cmd.cmdChar, pressesUs)) {
+            _commandQueues[i].recordWrite(cmd, micros());
+            return;
+        }
+        if (presses > 1 && !_motorHolds[i].active()) {
+            burstUs = pressesUs;
+        }
+    }
+
+    // Connecting while scanning is unreliable; commands take priority
+    _platform.stopScan();
+
+    LOG_INFO(BLE, "Sending command '%c' to bed %s", cmd.cmdChar, _beds[i]->getFriendlyName());
+    if (!acquireBed(i) || !writeBed(i, cmd.cmdChar)) {
+        _commandQueues[i].recordFailure();
+        return;
+    }
+    _commandQueues[i].recordWrite(cmd, micros());
+    commandWritten(i, cmd, burstUs);
+}
+
+// Trial-connect beds whose breaker wait has run out. Home Assistant disables
+// an unavailable bed's buttons, so the worker has to bring it back without
+// waiting for a command. Returns ms until the next trial (or maxWaitMs).
+unsigned long BedWorker::serviceBreakers(unsigned long maxWaitMs) {
+    unsigned long waitMs = maxWaitMs;
+    uint32_t now = millis();
+
+    for (size_t i = 0; i < MAX_BEDS; i++) {
+        if (!_beds[i] || _breakers[i].state() != BreakerState::OPEN) continue;
+
+        uint32_t trialMs = _breakers[i].untilTrialMs(now, _platform.lastSeenMs(i));
+        if (trialMs) {
+            if (trialMs < waitMs) waitMs = trialMs;
+            continue;
+        }
+
+        // Connecting while scanning is unreliable; try again once the scan ends
+        if (_platform.scanning()) continue;
+        LOG_INFO(BLE, "Trying bed %s again", _beds[i]->getFriendlyName());
+        if (acquireBed(i)) _pool.release(i);
+    }
+
+    return waitMs;
+}
+
+// Fan a command out to every bed in a group. All members are connected
+// first (pinned so they can't evict each other), then written back-to-back,
+// so the beds start moving together instead of one connect apart.
+void BedWorker::runGroupCommand(size_t g, const QueuedCommand& cmd) {
+    uint32_t members = BED_GROUPS[g].members & registeredBeds();
+    uint32_t pending = 0;
+
+    for (size_t i = 0; i < MAX_BEDS; i++) {
+        if (!(members & (1u << i))) continue;
+        _latencies[i].record(LatencyStage::QUEUE, micros() - cmd.enqueuedUs);
+        if (preemptedByStop(i, cmd)) continue;
+        if (!handleMacroControl(i, cmd) && !handlePositionControl(i, cmd) && !handleHoldControl(i, cmd)) {
+            pending |= 1u << i;
+        }
+    }
+    if (!pending) {
+        _groupQueues[g].recordWrite(cmd, micros());
+        return;
+    }
+
+    _platform.stopScan();
+
+    LOG_INFO(BLE, "Sending command '%c' to group %s", cmd.cmdChar, BED_GROUPS[g].friendlyName);
+    uint32_t ready = 0;
+    for (size_t i = 0; i < MAX_BEDS; i++) {
+        if (!(pending & (1u << i))) continue;
+
+        // Connects are slow; a stop that came in meanwhile goes first
+        serviceStops();
+        if (preemptedByStop(i, cmd)) {
+            pending &= ~(1u << i);
+            continue;
+        }
+        _pool.setPinned(i, true);
+        if (acquireBed(i)) ready |= 1u << i;
+    }
+
+    // A stop that came in during the last connect cancels members already connected
+    serviceStops();
+    uint32_t preempted = 0;
+    for (size_t i = 0; i < MAX_BEDS; i++) {
+        if ((pending & (1u << i)) && preemptedByStop(i, cmd)) preempted |= 1u << i;
+    }
+
+    uint32_t written = 0;
+    size_t writeCount = 0;
+    int64_t firstWriteUs = 0;
+    int64_t lastWriteUs = 0;
+    // Nothing but the writes in this loop; handles are persisted afterwards
+    for (size_t i = 0; i < MAX_BEDS; i++) {
+        if (!(ready & (1u << i)) || (preempted & (1u << i))) continue;
+        if (!_beds[i]->sendCommand(cmd.cmdChar)) continue;
+        _bleWrites[i].fetch_add(1, std::memory_order_relaxed);
+        lastWriteUs = _platform.nowUs();
+        if (!writeCount++) firstWriteUs = lastWriteUs;
+        written |= 1u << i;
+    }
+
+    // Pins were only for the fan-out; holds started below pin again. Every
+    // member that was acquired goes back to the pool, written or not.
+    for (size_t i = 0; i < MAX_BEDS; i++) {
+        if (!(pending & (1u << i))) continue;
+        persistHandle(i);
+        if (ready & (1u << i)) _pool.release(i);
+        updatePin(i);
+        if (written & (1u << i)) {
+            noteCommand(i, cmd.cmdChar);
+            commandWritten(i, cmd, 0);
+        }
+    }
+
+    if (writeCount > 1) {
+        uint32_t skewUs = static_cast<uint32_t>(lastWriteUs - firstWriteUs);
+        _groupSkew[g].record(skewUs);
+        LOG_INFO(BLE, "Group %s: %u beds written, skew %" PRIu32 " us",
+            BED_GROUPS[g].friendlyName, (unsigned)writeCount, skewUs);
+    }
+
+    if (preempted == pending) {
+        _groupQueues[g].recordPreempted();
+    } else if (written == (pending & ~preempted)) {
+        _groupQueues[g].recordWrite(cmd, micros());
+    } else {
+        _groupQueues[g].recordFailure();
+    }
+}
+
+// Repeat held motor commands that are due. Returns ms until the next one (or maxWaitMs).
+unsigned long BedWorker::serviceMotorHolds(unsigned long maxWaitMs) {
+    unsigned long waitMs = maxWaitMs;
+
+    for (size_t i = 0; i < MAX_BEDS; i++) {
+        MotorHold& hold = _motorHolds[i];
+        if (!hold.active()) continue;
+
+        if (hold.poll(micros())) {
+            // The hold keeps its link pinned, so this only connects after a drop
+            bool written = acquireBed(i) && _beds[i]->sendCommand(hold.cmdChar());
+            persistHandle(i);
+            if (written) {
+                _bleWrites[i].fetch_add(1, std::memory_order_relaxed);
+                _pool.release(i);
+            } else {
+                LOG_WARN(BLE, "Hold '%c' on bed %s lost its connection", hold.cmdChar(), _beds[i]->getFriendlyName());
+                hold.stop();
+            }
+        }
+
+        if (!hold.active()) {
+            updatePin(i);
+            continue;
+        }
+
+        unsigned long holdWaitMs = (hold.untilNextUs(micros()) + 999) / 1000;
+        if (holdWaitMs < waitMs) waitMs = holdWaitMs;
+    }
+
+    return waitMs;
+}
+
+// MotorHold is the worker's alone; other tasks see only this summary
+void BedWorker::publishHoldState() {
+    bool active = false;
+    for (size_t i = 0; i < MAX_BEDS; i++) {
+        if (_motorHolds[i].active()) active = true;
+    }
+    _holdActive.store(active, std::memory_order_relaxed);
+}
+
+// Write one macro step over the bed's pinned connection
+bool BedWorker::runMacroStep(size_t i, const MacroStep& step) {
+    _platform.stopScan();
+
+    LOG_DEBUG(BLE, "Macro step '%c' on bed %s", step.cmdChar, _beds[i]->getFriendlyName());
+    if (!acquireBed(i) || !writeBed(i, step.cmdChar)) {
+        LOG_WARN(BLE, "Macro on bed %s stopped: step '%c' failed", _beds[i]->getFriendlyName(), step.cmdChar);
+        return false;
+    }
+    _pool.release(i);
+
+    if (step.holdMs) {
+        // The hold ends itself; the next step is scheduled after it
+        MotorHold& hold = _motorHolds[i];
+        uint32_t now = micros();
+        hold.startTimed(step.cmdChar, now, step.holdMs * 1000UL);
+        hold.poll(now);
+    }
+    return true;
+}
+
+// Run macro steps that are due. Returns ms until the next one (or maxWaitMs).
+unsigned long BedWorker::serviceMacros(unsigned long maxWaitMs) {
+    _macroEngine.service(_platform.nowUs(), [this](size_t i, const MacroStep& step) {
+        return runMacroStep(i, step);
+    });
+
+    // Release beds whose macro just ended
+    for (size_t i = 0; i < MAX_BEDS; i++) {
+        updatePin(i);
+    }
+
+    uint32_t untilUs = _macroEngine.untilNextUs(_platform.nowUs());
+    if (untilUs == UINT32_MAX) return maxWaitMs;
+    unsigned long macroWaitMs = (untilUs + 999) / 1000;
+    return macroWaitMs < maxWaitMs ? macroWaitMs : maxWaitMs;
+}
+
+// Run between queued commands: stops, then the macro steps and hold repeats
+// that fell due while the last command was written, so a burst of commands
+// can't starve the hold cadence into a dead-man stop or push steps late
+void BedWorker::serviceDue() {
+    serviceStops();
+    serviceMacros(0);
+    serviceMotorHolds(0);
+    publishHoldState();
+}
+
+// =============================================================================
+// Position estimates
+// Runs on the BLE worker alongside the holds and writes they follow.
+// =============================================================================
+// Fold a single write into the estimates
+void BedWorker::noteCommand(size_t i, char cmdChar) {
+    using namespace MotoSleep;
+    uint32_t now = millis();
+    size_t a;
+    MotorDirection dir;
+
+    if (motorForCommand(cmdChar, a, dir)) {
+        // One write runs the motor for about one repeat interval
+        _positions[i][a].start(dir, now, MOTOR_HOLD_INTERVAL);
+        return;
+    }
+
+    switch (cmdChar) {
+        case Preset::HOME:
+            // Flat: both actuators run down to their end stops
+            for (a = 0; a < ACTUATOR_COUNT; a++) {
+                uint32_t runMs = _positions[i][a].plan(0, dir);
+                if (runMs) _positions[i][a].start(MotorDirection::DOWN, now, runMs);
+            }
+            break;
+        case Preset::MEMORY_1:
+        case Preset::MEMORY_2:
+        case Preset::ANTI_SNORE:
+        case Preset::TV:
+        case Preset::ZERO_G:
+            // Stored positions the controller never sees
+            for (a = 0; a < ACTUATOR_COUNT; a++) _positions[i][a].forget(now);
+            break;
+        case Massage::STOP:
+            for (a = 0; a < ACTUATOR_COUNT; a++) _positions[i][a].stop(now);
+            break;
+    }
+}
+
+// Write a motor char and hold it for runMs
+bool BedWorker::driveActuator(size_t i, size_t a, MotorDirection dir, uint32_t runMs) {
+    char cmdChar = commandForMotor(a, dir);
+    _platform.stopScan();
+
+    if (!acquireBed(i) || !writeBed(i, cmdChar)) {
+        LOG_WARN(BLE, "Could not move %s of bed %s", actuatorName(a), _beds[i]->getFriendlyName());
+        return false;
+    }
+    _pool.release(i);
+
+    MotorHold& hold = _motorHolds[i];
+    uint32_t now = micros();
+    hold.startTimed(cmdChar, now, runMs * 1000UL);
+    hold.poll(now);
+    updatePin(i);
+    trackMotion(i);
+    return true;
+}
+
+void BedWorker::startCalibrationRise(size_t i, size_t a) {
+    Calibration& cal = _calibrations[i][a];
+
+    // Twice the configured travel is plenty of time to press STOP at the top
+    cal.phase = CalibrationPhase::RISING;
+    if (!driveActuator(i, a, MotorDirection::UP, _positions[i][a].travelMs(MotorDirection::UP) * 2)) {
+        cal.phase = CalibrationPhase::IDLE;
+        return;
+    }
+    cal.riseStartMs = millis();
+    LOG_INFO(BED, "Calibrating %s of bed %s: rising, send STOP at the top", actuatorName(a), _beds[i]->getFriendlyName());
+}
+
+// A hold driving actuator a just ended
+void BedWorker::calibrationHoldEnded(size_t i, size_t a) {
+    Calibration& cal = _calibrations[i][a];
+
+    if (cal.phase == CalibrationPhase::HOMING) {
+        // Only a run long enough to sync at the bottom counts as homed
+        if (_positions[i][a].position(millis()) == 0 && _positions[i][a].uncertainty() == 0) {
+            startCalibrationRise(i, a);
+        } else {
+            LOG_WARN(BED, "Calibrating %s of bed %s: homing interrupted", actuatorName(a), _beds[i]->getFriendlyName());
+            cal.phase = CalibrationPhase::IDLE;
+        }
+    } else if (cal.phase == CalibrationPhase::RISING) {
+        LOG_WARN(BED, "Calibrating %s of bed %s: rise ended without STOP", actuatorName(a), _beds[i]->getFriendlyName());
+        cal.phase = CalibrationPhase::IDLE;
+    }
+}
+
+// Follow bed i's motor hold: stop the estimate it was driving, start the
+// one it drives now
+void BedWorker::trackMotion(size_t i) {
+    MotorHold& hold = _motorHolds[i];
+    char held = hold.active() ? hold.cmdChar() : 0;
+    char ended = _trackedHolds[i];
+    if (held == ended) return;
+    _trackedHolds[i] = held;
+
+    uint32_t now = millis();
+    size_t a;
+    MotorDirection dir;
+    if (motorForCommand(ended, a, dir)) {
+        _positions[i][a].stop(now);
+    }
+    if (motorForCommand(held, a, dir)) {
+        _positions[i][a].start(dir, now);
+    }
+    // May start the next calibration hold
+    if (motorForCommand(ended, a, dir)) {
+        calibrationHoldEnded(i, a);
+    }
+}
+
+// End the hold if it drives actuator a
+void BedWorker::stopActuator(size_t i, size_t a) {
+    MotorHold& hold = _motorHolds[i];
+    size_t heldActuator;
+    MotorDirection dir;
+    if (hold.active() && motorForCommand(hold.cmdChar(), heldActuator, dir) && heldActuator == a) {
+        hold.stop();
+        updatePin(i);
+        trackMotion(i);
+    }
+}
+
+// The user stopped the rise at the top: adopt the measured travel time
+void BedWorker::finishCalibration(size_t i, size_t a) {
+    Calibration& cal = _calibrations[i][a];
+    ActuatorEstimate& estimate = _positions[i][a];
+    uint32_t measuredMs = millis() - cal.riseStartMs;
+
+    cal.phase = CalibrationPhase::IDLE;
+    stopActuator(i, a);
+
+    // Unclamped estimate at the top, so a too-short configured travel shows up too
+    uint32_t upMs = estimate.travelMs(MotorDirection::UP);
+    uint32_t downMs = estimate.travelMs(MotorDirection::DOWN);
+    int32_t errorPermille = static_cast<int32_t>((uint64_t)measuredMs * ActuatorEstimate::FULL / upMs) - ActuatorEstimate::FULL;
+
+    // Descent isn't timed; scale it by the same factor
+    downMs = static_cast<uint32_t>((uint64_t)downMs * measuredMs / upMs);
+    estimate.setTravel(measuredMs, downMs);
+    estimate.setPosition(ActuatorEstimate::FULL);
+
+    cal.errorPermille = static_cast<int16_t>(errorPermille < -1000 ? -1000 : errorPermille > 1000 ? 1000 : errorPermille);
+    cal.upMs = measuredMs;
+    cal.downMs = downMs;
+    cal.done = true;
+
+    uint32_t travel[ACTUATOR_COUNT * 2];
+    for (size_t t = 0; t < ACTUATOR_COUNT; t++) {
+        travel[t * 2] = _positions[i][t].travelMs(MotorDirection::UP);
+        travel[t * 2 + 1] = _positions[i][t].travelMs(MotorDirection::DOWN);
+    }
+    BedStore::saveTravel(_beds[i]->getBleName(), travel, ACTUATOR_COUNT * 2);
+
+    LOG_INFO(BED, "Calibrated %s of bed %s: up %" PRIu32 " ms, down %" PRIu32 " ms, estimate was off by %" PRId32 " permille",
+        actuatorName(a), _beds[i]->getFriendlyName(), measuredMs, downMs, errorPermille);
+}
+
+// Position and calibration commands. Returns false if cmd is neither.
+bool BedWorker::handlePositionControl(size_t i, const QueuedCommand& cmd) {
+    switch (cmd.action) {
+        case CommandAction::POSITION_SET:
+        case CommandAction::POSITION_STOP:
+        case CommandAction::CALIBRATE_START:
+        case CommandAction::CALIBRATE_STOP:
+            break;
+        default:
+            return false;
+    }
+
+    size_t a = static_cast<uint8_t>(cmd.cmdChar);
+    ActuatorEstimate& estimate = _positions[i][a];
+    Calibration& cal = _calibrations[i][a];
+    MotorDirection dir;
+    uint32_t runMs;
+
+    switch (cmd.action) {
+        case CommandAction::POSITION_SET:
+            // Plan from where the actuator is now, not where a running hold is taking it
+            cal.phase = CalibrationPhase::IDLE;
+            stopActuator(i, a);
+            estimate.settle(millis());
+
+            runMs = estimate.plan(static_cast<uint16_t>(cmd.arg) * 10, dir);
+            if (!runMs) return true;
+            LOG_INFO(BLE, "Moving %s of bed %s to %u%% (%s for %" PRIu32 " ms)", actuatorName(a),
+                _beds[i]->getFriendlyName(), cmd.arg, directionName(dir), runMs);
+            driveActuator(i, a, dir, runMs);
+            return true;
+
+        case CommandAction::POSITION_STOP:
+        case CommandAction::CALIBRATE_STOP:
+            // The cover's STOP also ends a calibration rise, so a run needs nothing but HA
+            if (cal.phase == CalibrationPhase::RISING) {
+                finishCalibration(i, a);
+            } else {
+                cal.phase = CalibrationPhase::IDLE;
+                stopActuator(i, a);
+            }
+            return true;
+
+        case CommandAction::CALIBRATE_START:
+            cal.phase = CalibrationPhase::IDLE;
+            stopActuator(i, a);
+            estimate.settle(millis());
+
+            // Home with margin for a configured travel time that is too short
+            runMs = estimate.plan(0, dir);
+            if (!runMs) {
+                startCalibrationRise(i, a);
+                return true;
+            }
+            LOG_INFO(BED, "Calibrating %s of bed %s: homing", actuatorName(a), _beds[i]->getFriendlyName());
+            cal.phase = CalibrationPhase::HOMING;
+            if (!driveActuator(i, a, MotorDirection::DOWN, runMs + runMs / 2)) {
+                cal.phase = CalibrationPhase::IDLE;
+            }
+            return true;
+
+        default:
+            return false;
+    }
+}
+
+// Follow holds, fold finished runs into the estimates and hand them to
+// loop(). Returns ms until the next update (or maxWaitMs).
+unsigned long BedWorker::updatePositions(unsigned long maxWaitMs) {
+    bool moving = false;
+
+    for (size_t i = 0; i < MAX_BEDS; i++) {
+        trackMotion(i);
+
+        uint32_t now = millis();
+        for (size_t a = 0; a < ACTUATOR_COUNT; a++) {
+            ActuatorEstimate& estimate = _positions[i][a];
+            estimate.settle(now);
+            MotorDirection dir = estimate.direction(now);
+            if (dir != MotorDirection::NONE) moving = true;
+
+            // position | uncertainty << 10 | direction << 20
+            uint32_t state = estimate.position(now) | (uint32_t)estimate.uncertainty() << 10
+                | (uint32_t)(static_cast<int8_t>(dir) + 1) << 20;
+            _positionStates[i][a].store(state, std::memory_order_relaxed);
+        }
+    }
+
+    // Keep published positions moving during runs with no hold to wake us
+    if (moving && maxWaitMs > POSITION_PUBLISH_INTERVAL) return POSITION_PUBLISH_INTERVAL;
+    return maxWaitMs;
+}
@@ -0,0 +1,105 @@
+#include "ConnectionPool.h"
+#include "Log.h"
+
+ConnectionPool::ConnectionPool(MotoSleepBed** beds, size_t count)
+    : _beds(beds), _count(count) {
+}
+
+AcquireResult ConnectionPool::acquire(size_t index) {
+    MotoSleepBed* bed = _beds[index];
+    Slot& slot = _slots[index];
+
+    if (bed->isConnected()) {
+        slot.warmSends.fetch_add(1, std::memory_order_relaxed);
+        slot.lastUsed = millis();
+        return AcquireResult::CONNECTED;
+    }
+
+    // Make room if the controller is at its connection limit
+    if (connectedCount() >= BLE_MAX_CONNECTIONS && !evictLeastRecentlyUsed(index)) {
+        LOG_WARN(POOL, "No connection slot free for %s", bed->getFriendlyName());
+        slot.connectFailures.fetch_add(1, std::memory_order_relaxed);
+        return AcquireResult::NO_SLOT;
+    }
+
+    slot.coldSends.fetch_add(1, std::memory_order_relaxed);
+    if (!bed->connect()) {
+        slot.connectFailures.fetch_add(1, std::memory_order_relaxed);
+        return AcquireResult::CONNECT_FAILED;
+    }
+
+    slot.lastUsed = millis();
+    return AcquireResult::CONNECTED;
+}
+
+void ConnectionPool::release(size_t index) {
+    _slots[index].lastUsed = millis();
+}
+
+unsigned long ConnectionPool::expiryDelay() const {
+    unsigned long timeout = _idleTimeoutMs;
+    return timeout > WRITE_SETTLE_MS ? timeout : WRITE_SETTLE_MS;
+}
+
+unsigned long ConnectionPool::evictIdle(unsigned long maxWaitMs) {
+    unsigned long now = millis();
+    unsigned long delay = expiryDelay();
+    unsigned long nextWait = maxWaitMs;
+
+    for (size_t i = 0; i < _count; i++) {
+        if (_slots[i].pinned || !_beds[i] || !_beds[i]->isConnected()) continue;
+
+        unsigned long idle = now - _slots[i].lastUsed;
+        if (idle >= delay) {
+            LOG_INFO(POOL, "%s idle for %lu ms, disconnecting", _beds[i]->getFriendlyName(), idle);
+            _beds[i]->disconnect();
+            _slots[i].idleEvictions.fetch_add(1, std::memory_order_relaxed);
+        } else if (delay - idle < nextWait) {
+            nextWait = delay - idle;
+        }
+    }
+
+    return nextWait;
+}
+
+bool ConnectionPool::evictLeastRecentlyUsed(size_t except) {
+    size_t victim = _count;
+    unsigned long now = millis();
+    unsigned long longestIdle = 0;
+
+    for (size_t i = 0; i < _count; i++) {
+        if (i == except || _slots[i].pinned || !_beds[i] || !_beds[i]->isConnected()) continue;
+
+        unsigned long idle = now - _slots[i].lastUsed;
+        if (victim == _count || idle > longestIdle) {
+            victim = i;
+            longestIdle = idle;
+        }
+    }
+
+    if (victim == _count) return false;
+
+    LOG_INFO(POOL, "Evicting %s (idle %lu ms) to make room", _beds[victim]->getFriendlyName(), longestIdle);
+    _beds[victim]->disconnect();
+    _slots[victim].lruEvictions.fetch_add(1, std::memory_order_relaxed);
+    return true;
+}
+
+size_t ConnectionPool::connectedCount() const {
+    size_t connected = 0;
+    for (size_t i = 0; i < _count; i++) {
+        if (_beds[i] && _beds[i]->isConnected()) connected++;
+    }
+    return connected;
+}
+
+ConnectionStats ConnectionPool::getStats(size_t index) const {
+    const Slot& slot = _slots[index];
+    ConnectionStats stats;
+    stats.warmSends = slot.warmSends.load(std::memory_order_relaxed);
+    stats.coldSends = slot.coldSends.load(std::memory_order_relaxed);
+    stats.connectFailures = slot.connectFailures.load(std::memory_order_relaxed);
+    stats.idleEvictions = slot.idleEvictions.load(std::memory_order_relaxed);
+    stats.lruEvictions = slot.lruEvictions.load(std::memory_order_relaxed);
+    return stats;
+}
@@ -0,0 +1,197 @@
+#include "Esp32BleLink.h"
+#include "ConfigDefaults.h"
+#include "Log.h"
+
+// The write-with-response that checks a cached handle. Only the BLE worker
+// writes, so at most one is in flight; onGattcEvent hands back its status.
+static SemaphoreHandle_t checkDone = nullptr;
+static volatile uint16_t checkConnId = 0;
+static volatile uint16_t checkHandle = 0;
+static volatile esp_gatt_status_t checkStatus = ESP_GATT_OK;
+
+static void onGattcEvent(esp_gattc_cb_event_t event, esp_gatt_if_t gattcIf, esp_ble_gattc_cb_param_t* param) {
+    if (event != ESP_GATTC_WRITE_CHAR_EVT || !checkHandle) return;
+    if (param->write.conn_id != checkConnId || param->write.handle != checkHandle) return;
+    checkStatus = param->write.status;
+    checkHandle = 0;
+    xSemaphoreGive(checkDone);
+}
+
+Esp32BleLink::Esp32BleLink(const char* name) : _name(name) {
+}
+
+Esp32BleLink::~Esp32BleLink() {
+    disconnect();
+    delete _client;
+}
+
+bool Esp32BleLink::connect(const uint8_t address[6]) {
+    cleanup();
+
+    esp_bd_addr_t native;
+    memcpy(native, address, sizeof(native));
+    BLEAddress bleAddress(native);
+
+    if (!_client) {
+        _client = BLEDevice::createClient();
+        _client->setClientCallbacks(&_callbacks);
+    }
+    if (!checkDone) {
+        checkDone = xSemaphoreCreateBinary();
+        BLEDevice::setCustomGattcHandler(onGattcEvent);
+    }
+
+    // Connect to the BLE server. An unplugged bed would otherwise hold the
+    // worker until the stack gives up; the pending open is cancelled on timeout.
+    int64_t start = esp_timer_get_time();
+    if (!_client->connect(bleAddress, BLE_ADDR_TYPE_PUBLIC, BLE_CONNECT_TIMEOUT)) {
+        LOG_ERROR_TAG(BED, _name, "Failed to connect to BLE server");
+        _client->disconnect();
+        cleanup();
+        return false;
+    }
+    int64_t linked = esp_timer_get_time();
+    _timing.linkUs = static_cast<uint32_t>(linked - start);
+
+    // A known handle can be written straight away; the first write checks it
+    _handleChecked = false;
+    if (_handle) {
+        _timing.discoveryUs = 0;
+        _timing.cachedHandle = true;
+        return true;
+    }
+
+    if (!discover()) {
+        cleanup();
+        return false;
+    }
+
+    _timing.discoveryUs = static_cast<uint32_t>(esp_timer_get_time() - linked);
+    _timing.cachedHandle = false;
+    return true;
+}
+
+bool Esp32BleLink::discover() {
+    // Get the service
+    BLERemoteService* service = _client->getService(BLEUUID(MOTOSLEEP_SERVICE_UUID));
+    if (!service) {
+        LOG_ERROR_TAG(BED, _name, "Failed to find service UUID: %s", MOTOSLEEP_SERVICE_UUID);
+        return false;
+    }
+
+    // Get the characteristic
+    _characteristic = service->getCharacteristic(BLEUUID(MOTOSLEEP_CHARACTERISTIC_UUID));
+    if (!_characteristic) {
+        LOG_ERROR_TAG(BED, _name, "Failed to find characteristic UUID: %s", MOTOSLEEP_CHARACTERISTIC_UUID);
+        return false;
+    }
+
+    // Check if we can write to it
+    if (!_characteristic->canWrite()) {
+        LOG_ERROR_TAG(BED, _name, "Characteristic is not writable");
+        _characteristic = nullptr;
+        return false;
+    }
+
+    _handle = _characteristic->getHandle();
+    _handleChecked = true;
+    return true;
+}
+
+void Esp32BleLink::disconnect() {
+    if (_client && _client->isConnected()) {
+        _client->disconnect();
+    }
+    cleanup();
+}
+
+bool Esp32BleLink::isConnected() const {
+    return _client && _client->isConnected();
+}
+
+bool Esp32BleLink::write(const uint8_t* data, size_t len) {
+    if (!isConnected()) {
+        LOG_ERROR_TAG(BED, _name, "Not connected");
+        return false;
+    }
+
+    // Write to the cached handle without looking the characteristic up. A
+    // write without response is only queued locally, so the first write of
+    // each connection asks the bed to confirm the handle; one it rejects
+    // (the bed's firmware moved the characteristic) is rediscovered.
+    if (!_characteristic && _handle) {
+        if (_handleChecked) {
+            esp_err_t err = esp_ble_gattc_write_char(_client->getGattcIf(), _client->getConnId(), _handle,
+                len, const_cast<uint8_t*>(data), ESP_GATT_WRITE_TYPE_NO_RSP, ESP_GATT_AUTH_REQ_NONE);
+            if (err != ESP_OK) {
+                LOG_ERROR_TAG(BED, _name, "Write to handle 0x%04x failed (%d)", _handle, err);
+                return false;
+            }
+            return true;
+        }
+
+        bool rejected = false;
+        if (writeChecked(data, len, rejected)) {
+            _handleChecked = true;
+            return true;
+        }
+        if (!rejected) {
+            return false;
+        }
+
+        LOG_WARN_TAG(BED, _name, "Bed rejected handle 0x%04x (status %d), rediscovering", _handle, checkStatus);
+        _handle = 0;
+        if (!discover()) {
+            return false;
+        }
+    }
+
+    if (!_characteristic) {
+        LOG_ERROR_TAG(BED, _name, "No characteristic available");
+        return false;
+    }
+
+    _characteristic->writeValue(const_cast<uint8_t*>(data), len, false);
+    return true;
+}
+
+// Write with response to the cached handle and wait for the bed's answer.
+// rejected is set when the bed refused the write, as opposed to the write or
+// its answer not getting through.
+bool Esp32BleLink::writeChecked(const uint8_t* data, size_t len, bool& rejected) {
+    rejected = false;
+    xSemaphoreTake(checkDone, 0);   // Drop an answer that came after an earlier timeout
+    checkConnId = _client->getConnId();
+    checkHandle = _handle;
+
+    esp_err_t err = esp_ble_gattc_write_char(_client->getGattcIf(), _client->getConnId(), _handle,
+        len, const_cast<uint8_t*>(data), ESP_GATT_WRITE_TYPE_RSP, ESP_GATT_AUTH_REQ_NONE);
+    if (err != ESP_OK) {
+        checkHandle = 0;
+        LOG_ERROR_TAG(BED, _name, "Write to handle 0x%04x failed (%d)", _handle, err);
+        return false;
+    }
+
+    if (xSemaphoreTake(checkDone, pdMS_TO_TICKS(WRITE_RESPONSE_TIMEOUT_MS)) != pdTRUE) {
+        checkHandle = 0;
+        LOG_ERROR_TAG(BED, _name, "No response to write on handle 0x%04x", _handle);
+        return false;
+    }
+
+    rejected = checkStatus != ESP_GATT_OK;
+    return !rejected;
+}
+
+// Drop per-connection state; the client itself is kept for the next connect
+void Esp32BleLink::cleanup() {
+    _characteristic = nullptr;
+}
+
+// BLE Client Callbacks
+void BedClientCallback::onConnect(BLEClient* client) {
+    LOG_DEBUG(BLE, "Client connected");
+}
+
+void BedClientCallback::onDisconnect(BLEClient* client) {
+    LOG_DEBUG(BLE, "Client disconnected");
+}
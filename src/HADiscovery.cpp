@@ -1,170 +1,576 @@
 #include "HADiscovery.h"
-
-HADiscovery::HADiscovery(PubSubClient& mqtt) : _mqtt(mqtt) {
+#include <Preferences.h>
+#include "PublishStream.h"
+#include "PositionModel.h"
+#include "Log.h"
+
+static const char* NVS_NAMESPACE = "ha_discovery";
+static const char* NVS_HASH_KEY = "config_hash";
+
+// Sensor names, indexed by LatencyStage
+static const char* const LATENCY_SENSOR_NAMES[LATENCY_STAGE_COUNT] = {
+    "Parse Latency", "Queue Latency", "Connect Latency",
+    "Discovery Latency", "Write Latency", "Disconnect Latency",
+    "First Write Latency (Cached Handle)", "First Write Latency (Discovery)"
+};
+
+// Cover and calibration button names, indexed by actuator
+static const char* const COVER_NAMES[ACTUATOR_COUNT] = {"Head", "Feet"};
+static const char* const CALIBRATE_NAMES[ACTUATOR_COUNT] = {"Calibrate Head", "Calibrate Feet"};
+
+HADiscovery::HADiscovery(MqttTransport& mqtt) : _mqtt(mqtt) {
 }
 
-String HADiscovery::getDiscoveryTopic(const char* component, const BedConfig& bed, const char* entityId) {
-    // Format: homeassistant/{component}/{device_id}_{entity_id}/config
-    String topic = HA_DISCOVERY_PREFIX;
-    topic += "/";
-    topic += component;
-    topic += "/";
-    topic += DEVICE_NAME;
-    topic += "_";
-    topic += bed.id;
-    topic += "_";
-    topic += entityId;
-    topic += "/config";
-    return topic;
+// Call f(cmd) for every command in the MotoSleep tables, then for every
+// macro, which HA gets as a button like any other command
+template <typename F>
+static void forEachCommand(F f) {
+    for (size_t i = 0; i < MotoSleep::MOTOR_COMMAND_COUNT; i++) {
+        f(MotoSleep::MOTOR_COMMANDS[i]);
+    }
+    for (size_t i = 0; i < MotoSleep::PRESET_COMMAND_COUNT; i++) {
+        f(MotoSleep::PRESET_COMMANDS[i]);
+    }
+    for (size_t i = 0; i < MotoSleep::PROGRAM_COMMAND_COUNT; i++) {
+        f(MotoSleep::PROGRAM_COMMANDS[i]);
+    }
+    for (size_t i = 0; i < MotoSleep::MASSAGE_COMMAND_COUNT; i++) {
+        f(MotoSleep::MASSAGE_COMMANDS[i]);
+    }
+    for (size_t i = 0; i < MotoSleep::LIGHT_COMMAND_COUNT; i++) {
+        f(MotoSleep::LIGHT_COMMANDS[i]);
+    }
+    for (size_t i = 0; i < MACRO_COUNT; i++) {
+        f(MotoSleep::Command{MACROS[i].id, MACROS[i].friendlyName, 0, "macro", "mdi:playlist-play"});
+    }
 }
 
-String HADiscovery::getCommandTopic(const BedConfig& bed, const char* entityId) {
-    // Format: motosleep/{bed_id}/{entity_id}/set
-    String topic = "motosleep/";
-    topic += bed.id;
-    topic += "/";
-    topic += entityId;
-    topic += "/set";
-    return topic;
+template <typename Render>
+bool HADiscovery::publishStreamed(const char* topic, Render render) {
+    if (_hashSink) {
+        JsonWriter json(*_hashSink);
+        _hashSink->write(topic);
+        render(json);
+        return true;
+    }
+
+    // MQTT needs the length up front: render once to count, once to send
+    CountingPrint counter;
+    JsonWriter measure(counter);
+    render(measure);
+    size_t length = counter.count();
+
+    if (!_mqtt.beginPublish(topic, length, true)) {
+        _passFailed = true;
+        return false;
+    }
+
+    PublishStream stream(_mqtt);
+    JsonWriter json(stream);
+    render(json);
+    stream.flush();
+
+    _pass.publishes++;
+    _pass.bytes += length;
+    if (!_mqtt.endPublish()) {
+        _passFailed = true;
+        return false;
+    }
+    return true;
 }
 
-String HADiscovery::getStateTopic(const BedConfig& bed) {
-    // Format: motosleep/{bed_id}/state
-    String topic = "motosleep/";
-    topic += bed.id;
-    topic += "/state";
-    return topic;
+uint32_t HADiscovery::computeHash(const BedConfig* beds, size_t count,
+                                  const BedGroupConfig* groups, size_t groupCount) {
+    // Hash exactly what a pass would send, so any change to the bed table,
+    // command tables, discovery mode or sw_version is picked up
+    HashingPrint hasher;
+    _hashSink = &hasher;
+    publishControllerDiscovery();
+    for (size_t i = 0; i < count; i++) {
+        publishBedDiscovery(beds[i]);
+    }
+    for (size_t i = 0; i < groupCount; i++) {
+        publishGroupDiscovery(groups[i]);
+    }
+    _hashSink = nullptr;
+    return hasher.hash();
 }
 
-void HADiscovery::addDeviceInfo(JsonObject& device, const BedConfig& bed) {
-    device["identifiers"][0] = String(DEVICE_NAME) + "_" + bed.id;
-    device["name"] = bed.friendlyName;
-    device["manufacturer"] = "MotoSleep";
-    device["model"] = "Adjustable Bed";
-    device["via_device"] = DEVICE_NAME;
+uint32_t HADiscovery::loadStoredHash() {
+    Preferences prefs;
+    prefs.begin(NVS_NAMESPACE, true);
+    uint32_t hash = prefs.getUInt(NVS_HASH_KEY, 0);
+    prefs.end();
+    return hash;
 }
 
-void HADiscovery::addControllerDeviceInfo(JsonObject& device) {
-    device["identifiers"][0] = DEVICE_NAME;
-    device["name"] = DEVICE_FRIENDLY_NAME;
-    device["manufacturer"] = "DIY";
-    device["model"] = "ESP32 MotoSleep Controller";
-    device["sw_version"] = "1.0.0";
+void HADiscovery::storeHash(uint32_t hash) {
+    Preferences prefs;
+    prefs.begin(NVS_NAMESPACE, false);
+    prefs.putUInt(NVS_HASH_KEY, hash);
+    prefs.end();
 }
 
-void HADiscovery::publishButton(const BedConfig& bed, const MotoSleep::Command& cmd) {
-    JsonDocument doc;
+void HADiscovery::startPass(const BedConfig* beds, size_t count,
+                            const BedGroupConfig* groups, size_t groupCount, bool force) {
+    uint32_t hash = computeHash(beds, count, groups, groupCount);
+    if (!force && hash == loadStoredHash()) {
+        _passCounts.skipped++;
+        _passActive = false;
+        LOG_INFO(HA, "Discovery unchanged (hash %08lx), skipping", (unsigned long)hash);
+        return;
+    }
+
+    _pass = {};
+    _passFailed = false;
+    _passActive = true;
+    _passStep = 0;
+    _passHash = hash;
+    _passStart = millis();
+    _passBeds = beds;
+    _passBedCount = count;
+    _passGroups = groups;
+    _passGroupCount = groupCount;
+}
 
-    // Unique ID
-    String uniqueId = String(DEVICE_NAME) + "_" + bed.id + "_" + cmd.name;
-    doc["unique_id"] = uniqueId;
+bool HADiscovery::servicePass() {
+    if (!_passActive) return false;
 
-    // Name
-    doc["name"] = cmd.friendlyName;
+    size_t step = _passStep++;
+    if (step == 0) {
+        publishControllerDiscovery();
+    } else if (step <= _passBedCount) {
+        publishBedDiscovery(_passBeds[step - 1]);
+    } else if (step <= _passBedCount + _passGroupCount) {
+        publishGroupDiscovery(_passGroups[step - 1 - _passBedCount]);
+    }
 
-    // Command topic
-    doc["command_topic"] = getCommandTopic(bed, cmd.name);
+    if (_passStep <= _passBedCount + _passGroupCount) {
+        return true;
+    }
 
-    // Payload
-    doc["payload_press"] = "PRESS";
+    _passActive = false;
+    _pass.durationMs = millis() - _passStart;
+    _lastPass = _pass;
+    _passCounts.published++;
 
-    // Icon
-    if (cmd.icon) {
-        doc["icon"] = cmd.icon;
+    // Only remember the hash once the broker has every config
+    if (!_passFailed) {
+        storeHash(_passHash);
     }
 
-    // Device info
-    JsonObject device = doc["device"].to<JsonObject>();
-    addDeviceInfo(device, bed);
+    LOG_INFO(HA, "Discovery pass: %lu publishes, %lu bytes, %lu ms",
+        (unsigned long)_lastPass.publishes, (unsigned long)_lastPass.bytes,
+        (unsigned long)_lastPass.durationMs);
+    return false;
+}
 
-    // Availability
-    doc["availability_topic"] = "motosleep/status";
-    doc["payload_available"] = "online";
-    doc["payload_not_available"] = "offline";
+void HADiscovery::formatDiscoveryTopic(char* buffer, size_t size, const char* component, const BedConfig& bed, const char* entityId) {
+    // Format: homeassistant/{component}/{device_id}_{bed_id}_{entity_id}/config
+    snprintf(buffer, size, "%s/%s/%s_%s_%s/config", HA_DISCOVERY_PREFIX, component, DEVICE_NAME, bed.id, entityId);
+}
 
-    // Serialize and publish
-    String payload;
-    serializeJson(doc, payload);
+void HADiscovery::formatDeviceDiscoveryTopic(char* buffer, size_t size, const BedConfig& bed) {
+    // Format: homeassistant/device/{device_id}_{bed_id}/config
+    snprintf(buffer, size, "%s/device/%s_%s/config", HA_DISCOVERY_PREFIX, DEVICE_NAME, bed.id);
+}
 
-    String topic = getDiscoveryTopic("button", bed, cmd.name);
-    _mqtt.publish(topic.c_str(), payload.c_str(), true);
+void HADiscovery::formatStateTopic(char* buffer, size_t size, const BedConfig& bed) {
+    // Format: motosleep/{bed_id}/state
+    snprintf(buffer, size, "motosleep/%s/state", bed.id);
+}
 
-    Serial.printf("[HA] Published button: %s\n", cmd.name);
+void HADiscovery::formatLatencyEntityId(char* buffer, size_t size, size_t stage) {
+    // Format: latency_{stage}
+    snprintf(buffer, size, "latency_%s", latencyStageName(stage));
 }
 
-void HADiscovery::publishBedDiscovery(const BedConfig& bed) {
-    Serial.printf("[HA] Publishing discovery for bed: %s\n", bed.friendlyName);
+void HADiscovery::formatActuatorEntityId(char* buffer, size_t size, size_t actuator, const char* suffix) {
+    // Format: {actuator}_{suffix}, e.g. head_position
+    snprintf(buffer, size, "%s_%s", actuatorName(actuator), suffix);
+}
 
-    // Publish motor control buttons
-    for (size_t i = 0; i < MotoSleep::MOTOR_COMMAND_COUNT; i++) {
-        publishButton(bed, MotoSleep::MOTOR_COMMANDS[i]);
-    }
+// HA accepts abbreviated keys (uniq_id, cmd_t, dev, ...), which keeps payloads small
+
+void HADiscovery::writeDeviceInfo(JsonWriter& json, const BedConfig& bed, bool group) {
+    json.beginObject("dev");
+    json.beginString("ids");
+    json.append(DEVICE_NAME);
+    json.append("_");
+    json.append(bed.id);
+    json.endString();
+    json.field("name", bed.friendlyName);
+    json.field("mf", "MotoSleep");
+    json.field("mdl", group ? "Bed Group" : "Adjustable Bed");
+    json.field("via_device", DEVICE_NAME);
+    json.endObject();
+}
 
-    // Publish preset buttons
-    for (size_t i = 0; i < MotoSleep::PRESET_COMMAND_COUNT; i++) {
-        publishButton(bed, MotoSleep::PRESET_COMMANDS[i]);
-    }
+void HADiscovery::writeControllerDeviceInfo(JsonWriter& json) {
+    json.beginObject("dev");
+    json.field("ids", DEVICE_NAME);
+    json.field("name", DEVICE_FRIENDLY_NAME);
+    json.field("mf", "DIY");
+    json.field("mdl", "ESP32 MotoSleep Controller");
+    json.field("sw", MOTOSLEEP_SW_VERSION);
+    json.endObject();
+}
 
-    // Publish program buttons
-    for (size_t i = 0; i < MotoSleep::PROGRAM_COMMAND_COUNT; i++) {
-        publishButton(bed, MotoSleep::PROGRAM_COMMANDS[i]);
+// A bed's entities need the controller online and the bed's own breaker
+// closed; a group only follows the controller. Both topics use the default
+// online/offline payloads.
+void HADiscovery::writeAvailability(JsonWriter& json, const BedConfig& bed, bool group) {
+    if (group) {
+        json.field("avty_t", "motosleep/status");
+        json.field("pl_avail", "online");
+        json.field("pl_not_avail", "offline");
+        return;
     }
 
-    // Publish massage buttons
-    for (size_t i = 0; i < MotoSleep::MASSAGE_COMMAND_COUNT; i++) {
-        publishButton(bed, MotoSleep::MASSAGE_COMMANDS[i]);
-    }
+    json.beginArray("avty");
+    json.beginObject();
+    json.field("t", "motosleep/status");
+    json.endObject();
+    json.beginObject();
+    json.beginString("t");
+    json.append("motosleep/");
+    json.append(bed.id);
+    json.append("/available");
+    json.endString();
+    json.endObject();
+    json.endArray();
+    json.field("avty_mode", "all");
+}
 
-    // Publish light buttons
-    for (size_t i = 0; i < MotoSleep::LIGHT_COMMAND_COUNT; i++) {
-        publishButton(bed, MotoSleep::LIGHT_COMMANDS[i]);
+void HADiscovery::writeButton(JsonWriter& json, const BedConfig& bed, const MotoSleep::Command& cmd) {
+    json.beginString("uniq_id");
+    json.append(DEVICE_NAME);
+    json.append("_");
+    json.append(bed.id);
+    json.append("_");
+    json.append(cmd.name);
+    json.endString();
+
+    json.field("name", cmd.friendlyName);
+
+    // Format: motosleep/{bed_id}/{entity_id}/set
+    json.beginString("cmd_t");
+    json.append("motosleep/");
+    json.append(bed.id);
+    json.append("/");
+    json.append(cmd.name);
+    json.append("/set");
+    json.endString();
+
+    json.field("pl_prs", "PRESS");
+
+    if (cmd.icon) {
+        json.field("ic", cmd.icon);
     }
+}
 
-    Serial.printf("[HA] Discovery complete for bed: %s\n", bed.friendlyName);
+void HADiscovery::writeLatencySensor(JsonWriter& json, const BedConfig& bed, size_t stage) {
+    const char* stageName = latencyStageName(stage);
+
+    json.beginString("uniq_id");
+    json.append(DEVICE_NAME);
+    json.append("_");
+    json.append(bed.id);
+    json.append("_latency_");
+    json.append(stageName);
+    json.endString();
+
+    json.field("name", LATENCY_SENSOR_NAMES[stage]);
+
+    // Format: motosleep/{bed_id}/metrics; p95 is the state, the rest attributes
+    json.beginString("stat_t");
+    json.append("motosleep/");
+    json.append(bed.id);
+    json.append("/metrics");
+    json.endString();
+
+    json.beginString("val_tpl");
+    json.append("{{ value_json.");
+    json.append(stageName);
+    json.append(".p95 }}");
+    json.endString();
+
+    json.beginString("json_attr_t");
+    json.append("motosleep/");
+    json.append(bed.id);
+    json.append("/metrics");
+    json.endString();
+
+    json.beginString("json_attr_tpl");
+    json.append("{{ value_json.");
+    json.append(stageName);
+    json.append(" | tojson }}");
+    json.endString();
+
+    json.field("unit_of_meas", "\u00b5s");
+    json.field("stat_cla", "measurement");
+    json.field("ent_cat", "diagnostic");
+    json.field("ic", "mdi:timer-outline");
 }
 
-void HADiscovery::removeBedDiscovery(const BedConfig& bed) {
-    // Publish empty payload to remove entities
-    auto removeEntity = [this, &bed](const MotoSleep::Command& cmd) {
-        String topic = getDiscoveryTopic("button", bed, cmd.name);
-        _mqtt.publish(topic.c_str(), "", true);
-    };
+void HADiscovery::writeCover(JsonWriter& json, const BedConfig& bed, size_t actuator) {
+    const char* name = actuatorName(actuator);
+
+    json.beginString("uniq_id");
+    json.append(DEVICE_NAME);
+    json.append("_");
+    json.append(bed.id);
+    json.append("_");
+    json.append(name);
+    json.append("_position");
+    json.endString();
+
+    json.field("name", COVER_NAMES[actuator]);
+
+    // Format: motosleep/{bed_id}/{actuator}_position/set, for OPEN/CLOSE/STOP and 0-100
+    char commandTopic[64];
+    snprintf(commandTopic, sizeof(commandTopic), "motosleep/%s/%s_position/set", bed.id, name);
+    json.field("cmd_t", commandTopic);
+    json.field("set_pos_t", commandTopic);
+    json.field("pl_open", "OPEN");
+    json.field("pl_cls", "CLOSE");
+    json.field("pl_stop", "STOP");
+
+    // Format: motosleep/{bed_id}/position, shared by both actuators
+    char stateTopic[64];
+    snprintf(stateTopic, sizeof(stateTopic), "motosleep/%s/position", bed.id);
+    json.field("pos_t", stateTopic);
+    json.field("json_attr_t", stateTopic);
+
+    json.beginString("pos_tpl");
+    json.append("{{ value_json.");
+    json.append(name);
+    json.append(".pos }}");
+    json.endString();
+
+    json.beginString("json_attr_tpl");
+    json.append("{{ value_json.");
+    json.append(name);
+    json.append(" | tojson }}");
+    json.endString();
+
+    json.field("ic", "mdi:angle-acute");
+}
 
-    for (size_t i = 0; i < MotoSleep::MOTOR_COMMAND_COUNT; i++) {
-        removeEntity(MotoSleep::MOTOR_COMMANDS[i]);
-    }
-    for (size_t i = 0; i < MotoSleep::PRESET_COMMAND_COUNT; i++) {
-        removeEntity(MotoSleep::PRESET_COMMANDS[i]);
-    }
-    for (size_t i = 0; i < MotoSleep::PROGRAM_COMMAND_COUNT; i++) {
-        removeEntity(MotoSleep::PROGRAM_COMMANDS[i]);
+void HADiscovery::writeCalibrateButton(JsonWriter& json, const BedConfig& bed, size_t actuator) {
+    const char* name = actuatorName(actuator);
+
+    json.beginString("uniq_id");
+    json.append(DEVICE_NAME);
+    json.append("_");
+    json.append(bed.id);
+    json.append("_");
+    json.append(name);
+    json.append("_calibrate");
+    json.endString();
+
+    json.field("name", CALIBRATE_NAMES[actuator]);
+
+    // Format: motosleep/{bed_id}/{actuator}_calibrate/set; the cover's STOP ends the run
+    json.beginString("cmd_t");
+    json.append("motosleep/");
+    json.append(bed.id);
+    json.append("/");
+    json.append(name);
+    json.append("_calibrate/set");
+    json.endString();
+
+    json.field("pl_prs", "START");
+    json.field("ent_cat", "config");
+    json.field("ic", "mdi:timer-cog-outline");
+}
+
+void HADiscovery::publishButton(const BedConfig& bed, const MotoSleep::Command& cmd, bool group) {
+    char topic[128];
+    formatDiscoveryTopic(topic, sizeof(topic), "button", bed, cmd.name);
+
+    publishStreamed(topic, [this, &bed, &cmd, group](JsonWriter& json) {
+        json.beginObject();
+        writeButton(json, bed, cmd);
+        writeDeviceInfo(json, bed, group);
+        writeAvailability(json, bed, group);
+        json.endObject();
+    });
+}
+
+void HADiscovery::publishLatencySensor(const BedConfig& bed, size_t stage) {
+    char entityId[40];
+    char topic[128];
+    formatLatencyEntityId(entityId, sizeof(entityId), stage);
+    formatDiscoveryTopic(topic, sizeof(topic), "sensor", bed, entityId);
+
+    publishStreamed(topic, [this, &bed, stage](JsonWriter& json) {
+        json.beginObject();
+        writeLatencySensor(json, bed, stage);
+        writeDeviceInfo(json, bed, false);
+        writeAvailability(json, bed, false);
+        json.endObject();
+    });
+}
+
+void HADiscovery::publishCover(const BedConfig& bed, size_t actuator) {
+    char entityId[24];
+    char topic[128];
+    formatActuatorEntityId(entityId, sizeof(entityId), actuator, "position");
+    formatDiscoveryTopic(topic, sizeof(topic), "cover", bed, entityId);
+
+    publishStreamed(topic, [this, &bed, actuator](JsonWriter& json) {
+        json.beginObject();
+        writeCover(json, bed, actuator);
+        writeDeviceInfo(json, bed, false);
+        writeAvailability(json, bed, false);
+        json.endObject();
+    });
+
+    formatActuatorEntityId(entityId, sizeof(entityId), actuator, "calibrate");
+    formatDiscoveryTopic(topic, sizeof(topic), "button", bed, entityId);
+
+    publishStreamed(topic, [this, &bed, actuator](JsonWriter& json) {
+        json.beginObject();
+        writeCalibrateButton(json, bed, actuator);
+        writeDeviceInfo(json, bed, false);
+        writeAvailability(json, bed, false);
+        json.endObject();
+    });
+}
+
+void HADiscovery::publishBedDevice(const BedConfig& bed, bool group) {
+    char topic[128];
+    formatDeviceDiscoveryTopic(topic, sizeof(topic), bed);
+
+    publishStreamed(topic, [this, &bed, group](JsonWriter& json) {
+        json.beginObject();
+
+        // Device and availability are shared by every component
+        writeDeviceInfo(json, bed, group);
+        json.beginObject("o");
+        json.field("name", "motosleep-esp32");
+        json.field("sw", MOTOSLEEP_SW_VERSION);
+        json.endObject();
+        writeAvailability(json, bed, group);
+
+        json.beginObject("cmps");
+        forEachCommand([this, &json, &bed](const MotoSleep::Command& cmd) {
+            json.beginObject(cmd.name);
+            json.field("p", "button");
+            writeButton(json, bed, cmd);
+            json.endObject();
+        });
+        for (size_t actuator = 0; !group && actuator < ACTUATOR_COUNT; actuator++) {
+            char entityId[24];
+            formatActuatorEntityId(entityId, sizeof(entityId), actuator, "position");
+            json.beginObject(entityId);
+            json.field("p", "cover");
+            writeCover(json, bed, actuator);
+            json.endObject();
+
+            formatActuatorEntityId(entityId, sizeof(entityId), actuator, "calibrate");
+            json.beginObject(entityId);
+            json.field("p", "button");
+            writeCalibrateButton(json, bed, actuator);
+            json.endObject();
+        }
+        for (size_t stage = 0; !group && stage < LATENCY_STAGE_COUNT; stage++) {
+            char entityId[40];
+            formatLatencyEntityId(entityId, sizeof(entityId), stage);
+            json.beginObject(entityId);
+            json.field("p", "sensor");
+            writeLatencySensor(json, bed, stage);
+            json.endObject();
+        }
+        json.endObject();
+
+        json.endObject();
+    });
+}
+
+void HADiscovery::publishEntities(const BedConfig& bed, bool group) {
+#if HA_DISCOVERY_DEVICE_MODE
+    publishBedDevice(bed, group);
+#else
+    forEachCommand([this, &bed, group](const MotoSleep::Command& cmd) {
+        publishButton(bed, cmd, group);
+    });
+    for (size_t actuator = 0; !group && actuator < ACTUATOR_COUNT; actuator++) {
+        publishCover(bed, actuator);
     }
-    for (size_t i = 0; i < MotoSleep::MASSAGE_COMMAND_COUNT; i++) {
-        removeEntity(MotoSleep::MASSAGE_COMMANDS[i]);
+    for (size_t stage = 0; !group && stage < LATENCY_STAGE_COUNT; stage++) {
+        publishLatencySensor(bed, stage);
     }
-    for (size_t i = 0; i < MotoSleep::LIGHT_COMMAND_COUNT; i++) {
-        removeEntity(MotoSleep::LIGHT_COMMANDS[i]);
+#endif
+}
+
+void HADiscovery::publishBedDiscovery(const BedConfig& bed) {
+    publishEntities(bed, false);
+
+    if (!_hashSink) {
+        LOG_INFO(HA, "Published discovery for bed: %s", bed.friendlyName);
     }
 }
 
-void HADiscovery::publishControllerDiscovery() {
-    // Publish a sensor for the controller status
-    JsonDocument doc;
+void HADiscovery::publishGroupDiscovery(const BedGroupConfig& group) {
+    // A group is addressed like a bed, so it shares the bed topic and ID scheme
+    BedConfig asBed = {nullptr, group.friendlyName, group.id};
+    publishEntities(asBed, true);
 
-    String uniqueId = String(DEVICE_NAME) + "_status";
-    doc["unique_id"] = uniqueId;
-    doc["name"] = "Controller Status";
-    doc["state_topic"] = "motosleep/status";
-    doc["icon"] = "mdi:chip";
+    if (!_hashSink) {
+        LOG_INFO(HA, "Published discovery for group: %s", group.friendlyName);
+    }
+}
 
-    JsonObject device = doc["device"].to<JsonObject>();
-    addControllerDeviceInfo(device);
+void HADiscovery::removeBedDiscovery(const BedConfig& bed) {
+    char topic[128];
 
-    String payload;
-    serializeJson(doc, payload);
+    // The retained configs no longer match the stored hash
+    storeHash(0);
 
-    String topic = String(HA_DISCOVERY_PREFIX) + "/sensor/" + DEVICE_NAME + "_status/config";
-    _mqtt.publish(topic.c_str(), payload.c_str(), true);
+    // Clear the device-based config, then the per-entity configs, so a bed is
+    // removed whichever discovery mode published it
+    formatDeviceDiscoveryTopic(topic, sizeof(topic), bed);
+    _mqtt.publish(topic, "", true);
 
-    Serial.println("[HA] Published controller status sensor");
+    // Publish empty payload to remove entities
+    forEachCommand([this, &bed, &topic](const MotoSleep::Command& cmd) {
+        formatDiscoveryTopic(topic, sizeof(topic), "button", bed, cmd.name);
+        _mqtt.publish(topic, "", true);
+    });
+    for (size_t actuator = 0; actuator < ACTUATOR_COUNT; actuator++) {
+        char entityId[24];
+        formatActuatorEntityId(entityId, sizeof(entityId), actuator, "position");
+        formatDiscoveryTopic(topic, sizeof(topic), "cover", bed, entityId);
+        _mqtt.publish(topic, "", true);
+        formatActuatorEntityId(entityId, sizeof(entityId), actuator, "calibrate");
+        formatDiscoveryTopic(topic, sizeof(topic), "button", bed, entityId);
+        _mqtt.publish(topic, "", true);
+    }
+    for (size_t stage = 0; stage < LATENCY_STAGE_COUNT; stage++) {
+        char entityId[40];
+        formatLatencyEntityId(entityId, sizeof(entityId), stage);
+        formatDiscoveryTopic(topic, sizeof(topic), "sensor", bed, entityId);
+        _mqtt.publish(topic, "", true);
+    }
+}
+
+void HADiscovery::publishControllerDiscovery() {
+    // Publish a sensor for the controller status
+    char topic[128];
+    snprintf(topic, sizeof(topic), "%s/sensor/%s_status/config", HA_DISCOVERY_PREFIX, DEVICE_NAME);
+
+    publishStreamed(topic, [this](JsonWriter& json) {
+        json.beginObject();
+        json.beginString("uniq_id");
+        json.append(DEVICE_NAME);
+        json.append("_status");
+        json.endString();
+        json.field("name", "Controller Status");
+        json.field("stat_t", "motosleep/status");
+        json.field("ic", "mdi:chip");
+        writeControllerDeviceInfo(json);
+        json.endObject();
+    });
 }
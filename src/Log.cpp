@@ -0,0 +1,88 @@
+#include <Arduino.h>
+#include "Log.h"
+#include <stdarg.h>
+#include "MpscRing.h"
+#include "CommandQueue.h"
+
+static const uint32_t DRAIN_STACK_SIZE = 3072;
+static const UBaseType_t DRAIN_PRIORITY = 1;     // Below the BLE worker and loop()
+static const uint32_t DRAIN_IDLE_MS = 100;
+
+static MpscRing<LogRecord, LOG_RING_SIZE> logRing;
+static std::atomic<uint32_t> droppedCount{0};
+static TaskHandle_t drainHandle = nullptr;
+
+#if LOG_MQTT_MIRROR
+static SpscRing<LogRecord, 16> mirrorRing;
+#endif
+
+static void drainTask(void* param) {
+    uint32_t reportedDrops = 0;
+
+    for (;;) {
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(DRAIN_IDLE_MS));
+
+        while (logRing.consume([](const LogRecord& record) {
+            Serial.write(reinterpret_cast<const uint8_t*>(record.text), record.length);
+            Serial.write('\n');
+#if LOG_MQTT_MIRROR
+            mirrorRing.push(record);    // Best effort; the console copy is already out
+#endif
+        })) {
+        }
+
+        uint32_t drops = droppedCount.load(std::memory_order_relaxed);
+        if (drops != reportedDrops) {
+            Serial.printf("[Log] %lu records dropped\n", (unsigned long)(drops - reportedDrops));
+            reportedDrops = drops;
+        }
+    }
+}
+
+namespace Log {
+
+void begin() {
+    if (drainHandle) return;
+    xTaskCreate(drainTask, "log_drain", DRAIN_STACK_SIZE, nullptr, DRAIN_PRIORITY, &drainHandle);
+}
+
+void write(const char* tag, const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    bool queued = logRing.emplace([tag, format, &args](LogRecord& record) {
+        int prefix = snprintf(record.text, sizeof(record.text), "[%s] ", tag);
+        if (prefix < 0) prefix = 0;
+        if (prefix > static_cast<int>(sizeof(record.text)) - 1) prefix = sizeof(record.text) - 1;
+
+        int body = vsnprintf(record.text + prefix, sizeof(record.text) - prefix, format, args);
+        if (body < 0) body = 0;
+
+        size_t length = prefix + body;
+        if (length > sizeof(record.text) - 1) length = sizeof(record.text) - 1;
+        record.length = length;
+    });
+    va_end(args);
+
+    if (!queued) {
+        droppedCount.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    if (drainHandle) {
+        xTaskNotifyGive(drainHandle);
+    }
+}
+
+uint32_t dropped() {
+    return droppedCount.load(std::memory_order_relaxed);
+}
+
+bool popMirrored(LogRecord& record) {
+#if LOG_MQTT_MIRROR
+    return mirrorRing.pop(record);
+#else
+    (void)record;
+    return false;
+#endif
+}
+
+} // namespace Log
@@ -1,108 +1,71 @@
 #include "MotoSleepBed.h"
+#include <string.h>
+#include "Log.h"
 
-static const char* TAG = "MotoSleepBed";
-
-MotoSleepBed::MotoSleepBed(const BedConfig& config) : _config(config) {
+MotoSleepBed::MotoSleepBed(const BedConfig& config, BedLink& link)
+    : _config(config), _link(link) {
 }
 
 MotoSleepBed::~MotoSleepBed() {
-    cleanup();
-    if (_address) {
-        delete _address;
-        _address = nullptr;
-    }
+    disconnect();
 }
 
-void MotoSleepBed::setAddress(BLEAddress* address) {
-    if (_address) {
-        delete _address;
-    }
-    _address = new BLEAddress(*address);
+void MotoSleepBed::setAddress(const uint8_t address[6]) {
+    memcpy(_address, address, sizeof(_address));
+    _hasAddress = true;
 }
 
 bool MotoSleepBed::connect() {
-    if (_state == State::CONNECTED && _client && _client->isConnected()) {
+    if (isConnected()) {
         return true;
     }
 
-    if (!_address) {
-        Serial.printf("[%s] No BLE address set, cannot connect\n", _config.friendlyName);
+    if (!_hasAddress) {
+        LOG_ERROR_TAG(BED, _config.friendlyName, "No BLE address set, cannot connect");
         return false;
     }
 
     _state = State::CONNECTING;
-    _lastConnectAttempt = millis();
 
-    Serial.printf("[%s] Connecting to %s...\n", _config.friendlyName, _address->toString().c_str());
+    LOG_INFO_TAG(BED, _config.friendlyName, "Connecting to %02x:%02x:%02x:%02x:%02x:%02x...",
+        _address[0], _address[1], _address[2], _address[3], _address[4], _address[5]);
 
-    if (!connectToServer()) {
+    _connectStartUs = _link.nowUs();
+    if (!_link.connect(_address)) {
         _state = State::ERROR;
         return false;
     }
 
     _state = State::CONNECTED;
-    Serial.printf("[%s] Connected!\n", _config.friendlyName);
-    return true;
-}
-
-bool MotoSleepBed::connectToServer() {
-    cleanup();
-
-    _client = BLEDevice::createClient();
-    _client->setClientCallbacks(new BedClientCallback(this));
-
-    // Connect to the BLE server
-    if (!_client->connect(*_address)) {
-        Serial.printf("[%s] Failed to connect to BLE server\n", _config.friendlyName);
-        cleanup();
-        return false;
-    }
-
-    // Get the service
-    BLERemoteService* service = _client->getService(BLEUUID(MOTOSLEEP_SERVICE_UUID));
-    if (!service) {
-        Serial.printf("[%s] Failed to find service UUID: %s\n", _config.friendlyName, MOTOSLEEP_SERVICE_UUID);
-        cleanup();
-        return false;
-    }
-
-    // Get the characteristic
-    _characteristic = service->getCharacteristic(BLEUUID(MOTOSLEEP_CHARACTERISTIC_UUID));
-    if (!_characteristic) {
-        Serial.printf("[%s] Failed to find characteristic UUID: %s\n", _config.friendlyName, MOTOSLEEP_CHARACTERISTIC_UUID);
-        cleanup();
-        return false;
-    }
-
-    // Check if we can write to it
-    if (!_characteristic->canWrite()) {
-        Serial.printf("[%s] Characteristic is not writable\n", _config.friendlyName);
-        cleanup();
-        return false;
+    BedLink::ConnectTiming timing = _link.lastConnectTiming();
+    _firstWritePending = true;
+    _connectedByHandle = timing.cachedHandle;
+    if (_latencies) {
+        _latencies->record(LatencyStage::CONNECT, timing.linkUs);
+        if (!timing.cachedHandle) {
+            _latencies->record(LatencyStage::DISCOVERY, timing.discoveryUs);
+        }
     }
-
+    LOG_INFO_TAG(BED, _config.friendlyName, "Connected!");
     return true;
 }
 
 void MotoSleepBed::disconnect() {
-    if (_client && _client->isConnected()) {
-        Serial.printf("[%s] Disconnecting...\n", _config.friendlyName);
-        _client->disconnect();
+    if (!_link.isConnected()) {
+        _link.disconnect();
+        _state = State::DISCONNECTED;
+        return;
     }
-    cleanup();
-    _state = State::DISCONNECTED;
-}
 
-void MotoSleepBed::cleanup() {
-    _characteristic = nullptr;
-    if (_client) {
-        delete _client;
-        _client = nullptr;
-    }
+    LOG_INFO_TAG(BED, _config.friendlyName, "Disconnecting...");
+    int64_t start = _link.nowUs();
+    _link.disconnect();
+    _state = State::DISCONNECTED;
+    recordLatency(LatencyStage::DISCONNECT, start);
 }
 
 bool MotoSleepBed::isConnected() const {
-    return _state == State::CONNECTED && _client && _client->isConnected();
+    return _state == State::CONNECTED && _link.isConnected();
 }
 
 bool MotoSleepBed::sendCommand(char cmdChar) {
@@ -112,38 +75,31 @@ bool MotoSleepBed::sendCommand(char cmdChar) {
 }
 
 bool MotoSleepBed::sendCommand(const uint8_t* data, size_t len) {
-    // Connect if not already connected
+    // Connecting is the caller's job (the connection pool), so a write never
+    // opens a link past the pool's limit or an open circuit breaker
     if (!isConnected()) {
-        if (!connect()) {
-            Serial.printf("[%s] Cannot send command - connection failed\n", _config.friendlyName);
-            return false;
-        }
-    }
-
-    if (!_characteristic) {
-        Serial.printf("[%s] No characteristic available\n", _config.friendlyName);
+        LOG_ERROR_TAG(BED, _config.friendlyName, "Cannot send command - not connected");
         return false;
     }
 
-    Serial.printf("[%s] Sending command: 0x%02X 0x%02X\n", _config.friendlyName, data[0], data[1]);
-
-    // Write the command
-    _characteristic->writeValue((uint8_t*)data, len, false);
-
-    // If not staying connected, disconnect after sending
-    #if !BLE_STAY_CONNECTED
-    delay(100);  // Give the command time to be sent
-    disconnect();
-    #endif
-
-    return true;
-}
-
-// BLE Client Callbacks
-void BedClientCallback::onConnect(BLEClient* client) {
-    Serial.printf("[BLE] Client connected\n");
+    LOG_DEBUG_TAG(BED, _config.friendlyName, "Sending command: 0x%02X 0x%02X", data[0], data[1]);
+
+    // Write the command; the connection pool decides when to disconnect
+    int64_t start = _link.nowUs();
+    bool written = _link.write(data, len);
+    if (written) {
+        recordLatency(LatencyStage::WRITE, start);
+        if (_firstWritePending) {
+            _firstWritePending = false;
+            recordLatency(_connectedByHandle ? LatencyStage::FIRST_WRITE_CACHED
+                                             : LatencyStage::FIRST_WRITE_DISCOVERED, _connectStartUs);
+        }
+    }
+    return written;
 }
 
-void BedClientCallback::onDisconnect(BLEClient* client) {
-    Serial.printf("[BLE] Client disconnected\n");
+void MotoSleepBed::recordLatency(LatencyStage stage, int64_t startUs) {
+    if (_latencies) {
+        _latencies->record(stage, static_cast<uint32_t>(_link.nowUs() - startUs));
+    }
 }
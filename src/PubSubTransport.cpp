@@ -0,0 +1,23 @@
+#include <Arduino.h>
+#include "ConfigDefaults.h"
+
+#if !MQTT_ASYNC
+
+#include "PubSubTransport.h"
+
+PubSubTransport::PubSubTransport(uint16_t bufferSize)
+    : _mqtt(_wifiClient), _bufferSize(bufferSize) {
+}
+
+void PubSubTransport::begin(const char* host, uint16_t port, MessageCallback callback) {
+    _mqtt.setServer(host, port);
+    _mqtt.setCallback(callback);
+    _mqtt.setBufferSize(_bufferSize);
+}
+
+bool PubSubTransport::connect(const char* clientId, const char* user, const char* password,
+                              const char* willTopic, const char* willPayload) {
+    return _mqtt.connect(clientId, user, password, willTopic, 0, true, willPayload);
+}
+
+#endif // !MQTT_ASYNC
@@ -2,199 +2,352 @@
 #include <WiFi.h>
 #include <esp_wifi.h>
 #include <esp_mac.h>
-#include <PubSubClient.h>
+#include <esp_timer.h>
+#include <esp_heap_caps.h>
 #include <BLEDevice.h>
 #include <BLEScan.h>
 #include <BLEAdvertisedDevice.h>
 
-#include "config.h"
+#include "ConfigDefaults.h"
 #include "MotoSleepCommands.h"
+#include "CommandTable.h"
+#include "TopicRouter.h"
 #include "MotoSleepBed.h"
+#include "Esp32BleLink.h"
 #include "HADiscovery.h"
+#include "CommandQueue.h"
+#include "BedWorker.h"
+#include "BedStore.h"
+#include "LatencyHistogram.h"
+#include "Log.h"
+#include "WiFiReconnect.h"
+#include "PositionModel.h"
+#include "BedRegistry.h"
+#include "StaticPool.h"
+#include "HeapStats.h"
+#include "TaskLoad.h"
+#include "ScanScheduler.h"
+#include "CircuitBreaker.h"
+#if MQTT_ASYNC
+#include "AsyncMqttTransport.h"
+#else
+#include "PubSubTransport.h"
+#endif
 
 // =============================================================================
 // Global Objects
 // =============================================================================
-WiFiClient wifiClient;
-PubSubClient mqtt(wifiClient);
+// Broker connection; MQTT_ASYNC picks the backend. Discovery and stats are
+// streamed, so the buffer only has to hold incoming command messages.
+#if MQTT_ASYNC
+AsyncMqttTransport mqttTransport(MQTT_BUFFER_SIZE, MQTT_PUBLISH_BUFFER_SIZE);
+#else
+PubSubTransport mqttTransport(MQTT_BUFFER_SIZE);
+#endif
+MqttTransport& mqtt = mqttTransport;
 HADiscovery* haDiscovery = nullptr;
 BLEScan* bleScan = nullptr;
 
-// Array of bed objects
-MotoSleepBed* beds[BED_COUNT];
-bool bedsDiscovered[BED_COUNT] = {false};
+// Registered beds, and the bed objects and BLE links serving them, built in
+// place in static pools (nullptr for an empty slot). Slots only change in
+// loop(), while it holds registryLock; the BLE worker holds the lock
+// whenever it is awake.
+BedRegistry<MAX_BEDS> bedRegistry;
+StaticPool<Esp32BleLink, MAX_BEDS> linkPool;
+StaticPool<MotoSleepBed, MAX_BEDS> bedPool;
+BedLink* bleLinks[MAX_BEDS] = {};
+MotoSleepBed* beds[MAX_BEDS] = {};
+SemaphoreHandle_t registryLock = nullptr;
+static_assert(BED_COUNT <= MAX_BEDS, "BEDS[] has more beds than MAX_BEDS");
+
+// Bed config messages waiting for registryLock, applied in order by loop()
+struct BedChange {
+    BedEntry entry;
+    bool remove;
+};
+BedChange bedChanges[8];
+size_t bedChangeCount = 0;
+
+// Beds removed while MQTT was down; their retained topics are cleared on reconnect
+BedEntry pendingRemovals[MAX_BEDS];
+size_t pendingRemovalCount = 0;
+
+// Registered beds packed for a discovery pass, rebuilt when a pass starts
+BedConfig discoveryBeds[MAX_BEDS];
+
+bool bedsDiscovered[MAX_BEDS] = {false};
+bool addressFromCache[MAX_BEDS] = {false};  // Loaded from NVS, not yet confirmed by a connect
+uint8_t connectFailures[MAX_BEDS] = {0};    // In a row; enough of them and the bed is searched for again
+
+// Published unavailable while a bed's breaker is open (see BedWorker)
+int8_t publishedAvailable[MAX_BEDS];        // loop(); -1 = not published since the last MQTT connect
+
+// Advertisements seen by the scan callback: name hashes to match against,
+// then each bed's latest signal strength and when it was heard (0 = never)
+std::atomic<uint32_t> bleNameHashes[MAX_BEDS];
+std::atomic<int8_t> bedRssi[MAX_BEDS];
+std::atomic<uint32_t> bedLastSeenMs[MAX_BEDS];
+
+// Advertisements whose name hash matched a bed, pushed by the scan callback
+// on the BLE stack's task and matched to beds by the worker
+struct ScanResult {
+    uint32_t nameHash;
+    uint8_t address[6];
+    int8_t rssi;
+    uint32_t seenMs;
+};
+
+SpscRing<ScanResult, SCAN_RESULT_RING_SIZE> scanResults;
+std::atomic<uint32_t> scanResultsDropped{0};
+TaskHandle_t bleWorkerHandle = nullptr;
+
+// Link state changes, pushed by the BLE worker and drained by loop(), which
+// publishes them. Each side keeps its own copy: the worker's is what it last
+// reported, loop()'s is what it last heard.
+enum class BedEventType : uint8_t {
+    LINK_UP,
+    LINK_DOWN
+};
+
+struct BedEvent {
+    uint8_t bed;
+    BedEventType type;
+};
+
+SpscRing<BedEvent, BED_EVENT_RING_SIZE> bedEvents;
+std::atomic<uint32_t> bedEventsDropped{0};
+std::atomic<uint32_t> bedEventsHighWater{0};
+bool reportedLinkUp[MAX_BEDS] = {};         // BLE worker
+bool bedLinkUp[MAX_BEDS] = {};              // loop()
+int8_t publishedLinkUp[MAX_BEDS];           // loop(); -1 = not published since the last MQTT connect
+
+// Busy time of the BLE worker (core BLE_WORKER_CORE) and loop() (the network side)
+TaskLoad bleWorkerLoad;
+TaskLoad networkLoad;
+
+// Position estimates as last published, so only changes go out
+uint32_t publishedPositionStates[MAX_BEDS][ACTUATOR_COUNT];
 
 // Timing
 unsigned long lastMqttReconnect = 0;
-unsigned long lastBleScan = 0;
+bool mqttConnectNow = false;       // Skip the reconnect interval once WiFi comes up
+bool mqttWasConnected = false;
+bool mqttWasConnecting = false;
+unsigned long lastStatsPublish = 0;
+unsigned long lastMetricsPublish = 0;
+unsigned long lastLogMirror = 0;
+unsigned long lastPositionPublish = 0;
+volatile bool discoveryRequested = false;
 bool allBedsFound = false;
+volatile bool bleScanning = false;
+volatile bool scanCutShort = false;     // The running scan was stopped before its full duration
+ScanScheduler scanScheduler;            // BLE worker; loop() only while it holds registryLock
 
-// =============================================================================
-// BLE Scan Callback
-// =============================================================================
-class ScanCallback : public BLEAdvertisedDeviceCallbacks {
-    void onResult(BLEAdvertisedDevice advertisedDevice) override {
-        String name = advertisedDevice.getName().c_str();
+// WiFi link state: wifiUp follows GOT_IP/DISCONNECTED events, wifiReconnect
+// decides when to retry. Both are serviced from loop().
+volatile bool wifiUp = false;
+WiFiReconnect wifiReconnect;
+WiFiReconnect::State lastWiFiState = WiFiReconnect::State::CONNECTING;
 
-        if (name.length() == 0) return;
+// loop() iteration times, excluding its idle delay
+LatencyHistogram loopTimes;
+uint32_t loopStalls = 0;
 
-        // Check if this device matches any of our configured beds
-        for (size_t i = 0; i < BED_COUNT; i++) {
-            if (!bedsDiscovered[i] && name.equals(BEDS[i].bleName)) {
-                Serial.printf("[BLE] Found bed: %s at %s\n",
-                    BEDS[i].friendlyName,
-                    advertisedDevice.getAddress().toString().c_str());
-
-                beds[i]->setAddress(new BLEAddress(advertisedDevice.getAddress()));
-                bedsDiscovered[i] = true;
-
-                // Check if all beds are found
-                allBedsFound = true;
-                for (size_t j = 0; j < BED_COUNT; j++) {
-                    if (!bedsDiscovered[j]) {
-                        allBedsFound = false;
-                        break;
-                    }
-                }
-
-                if (allBedsFound) {
-                    Serial.println("[BLE] All beds found, stopping scan");
-                    bleScan->stop();
-                }
-                break;
-            }
-        }
-    }
-};
+// Boot-to-ready timing (ms since reset, 0 = not yet)
+unsigned long bedsReadyMs = 0;
+size_t cachedAddressCount = 0;
+
+void stopBleScan();
+void queueBedChange(const char* id, const byte* payload, unsigned int length);
+void flushBedRemovals();
+void startDiscoveryPass(bool force);
 
 // =============================================================================
-// MQTT Callback
+// BLE Worker Platform
+// What BedWorker needs from FreeRTOS and the BLE stack. Everything here runs
+// on the BLE worker, except notify(), which the MQTT callback calls.
 // =============================================================================
-void mqttCallback(char* topic, byte* payload, unsigned int length) {
-    // Null-terminate payload
-    char message[length + 1];
-    memcpy(message, payload, length);
-    message[length] = '\0';
-
-    Serial.printf("[MQTT] Received: %s = %s\n", topic, message);
+class Esp32WorkerPlatform : public WorkerPlatform {
+public:
+    void notify() override { xTaskNotifyGive(bleWorkerHandle); }
 
-    // Parse topic: motosleep/{bed_id}/{command}/set
-    String topicStr = String(topic);
+    bool scanning() const override { return bleScanning; }
+    void stopScan() override { stopBleScan(); }
 
-    if (!topicStr.startsWith("motosleep/")) return;
-
-    // Extract bed_id and command
-    int firstSlash = topicStr.indexOf('/', 10);  // After "motosleep/"
-    int secondSlash = topicStr.indexOf('/', firstSlash + 1);
-
-    if (firstSlash == -1 || secondSlash == -1) return;
-
-    String bedId = topicStr.substring(10, firstSlash);
-    String command = topicStr.substring(firstSlash + 1, secondSlash);
+    uint32_t lastSeenMs(size_t i) const override {
+        return bedLastSeenMs[i].load(std::memory_order_relaxed);
+    }
 
-    // Find the bed
-    MotoSleepBed* targetBed = nullptr;
-    for (size_t i = 0; i < BED_COUNT; i++) {
-        if (bedId.equals(beds[i]->getId())) {
-            targetBed = beds[i];
-            break;
+    // A cached address that fails, or a known one that fails
+    // BLE_RESCAN_AFTER_FAILURES times in a row, sends the scanner looking for
+    // the bed again; commands keep trying the old address until it turns up
+    void connectFailed(size_t i) override {
+        if (connectFailures[i] < UINT8_MAX) connectFailures[i]++;
+        if (bedsDiscovered[i] && (addressFromCache[i] || connectFailures[i] >= BLE_RESCAN_AFTER_FAILURES)) {
+            LOG_WARN(BLE, "%s address for %s failed, rescanning",
+                addressFromCache[i] ? "Cached" : "Known", beds[i]->getFriendlyName());
+            addressFromCache[i] = false;
+            bedsDiscovered[i] = false;
+            allBedsFound = false;
+            scanScheduler.searchNow();
         }
     }
 
-    if (!targetBed) {
-        Serial.printf("[MQTT] Unknown bed ID: %s\n", bedId.c_str());
-        return;
+    void connected(size_t i) override {
+        addressFromCache[i] = false;
+        connectFailures[i] = 0;
     }
 
-    if (!targetBed->hasAddress()) {
-        Serial.printf("[MQTT] Bed %s not discovered yet\n", bedId.c_str());
-        return;
+    size_t allocatedBlocks() const override {
+        multi_heap_info_t info;
+        heap_caps_get_info(&info, MALLOC_CAP_8BIT);
+        return info.total_allocated_blocks;
     }
 
-    // Find the command
-    char cmdChar = 0;
+    int64_t nowUs() const override { return esp_timer_get_time(); }
+};
+
+Esp32WorkerPlatform workerPlatform;
 
-    // Check motor commands
-    for (size_t i = 0; i < MotoSleep::MOTOR_COMMAND_COUNT; i++) {
-        if (command.equals(MotoSleep::MOTOR_COMMANDS[i].name)) {
-            cmdChar = MotoSleep::MOTOR_COMMANDS[i].cmdChar;
-            break;
+// Queues, connections, holds, macros and position estimates for every bed
+BedWorker bedWorker(beds, bleLinks, workerPlatform);
+
+// =============================================================================
+// BLE Scan Callback
+// =============================================================================
+void updateAllBedsFound() {
+    allBedsFound = true;
+    for (size_t i = 0; i < MAX_BEDS; i++) {
+        if (beds[i] && !bedsDiscovered[i]) {
+            allBedsFound = false;
+            return;
         }
     }
 
-    // Check preset commands
-    if (!cmdChar) {
-        for (size_t i = 0; i < MotoSleep::PRESET_COMMAND_COUNT; i++) {
-            if (command.equals(MotoSleep::PRESET_COMMANDS[i].name)) {
-                cmdChar = MotoSleep::PRESET_COMMANDS[i].cmdChar;
-                break;
-            }
-        }
+    if (!bedsReadyMs) {
+        bedsReadyMs = millis();
     }
+}
 
-    // Check program commands
-    if (!cmdChar) {
-        for (size_t i = 0; i < MotoSleep::PROGRAM_COMMAND_COUNT; i++) {
-            if (command.equals(MotoSleep::PROGRAM_COMMANDS[i].name)) {
-                cmdChar = MotoSleep::PROGRAM_COMMANDS[i].cmdChar;
-                break;
-            }
+class ScanCallback : public BLEAdvertisedDeviceCallbacks {
+    void onResult(BLEAdvertisedDevice advertisedDevice) override {
+        if (!advertisedDevice.haveName()) return;
+
+        // Bed names fit std::string's inline buffer, so this copy doesn't
+        // allocate; most advertisements stop at the hash compare
+        std::string name = advertisedDevice.getName();
+        uint32_t hash = bleNameHash(name.data(), name.size());
+
+        bool bed = false;
+        for (size_t i = 0; i < MAX_BEDS; i++) {
+            if (bleNameHashes[i].load(std::memory_order_relaxed) == hash) bed = true;
+        }
+        if (!bed) return;
+
+        // Runs on the BLE stack's task, which must not wait for registryLock
+        // or flash: the worker matches the result and saves the address. A
+        // result that finds the ring full is dropped; the bed advertises again.
+        ScanResult result;
+        result.nameHash = hash;
+        memcpy(result.address, *advertisedDevice.getAddress().getNative(), 6);
+        result.rssi = static_cast<int8_t>(advertisedDevice.getRSSI());
+        uint32_t now = millis();
+        result.seenMs = now ? now : 1;
+        if (!scanResults.push(result)) {
+            scanResultsDropped.fetch_add(1, std::memory_order_relaxed);
+            return;
         }
+        if (bleWorkerHandle) xTaskNotifyGive(bleWorkerHandle);
     }
+};
 
-    // Check massage commands
-    if (!cmdChar) {
-        for (size_t i = 0; i < MotoSleep::MASSAGE_COMMAND_COUNT; i++) {
-            if (command.equals(MotoSleep::MASSAGE_COMMANDS[i].name)) {
-                cmdChar = MotoSleep::MASSAGE_COMMANDS[i].cmdChar;
-                break;
+// Match the advertisements the scan callback queued to beds: refresh signal
+// strength, and take up the address of a bed that was missing or moved.
+// BLE worker, with registryLock held.
+void applyScanResults() {
+    ScanResult result;
+    while (scanResults.pop(result)) {
+        for (size_t i = 0; i < MAX_BEDS; i++) {
+            if (!beds[i] || bleNameHashes[i].load(std::memory_order_relaxed) != result.nameHash) continue;
+
+            bedRssi[i].store(result.rssi, std::memory_order_relaxed);
+            bedLastSeenMs[i].store(result.seenMs, std::memory_order_relaxed);
+
+            // A known bed advertising from its known address needs nothing more
+            const uint8_t* native = result.address;
+            bool moved = beds[i]->hasAddress() && memcmp(beds[i]->getAddress(), native, 6) != 0;
+            if (bedsDiscovered[i] && !moved) break;
+
+            LOG_INFO(BLE, "%s bed %s at %02x:%02x:%02x:%02x:%02x:%02x", moved ? "Moved:" : "Found",
+                bedRegistry.config(i).friendlyName, native[0], native[1], native[2], native[3], native[4], native[5]);
+            beds[i]->setAddress(native);
+            BedStore::saveAddress(bedRegistry.config(i).bleName, native);
+            addressFromCache[i] = false;
+            bedsDiscovered[i] = true;
+            connectFailures[i] = 0;
+
+            updateAllBedsFound();
+            if (allBedsFound && scanScheduler.running() == ScanMode::SEARCH) {
+                LOG_INFO(BLE, "All beds found, stopping scan");
+                stopBleScan();
             }
+            break;
         }
     }
+}
 
-    // Check light commands
-    if (!cmdChar) {
-        for (size_t i = 0; i < MotoSleep::LIGHT_COMMAND_COUNT; i++) {
-            if (command.equals(MotoSleep::LIGHT_COMMANDS[i].name)) {
-                cmdChar = MotoSleep::LIGHT_COMMANDS[i].cmdChar;
-                break;
-            }
+// =============================================================================
+// MQTT Callback
+// =============================================================================
+static bool payloadEquals(const byte* payload, unsigned int length, const char* value) {
+    return strlen(value) == length && memcmp(payload, value, length) == 0;
+}
+
+void mqttCallback(char* topic, byte* payload, unsigned int length) {
+    // Home Assistant birth message: it may have lost our configs, so resend them
+    if (strcmp(topic, HA_STATUS_TOPIC) == 0) {
+        if (payloadEquals(payload, length, "online")) {
+            discoveryRequested = true;
         }
+        return;
     }
 
-    if (!cmdChar) {
-        Serial.printf("[MQTT] Unknown command: %s\n", command.c_str());
+    // Bed registry changes wait for the BLE worker to sleep
+    static constexpr size_t CONFIG_PREFIX_LENGTH = sizeof(MOTOSLEEP_BED_CONFIG_PREFIX) - 1;
+    if (strncmp(topic, MOTOSLEEP_BED_CONFIG_PREFIX, CONFIG_PREFIX_LENGTH) == 0) {
+        queueBedChange(topic + CONFIG_PREFIX_LENGTH, payload, length);
         return;
     }
 
-    // Send the command
-    Serial.printf("[MQTT] Sending command '%c' to bed %s\n", cmdChar, targetBed->getFriendlyName());
-    targetBed->sendCommand(cmdChar);
+    // Everything else is a bed or group command for the BLE worker
+    bedWorker.onCommand(topic, payload, length);
 }
 
 // =============================================================================
 // WiFi Event Handler
 // =============================================================================
 void onWiFiEvent(WiFiEvent_t event, WiFiEventInfo_t info) {
-    Serial.printf("[WiFi Event] ");
     switch(event) {
         case ARDUINO_EVENT_WIFI_STA_START:
-            Serial.println("STA Started");
+            LOG_INFO_TAG(WIFI, "WiFi Event", "STA Started");
             break;
         case ARDUINO_EVENT_WIFI_STA_CONNECTED:
-            Serial.println("Connected to AP");
+            LOG_INFO_TAG(WIFI, "WiFi Event", "Connected to AP");
             break;
         case ARDUINO_EVENT_WIFI_STA_DISCONNECTED:
-            Serial.printf("Disconnected. Reason: %d\n", info.wifi_sta_disconnected.reason);
+            wifiUp = false;
+            LOG_WARN_TAG(WIFI, "WiFi Event", "Disconnected. Reason: %d", info.wifi_sta_disconnected.reason);
             break;
         case ARDUINO_EVENT_WIFI_STA_GOT_IP:
-            Serial.printf("Got IP: %s\n", IPAddress(info.got_ip.ip_info.ip.addr).toString().c_str());
+            wifiUp = true;
+            LOG_INFO_TAG(WIFI, "WiFi Event", "Got IP: %s", IPAddress(info.got_ip.ip_info.ip.addr).toString().c_str());
             break;
         case ARDUINO_EVENT_WIFI_STA_LOST_IP:
-            Serial.println("Lost IP");
+            wifiUp = false;
+            LOG_WARN_TAG(WIFI, "WiFi Event", "Lost IP");
             break;
         default:
-            Serial.printf("Event: %d\n", event);
+            LOG_DEBUG_TAG(WIFI, "WiFi Event", "Event: %d", event);
             break;
     }
 }
@@ -202,16 +355,16 @@ void onWiFiEvent(WiFiEvent_t event, WiFiEventInfo_t info) {
 // =============================================================================
 // WiFi Setup
 // =============================================================================
-void printWiFiStatus(wl_status_t status) {
+const char* wifiStatusName(wl_status_t status) {
     switch(status) {
-        case WL_IDLE_STATUS: Serial.print("IDLE"); break;
-        case WL_NO_SSID_AVAIL: Serial.print("NO_SSID_AVAIL"); break;
-        case WL_SCAN_COMPLETED: Serial.print("SCAN_COMPLETED"); break;
-        case WL_CONNECTED: Serial.print("CONNECTED"); break;
-        case WL_CONNECT_FAILED: Serial.print("CONNECT_FAILED"); break;
-        case WL_CONNECTION_LOST: Serial.print("CONNECTION_LOST"); break;
-        case WL_DISCONNECTED: Serial.print("DISCONNECTED"); break;
-        default: Serial.printf("UNKNOWN(%d)", status); break;
+        case WL_IDLE_STATUS: return "IDLE";
+        case WL_NO_SSID_AVAIL: return "NO_SSID_AVAIL";
+        case WL_SCAN_COMPLETED: return "SCAN_COMPLETED";
+        case WL_CONNECTED: return "CONNECTED";
+        case WL_CONNECT_FAILED: return "CONNECT_FAILED";
+        case WL_CONNECTION_LOST: return "CONNECTION_LOST";
+        case WL_DISCONNECTED: return "DISCONNECTED";
+        default: return "UNKNOWN";
     }
 }
 
@@ -222,19 +375,20 @@ void printWiFiStatus(wl_status_t status) {
 #define STATIC_SUBNET  255, 255, 255, 0
 #define STATIC_DNS     8, 8, 8, 8         // Google DNS
 
+// Start the first connection attempt and return; serviceWiFi() takes it from there
 void setupWiFi() {
-    Serial.printf("[WiFi] Connecting to: %s\n", WIFI_SSID);
-    Serial.printf("[WiFi] Password length: %d\n", strlen(WIFI_PASSWORD));
+    LOG_INFO(WIFI, "Connecting to: %s", WIFI_SSID);
 
     // Register event handler first
     WiFi.onEvent(onWiFiEvent);
 
-    // Initialize WiFi
+    // Initialize WiFi; retries are driven by wifiReconnect, not the driver
     WiFi.mode(WIFI_STA);
+    WiFi.setAutoReconnect(false);
     delay(100);
 
     // Now read MAC (after WiFi is initialized)
-    Serial.printf("[WiFi] ESP32 MAC: %s\n", WiFi.macAddress().c_str());
+    LOG_INFO(WIFI, "ESP32 MAC: %s", WiFi.macAddress().c_str());
 
     #if USE_STATIC_IP
     IPAddress staticIP(STATIC_IP);
@@ -242,126 +396,743 @@ void setupWiFi() {
     IPAddress subnet(STATIC_SUBNET);
     IPAddress dns(STATIC_DNS);
 
-    Serial.printf("[WiFi] Using static IP: %s\n", staticIP.toString().c_str());
+    LOG_INFO(WIFI, "Using static IP: %s", staticIP.toString().c_str());
     if (!WiFi.config(staticIP, gateway, subnet, dns)) {
-        Serial.println("[WiFi] Static IP config failed!");
+        LOG_ERROR(WIFI, "Static IP config failed!");
     }
     #else
-    Serial.println("[WiFi] Using DHCP");
+    LOG_INFO(WIFI, "Using DHCP");
     #endif
 
     // Disable power saving
     esp_wifi_set_ps(WIFI_PS_NONE);
 
-    for (int retry = 1; retry <= 3; retry++) {
-        Serial.printf("\n[WiFi] Attempt %d of 3\n", retry);
-
-        WiFi.begin(WIFI_SSID, WIFI_PASSWORD);
+    wifiReconnect.setTiming(WIFI_CONNECT_TIMEOUT, WIFI_BACKOFF_MIN, WIFI_BACKOFF_MAX, WIFI_RESTART_AFTER);
+    WiFi.begin(WIFI_SSID, WIFI_PASSWORD);
+    wifiReconnect.begin(millis());
+}
 
-        // Wait up to 20 seconds for connection (DHCP can be slow)
-        unsigned long startTime = millis();
-        while (WiFi.status() != WL_CONNECTED && (millis() - startTime) < 20000) {
-            delay(500);
-            Serial.print(".");
+// Advance the WiFi state machine; called every loop() and never blocks
+void serviceWiFi() {
+    unsigned long now = millis();
+    bool wasConnected = wifiReconnect.connected();
 
-            // Check if we got an IP even if status doesn't update
-            if (WiFi.localIP() != IPAddress(0, 0, 0, 0)) {
-                Serial.println("\n[WiFi] Got IP!");
-                break;
-            }
-        }
-        Serial.println();
-
-        if (WiFi.status() == WL_CONNECTED || WiFi.localIP() != IPAddress(0, 0, 0, 0)) {
-            Serial.println("[WiFi] SUCCESS!");
-            Serial.printf("[WiFi] IP: %s\n", WiFi.localIP().toString().c_str());
-            Serial.printf("[WiFi] Gateway: %s\n", WiFi.gatewayIP().toString().c_str());
-            Serial.printf("[WiFi] RSSI: %d dBm\n", WiFi.RSSI());
-            Serial.printf("[WiFi] MAC: %s\n", WiFi.macAddress().c_str());
-            return;
-        }
+    switch (wifiReconnect.poll(now, wifiUp)) {
+        case WiFiAction::CONNECT:
+            LOG_INFO(WIFI, "Reconnecting (attempt %" PRIu32 ")", wifiReconnect.getStats().attempts);
+            WiFi.reconnect();
+            break;
 
-        Serial.printf("[WiFi] Failed. Status: ");
-        printWiFiStatus(WiFi.status());
-        Serial.printf(" | IP: %s\n", WiFi.localIP().toString().c_str());
+        case WiFiAction::RESTART:
+            // Restarting drops a running hold mid-movement; wait until it ends
+            if (bedWorker.anyHoldActive()) break;
+            LOG_ERROR(WIFI, "No connection for %" PRIu32 " ms, restarting", wifiReconnect.currentOutageMs(now));
+            delay(1000);    // Let the log drain
+            ESP.restart();
+            break;
 
-        WiFi.disconnect(true);
-        delay(3000);
+        case WiFiAction::NONE:
+            break;
     }
 
-    Serial.println("[WiFi] All attempts failed. Restarting...");
-    delay(5000);
-    ESP.restart();
+    if (!wasConnected && wifiReconnect.connected()) {
+        mqttConnectNow = true;
+        LOG_INFO(WIFI, "Connected. IP: %s, gateway: %s, RSSI: %d dBm", WiFi.localIP().toString().c_str(),
+            WiFi.gatewayIP().toString().c_str(), WiFi.RSSI());
+        if (wifiReconnect.getStats().outages) {
+            LOG_INFO(WIFI, "Outage lasted %" PRIu32 " ms", wifiReconnect.getStats().lastOutageMs);
+        }
+    } else if (wasConnected && !wifiReconnect.connected()) {
+        LOG_WARN(WIFI, "Connection lost, retrying in %" PRIu32 " ms", wifiReconnect.retryInMs(now));
+    } else if (wifiReconnect.state() == WiFiReconnect::State::BACKOFF && lastWiFiState == WiFiReconnect::State::CONNECTING) {
+        LOG_WARN(WIFI, "No connection (status %s), retrying in %" PRIu32 " ms",
+            wifiStatusName(WiFi.status()), wifiReconnect.retryInMs(now));
+    }
+    lastWiFiState = wifiReconnect.state();
 }
 
 // =============================================================================
 // MQTT Setup
 // =============================================================================
-void setupMQTT() {
-    mqtt.setServer(MQTT_HOST, MQTT_PORT);
-    mqtt.setCallback(mqttCallback);
-    mqtt.setBufferSize(1024);  // Larger buffer for discovery payloads
+// Discovery for every registered bed and every group
+void startDiscoveryPass(bool force) {
+    size_t count = bedRegistry.list(discoveryBeds);
+    haDiscovery->startPass(discoveryBeds, count, BED_GROUPS, BED_GROUP_COUNT, force);
 }
 
-bool connectMQTT() {
-    if (mqtt.connected()) return true;
+void setupMQTT() {
+    mqtt.begin(MQTT_HOST, MQTT_PORT, mqttCallback);
+}
 
-    Serial.println("[MQTT] Connecting...");
+// Start a connection. PubSubClient finishes it here; the async backend
+// returns at once and serviceMQTT() picks up the outcome.
+void connectMQTT() {
+    LOG_INFO(MQTT, "Connecting...");
 
     String clientId = DEVICE_NAME;
     clientId += "_";
     clientId += String(random(0xffff), HEX);
 
     // Connect with last will
-    if (mqtt.connect(clientId.c_str(), MQTT_USER, MQTT_PASSWORD,
-                     "motosleep/status", 0, true, "offline")) {
-        Serial.println("[MQTT] Connected!");
+    if (!mqtt.connect(clientId.c_str(), MQTT_USER, MQTT_PASSWORD, "motosleep/status", "offline")) {
+        LOG_WARN(MQTT, "Failed, rc=%d", mqtt.state());
+    }
+}
 
-        // Publish online status
-        mqtt.publish("motosleep/status", "online", true);
+void onMqttConnected() {
+    LOG_INFO(MQTT, "Connected!");
 
-        // Subscribe to command topics for all beds
-        for (size_t i = 0; i < BED_COUNT; i++) {
-            String topic = "motosleep/";
-            topic += BEDS[i].id;
-            topic += "/+/set";
-            mqtt.subscribe(topic.c_str());
-            Serial.printf("[MQTT] Subscribed to: %s\n", topic.c_str());
-        }
+    // Publish online status
+    mqtt.publish("motosleep/status", "online", true);
 
-        // Publish HA discovery
-        haDiscovery->publishControllerDiscovery();
-        for (size_t i = 0; i < BED_COUNT; i++) {
-            haDiscovery->publishBedDiscovery(BEDS[i]);
+    // One wildcard covers every bed; the router rejects unknown bed IDs
+    mqtt.subscribe(MOTOSLEEP_COMMAND_FILTER);
+    LOG_INFO(MQTT, "Subscribed to: %s", MOTOSLEEP_COMMAND_FILTER);
+    mqtt.subscribe(HA_STATUS_TOPIC);
+
+    // Retained bed configs replay on every connect, so the registry follows the broker
+    mqtt.subscribe(MOTOSLEEP_BED_CONFIG_FILTER);
+
+    // Beds removed while offline still have retained topics on the broker
+    flushBedRemovals();
+
+    // The broker may have restarted without our retained positions and links
+    memset(publishedPositionStates, 0xFF, sizeof(publishedPositionStates));
+    memset(publishedLinkUp, 0xFF, sizeof(publishedLinkUp));
+    memset(publishedAvailable, 0xFF, sizeof(publishedAvailable));
+
+    // Publish HA discovery from loop() (skipped if unchanged since the last pass)
+    startDiscoveryPass(false);
+}
+
+void serviceMQTT() {
+    if (wifiReconnect.connected() && !mqtt.connected() && !mqtt.connecting()) {
+        unsigned long now = millis();
+        if (mqttConnectNow || now - lastMqttReconnect > MQTT_RECONNECT_INTERVAL) {
+            mqttConnectNow = false;
+            lastMqttReconnect = now;
+            connectMQTT();
         }
+    }
 
-        return true;
-    } else {
-        Serial.printf("[MQTT] Failed, rc=%d\n", mqtt.state());
-        return false;
+    bool connected = mqtt.connected();
+    bool connecting = mqtt.connecting();
+    if (connected && !mqttWasConnected) {
+        onMqttConnected();
+    } else if (!connected && mqttWasConnected) {
+        LOG_WARN(MQTT, "Disconnected, rc=%d", mqtt.state());
+    } else if (!connected && mqttWasConnecting && !connecting) {
+        LOG_WARN(MQTT, "Failed, rc=%d", mqtt.state());
     }
+    mqttWasConnected = connected;
+    mqttWasConnecting = connecting;
+
+    mqtt.loop();
 }
 
 // =============================================================================
 // BLE Setup
 // =============================================================================
 void setupBLE() {
-    Serial.println("[BLE] Initializing...");
+    LOG_INFO(BLE, "Initializing...");
     BLEDevice::init(DEVICE_NAME);
 
     bleScan = BLEDevice::getScan();
     bleScan->setAdvertisedDeviceCallbacks(new ScanCallback());
     bleScan->setActiveScan(true);
-    bleScan->setInterval(100);
-    bleScan->setWindow(99);
+    scanScheduler.setTiming(BLE_SCAN_GAP_MIN, BLE_SCAN_GAP_MAX, BLE_PRESENCE_SCAN_INTERVAL);
+}
+
+void onBleScanComplete(BLEScanResults results) {
+    bleScanning = false;
+    bleScan->clearResults();
+}
+
+void startBleScan(ScanMode mode) {
+    if (bleScanning) return;
+
+    // Searching listens 99% of the time; a presence refresh 5%, leaving
+    // the radio to WiFi
+    if (mode == ScanMode::SEARCH) {
+        bleScan->setInterval(100);
+        bleScan->setWindow(99);
+    } else {
+        bleScan->setInterval(1000);
+        bleScan->setWindow(50);
+    }
+
+    LOG_INFO(BLE, "Starting %s scan...", scanModeName(mode));
+    bleScanning = true;
+    scanCutShort = false;
+    scanScheduler.started(mode);
+    bleScan->start(BLE_SCAN_DURATION, onBleScanComplete, false);
+}
+
+void stopBleScan() {
+    if (!bleScanning) return;
+
+    bleScan->stop();
+    scanCutShort = true;
+    bleScanning = false;
+}
+
+// Wind up a finished scan and start the next one the schedule calls for,
+// never while a motor is held
+void serviceScan() {
+    applyScanResults();
+    if (scanScheduler.running() != ScanMode::NONE && !bleScanning) {
+        scanScheduler.finished(!allBedsFound, scanCutShort, millis());
+    }
+    if (bedWorker.anyHoldActive()) return;
+
+    ScanMode mode = scanScheduler.due(!allBedsFound, millis());
+    if (mode != ScanMode::NONE) {
+        startBleScan(mode);
+    }
+}
+
+// =============================================================================
+// BLE Worker Task
+// Owns the BLE stack: scanning and every bed connection happen on this task,
+// so mqttCallback only ever enqueues and returns. The command path itself is
+// BedWorker.
+// =============================================================================
+// Tell loop() about beds that connected or dropped since the last call.
+// A drop the bed initiated is noticed here, so within one worker wake-up.
+void reportLinkChanges() {
+    for (size_t i = 0; i < MAX_BEDS; i++) {
+        bool up = beds[i] && beds[i]->isConnected();
+        if (up == reportedLinkUp[i]) continue;
+
+        BedEvent event = {static_cast<uint8_t>(i), up ? BedEventType::LINK_UP : BedEventType::LINK_DOWN};
+        if (!bedEvents.push(event)) {
+            // Retry on the next wake-up rather than lose the change
+            bedEventsDropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        reportedLinkUp[i] = up;
+
+        uint32_t depth = bedEvents.size();
+        if (depth > bedEventsHighWater.load(std::memory_order_relaxed)) {
+            bedEventsHighWater.store(depth, std::memory_order_relaxed);
+        }
+    }
+}
+
+void bleWorkerTask(void* param) {
+    // Held whenever the worker is awake; see applyBedChanges()
+    xSemaphoreTake(registryLock, portMAX_DELAY);
+    uint32_t awakeUs = micros();
+    serviceScan();
+
+    for (;;) {
+        // Run stops, close idle links, run due macro steps, repeat due holds,
+        // update position estimates and retry failing beds, then sleep until
+        // a command is queued, a step, hold, link or trial connect is due or
+        // the scan schedule needs checking
+        unsigned long waitMs = bedWorker.service(1000);
+        reportLinkChanges();
+        xSemaphoreGive(registryLock);
+        bleWorkerLoad.add(micros() - awakeUs);
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(waitMs));
+        xSemaphoreTake(registryLock, portMAX_DELAY);
+        awakeUs = micros();
+
+        bedWorker.drain();
+
+        // Search for missing beds, backing off while they stay missing, or
+        // refresh signal strength once every bed is known
+        serviceScan();
+    }
+}
+
+// Pinned next to the Bluedroid host, leaving the other core to loop() and MQTT
+void startBleWorker() {
+    xTaskCreatePinnedToCore(bleWorkerTask, "ble_worker", BLE_WORKER_STACK_SIZE, nullptr,
+                            BLE_WORKER_PRIORITY, &bleWorkerHandle, BLE_WORKER_CORE);
+}
+
+// =============================================================================
+// Stats
+// =============================================================================
+// Publish a payload larger than the MQTT buffer by streaming it
+bool publishStreamed(const char* topic, const char* payload, size_t length, bool retained = false) {
+    if (!mqtt.beginPublish(topic, length, retained)) return false;
+    mqtt.write(reinterpret_cast<const uint8_t*>(payload), length);
+    return mqtt.endPublish();
+}
+
+// Append formatted text to a payload being built in buffer. A piece that
+// doesn't fit is not appended and false is returned; callers stop there, so
+// length never runs past the buffer and a cut-off payload is never sent.
+bool appendPayload(char* buffer, size_t size, size_t& length, const char* format, ...)
+    __attribute__((format(printf, 4, 5)));
+
+bool appendPayload(char* buffer, size_t size, size_t& length, const char* format, ...) {
+    if (length >= size) return false;
+
+    va_list args;
+    va_start(args, format);
+    int written = vsnprintf(buffer + length, size - length, format, args);
+    va_end(args);
+    if (written < 0 || static_cast<size_t>(written) >= size - length) {
+        buffer[length] = '\0';
+        return false;
+    }
+    length += written;
+    return true;
+}
+
+void publishStats() {
+    char topic[64];
+    char payload[1536];
+
+    for (size_t i = 0; i < MAX_BEDS; i++) {
+        if (!beds[i]) continue;
+        CommandQueueStats stats = bedWorker.queueStats(i);
+        CommandQueueStats stops = bedWorker.stopStats(i);
+        uint32_t seenMs = bedLastSeenMs[i].load(std::memory_order_relaxed);
+        ConnectionStats conn = bedWorker.pool().getStats(i);
+        MotorHoldStats hold = bedWorker.holdStats(i);
+        BreakerStats breaker = bedWorker.breaker(i).getStats();
+
+        snprintf(topic, sizeof(topic), "motosleep/%s/stats", bedRegistry.config(i).id);
+        size_t length = 0;
+        bool complete = appendPayload(payload, sizeof(payload), length,
+            "{\"queue_depth\":%" PRIu32 ",\"queue_high_water\":%" PRIu32
+            ",\"enqueued\":%" PRIu32 ",\"written\":%" PRIu32 ",\"failed\":%" PRIu32
+            ",\"dropped\":%" PRIu32 ",\"coalesced\":%" PRIu32 ",\"preempted\":%" PRIu32 ",\"ble_writes\":%" PRIu32
+            ",\"stops\":%" PRIu32 ",\"stop_failed\":%" PRIu32 ",\"stop_latency_last_us\":%" PRIu32
+            ",\"stop_latency_max_us\":%" PRIu32
+            ",\"latency_last_us\":%" PRIu32
+            ",\"latency_avg_us\":%" PRIu32 ",\"latency_max_us\":%" PRIu32
+            ",\"connected\":%s,\"warm_sends\":%" PRIu32 ",\"cold_sends\":%" PRIu32
+            ",\"connect_failures\":%" PRIu32 ",\"idle_evictions\":%" PRIu32
+            ",\"lru_evictions\":%" PRIu32 ",\"holds\":%" PRIu32 ",\"hold_writes\":%" PRIu32
+            ",\"hold_missed_deadlines\":%" PRIu32 ",\"hold_deadman_stops\":%" PRIu32
+            ",\"hold_jitter_last_us\":%" PRIu32 ",\"hold_jitter_avg_us\":%" PRIu32
+            ",\"hold_jitter_max_us\":%" PRIu32 ",\"rssi\":%d,\"last_seen_ms\":%ld"
+            ",\"breaker_state\":\"%s\",\"breaker_opens\":%" PRIu32 ",\"breaker_half_opens\":%" PRIu32
+            ",\"breaker_closes\":%" PRIu32 ",\"breaker_fast_fails\":%" PRIu32 ",\"breaker_open_ms\":%" PRIu32 "}",
+            stats.depth, stats.highWater, stats.enqueued, stats.written, stats.failed,
+            stats.dropped, stats.coalesced, stats.preempted, bedWorker.bleWrites(i),
+            stops.written, stops.failed, stops.lastLatencyUs, stops.maxLatencyUs, stats.lastLatencyUs, stats.avgLatencyUs, stats.maxLatencyUs,
+            bedLinkUp[i] ? "true" : "false", conn.warmSends, conn.coldSends,
+            conn.connectFailures, conn.idleEvictions, conn.lruEvictions, hold.holds, hold.writes,
+            hold.missedDeadlines, hold.deadmanStops, hold.lastJitterUs, hold.avgJitterUs, hold.maxJitterUs,
+            bedRssi[i].load(std::memory_order_relaxed), seenMs ? (long)(millis() - seenMs) : -1L,
+            breakerStateName(breaker.state), breaker.opens, breaker.halfOpens, breaker.closes,
+            breaker.fastFails, breaker.openMs);
+        if (!complete) {
+            LOG_WARN(MQTT, "%s does not fit in %u bytes, not published", topic, (unsigned)sizeof(payload));
+            continue;
+        }
+
+        publishStreamed(topic, payload, length);
+    }
+
+    // Controller-wide stats
+    const DiscoveryStats& discovery = haDiscovery->getLastPassStats();
+    const DiscoveryPassCounts& passes = haDiscovery->getPassCounts();
+    const WiFiOutageStats& wifi = wifiReconnect.getStats();
+    LatencySnapshot loop = loopTimes.takeSnapshot();
+    MacroStats macros = bedWorker.macros().getStats();
+    LatencySnapshot macroLate = bedWorker.macros().takeLatenessSnapshot();
+    CommandHeapStats heap = bedWorker.heapStats();
+    ScanStats scans = scanScheduler.getStats();
+    uint32_t nowUs = micros();
+    size_t length = 0;
+    bool complete = appendPayload(payload, sizeof(payload), length,
+        "{\"discovery_publishes\":%" PRIu32 ",\"discovery_bytes\":%" PRIu32
+        ",\"discovery_ms\":%" PRIu32 ",\"discovery_passes_published\":%" PRIu32
+        ",\"discovery_passes_skipped\":%" PRIu32 ",\"cached_addresses\":%u"
+        ",\"beds_ready_ms\":%lu,\"first_command_ms\":%lu,\"log_dropped\":%" PRIu32
+        ",\"wifi_outages\":%" PRIu32 ",\"wifi_attempts\":%" PRIu32 ",\"wifi_outage_last_ms\":%" PRIu32
+        ",\"wifi_outage_max_ms\":%" PRIu32 ",\"wifi_outage_total_ms\":%" PRIu32
+        ",\"loop_p99_us\":%" PRIu32 ",\"loop_max_us\":%" PRIu32 ",\"loop_stalls\":%" PRIu32
+        ",\"macros_started\":%" PRIu32 ",\"macros_completed\":%" PRIu32 ",\"macros_cancelled\":%" PRIu32
+        ",\"macros_failed\":%" PRIu32 ",\"macro_steps\":%" PRIu32 ",\"macro_late_p50_us\":%" PRIu32
+        ",\"macro_late_p99_us\":%" PRIu32 ",\"macro_late_max_us\":%" PRIu32
+        ",\"heap_free\":%u,\"heap_min_free\":%u,\"heap_largest_block\":%u"
+        ",\"heap_commands\":%" PRIu32 ",\"heap_net_blocks\":%" PRId32 ",\"heap_last_blocks\":%" PRId32
+        ",\"heap_max_blocks\":%" PRId32 ",\"heap_growing_commands\":%" PRIu32
+        ",\"ble_worker_busy_permille\":%" PRIu32 ",\"network_busy_permille\":%" PRIu32
+        ",\"ble_worker_stack_free\":%u,\"bed_event_high_water\":%" PRIu32 ",\"bed_events_dropped\":%" PRIu32
+        ",\"scan_results_dropped\":%" PRIu32 ",\"scan_searches\":%" PRIu32 ",\"scan_presence\":%" PRIu32
+        ",\"scan_gap_ms\":%" PRIu32 "}",
+        discovery.publishes, discovery.bytes, discovery.durationMs,
+        passes.published, passes.skipped, (unsigned)cachedAddressCount,
+        bedsReadyMs, bedWorker.firstCommandMs(), Log::dropped(),
+        wifi.outages, wifi.attempts, wifi.lastOutageMs, wifi.longestOutageMs, wifi.totalOutageMs,
+        loop.p99Us, loop.maxUs, loopStalls,
+        macros.started, macros.completed, macros.cancelled, macros.failed, macros.steps,
+        macroLate.p50Us, macroLate.p99Us, macroLate.maxUs,
+        (unsigned)heap_caps_get_free_size(MALLOC_CAP_8BIT),
+        (unsigned)heap_caps_get_minimum_free_size(MALLOC_CAP_8BIT),
+        (unsigned)heap_caps_get_largest_free_block(MALLOC_CAP_8BIT),
+        heap.commands, heap.netBlocks, heap.lastBlocks, heap.maxBlocks, heap.growingCommands,
+        bleWorkerLoad.takePermille(nowUs), networkLoad.takePermille(nowUs),
+        (unsigned)uxTaskGetStackHighWaterMark(bleWorkerHandle), bedEventsHighWater.load(), bedEventsDropped.load(),
+        scanResultsDropped.load(), scans.searches, scans.presenceScans, scans.gapMs);
+    if (!complete) {
+        LOG_WARN(MQTT, "motosleep/stats does not fit in %u bytes, not published", (unsigned)sizeof(payload));
+        return;
+    }
+    publishStreamed("motosleep/stats", payload, length);
+}
+
+// Publish p50/p95/p99 for each command path stage (and group skew) since the last call
+void publishMetrics() {
+    char topic[64];
+    char payload[1024];
+
+    for (size_t i = 0; i < MAX_BEDS; i++) {
+        if (!beds[i]) continue;
+        snprintf(topic, sizeof(topic), "motosleep/%s/metrics", bedRegistry.config(i).id);
+        size_t length = 0;
+        bool complete = appendPayload(payload, sizeof(payload), length, "{");
+
+        // Every stage is drained, so a cut-off payload still starts the next interval cleanly
+        for (size_t stage = 0; stage < LATENCY_STAGE_COUNT; stage++) {
+            LatencySnapshot snapshot = bedWorker.latencies(i)[stage].takeSnapshot();
+            complete = complete && appendPayload(payload, sizeof(payload), length,
+                "%s\"%s\":{\"n\":%" PRIu32 ",\"p50\":%" PRIu32 ",\"p95\":%" PRIu32
+                ",\"p99\":%" PRIu32 ",\"max\":%" PRIu32 "}",
+                stage ? "," : "", latencyStageName(stage), snapshot.count,
+                snapshot.p50Us, snapshot.p95Us, snapshot.p99Us, snapshot.maxUs);
+        }
+        complete = complete && appendPayload(payload, sizeof(payload), length, "}");
+        if (!complete) {
+            LOG_WARN(MQTT, "%s does not fit in %u bytes, not published", topic, (unsigned)sizeof(payload));
+            continue;
+        }
+
+        publishStreamed(topic, payload, length);
+    }
+
+    // Groups: first-to-last write skew and fan-out outcomes
+    for (size_t g = 0; g < BED_GROUP_COUNT; g++) {
+        LatencySnapshot skew = bedWorker.groupSkew(g).takeSnapshot();
+        CommandQueueStats stats = bedWorker.groupStats(g);
+
+        snprintf(topic, sizeof(topic), "motosleep/%s/metrics", BED_GROUPS[g].id);
+        size_t length = 0;
+        bool complete = appendPayload(payload, sizeof(payload), length,
+            "{\"skew\":{\"n\":%" PRIu32 ",\"p50\":%" PRIu32 ",\"p95\":%" PRIu32
+            ",\"p99\":%" PRIu32 ",\"max\":%" PRIu32 "},\"enqueued\":%" PRIu32
+            ",\"written\":%" PRIu32 ",\"failed\":%" PRIu32 ",\"dropped\":%" PRIu32 "}",
+            skew.count, skew.p50Us, skew.p95Us, skew.p99Us, skew.maxUs,
+            stats.enqueued, stats.written, stats.failed, stats.dropped);
+        if (!complete) {
+            LOG_WARN(MQTT, "%s does not fit in %u bytes, not published", topic, (unsigned)sizeof(payload));
+            continue;
+        }
+        publishStreamed(topic, payload, length);
+    }
+}
+
+// Publish retained head/feet estimates for beds whose estimate changed
+void publishPositions() {
+    char topic[64];
+    char payload[384];
+
+    for (size_t i = 0; i < MAX_BEDS; i++) {
+        if (!beds[i]) continue;
+        uint32_t states[ACTUATOR_COUNT];
+        bool changed = false;
+        for (size_t a = 0; a < ACTUATOR_COUNT; a++) {
+            states[a] = bedWorker.positionState(i, a);
+            if (states[a] != publishedPositionStates[i][a]) changed = true;
+        }
+        if (!changed) continue;
+
+        snprintf(topic, sizeof(topic), "motosleep/%s/position", bedRegistry.config(i).id);
+        size_t length = 0;
+        bool complete = appendPayload(payload, sizeof(payload), length, "{");
+        for (size_t a = 0; a < ACTUATOR_COUNT && complete; a++) {
+            const Calibration& cal = bedWorker.calibration(i, a);
+            unsigned position = states[a] & 0x3FF;
+            unsigned uncertainty = (states[a] >> 10) & 0x3FF;
+            MotorDirection dir = static_cast<MotorDirection>(static_cast<int8_t>((states[a] >> 20) & 0x3) - 1);
+
+            // Percent for HA; the error bound rounds up so it never understates
+            complete = appendPayload(payload, sizeof(payload), length,
+                "%s\"%s\":{\"pos\":%u,\"err\":%u,\"dir\":\"%s\",\"up_ms\":%" PRIu32 ",\"down_ms\":%" PRIu32,
+                a ? "," : "", actuatorName(a), (position + 5) / 10, (uncertainty + 9) / 10, directionName(dir),
+                cal.upMs.load(), cal.downMs.load());
+            if (complete && cal.done) {
+                complete = appendPayload(payload, sizeof(payload), length,
+                    ",\"cal_err\":%.1f", cal.errorPermille.load() / 10.0f);
+            }
+            complete = complete && appendPayload(payload, sizeof(payload), length, "}");
+        }
+        complete = complete && appendPayload(payload, sizeof(payload), length, "}");
+        if (!complete) {
+            LOG_WARN(MQTT, "%s does not fit in %u bytes, not published", topic, (unsigned)sizeof(payload));
+            continue;
+        }
+
+        if (publishStreamed(topic, payload, length, true)) {
+            memcpy(publishedPositionStates[i], states, sizeof(states));
+        }
+    }
+}
+
+// Publish motosleep/{bed_id}/link for beds whose link changed
+void publishLinkStates() {
+    char topic[64];
+
+    for (size_t i = 0; i < MAX_BEDS; i++) {
+        if (!beds[i] || publishedLinkUp[i] == bedLinkUp[i]) continue;
+        snprintf(topic, sizeof(topic), "motosleep/%s/link", bedRegistry.config(i).id);
+        if (mqtt.publish(topic, bedLinkUp[i] ? "connected" : "disconnected", true)) {
+            publishedLinkUp[i] = bedLinkUp[i];
+        }
+    }
+}
+
+// Publish motosleep/{bed_id}/available when a bed's breaker opens or closes.
+// Half-open stays offline until the trial connect succeeds.
+void publishAvailability() {
+    char topic[64];
+
+    for (size_t i = 0; i < MAX_BEDS; i++) {
+        if (!beds[i]) continue;
+        int8_t available = bedWorker.breaker(i).state() == BreakerState::CLOSED;
+        if (publishedAvailable[i] == available) continue;
+        snprintf(topic, sizeof(topic), "motosleep/%s/available", bedRegistry.config(i).id);
+        if (mqtt.publish(topic, available ? "online" : "offline", true)) {
+            publishedAvailable[i] = available;
+        }
+    }
+}
+
+#if LOG_MQTT_MIRROR
+// Publish log lines already written to Serial as one newline-separated batch
+void publishLogBatch() {
+    char batch[1024];
+    size_t length = 0;
+    LogRecord record;
+
+    while (length + LogRecord::TEXT_SIZE + 1 <= sizeof(batch) && Log::popMirrored(record)) {
+        memcpy(batch + length, record.text, record.length);
+        length += record.length;
+        batch[length++] = '\n';
+    }
+    if (length) {
+        publishStreamed("motosleep/debug", batch, length - 1);
+    }
+}
+#endif
+
+// Apply link changes reported by the BLE worker
+void drainBedEvents() {
+    BedEvent event;
+    while (bedEvents.pop(event)) {
+        bedLinkUp[event.bed] = event.type == BedEventType::LINK_UP;
+    }
+}
+
+// =============================================================================
+// Bed Registry
+// Slots are built, torn down and rebuilt here, in loop(), with registryLock
+// held so the BLE worker and the scan callback never see a slot mid-change.
+// =============================================================================
+// Build a registered slot's bed object and BLE link, and restore what NVS
+// has cached for it
+void createBed(size_t i) {
+    const BedConfig& config = bedRegistry.config(i);
+    bleLinks[i] = linkPool.create(i, config.friendlyName);
+    beds[i] = bedPool.create(i, config, *bleLinks[i]);
+    bleNameHashes[i].store(bleNameHash(config.bleName, strlen(config.bleName)), std::memory_order_relaxed);
+    bedRssi[i].store(0, std::memory_order_relaxed);
+    bedLastSeenMs[i].store(0, std::memory_order_relaxed);
+    connectFailures[i] = 0;
+    for (size_t a = 0; a < ACTUATOR_COUNT; a++) {
+        publishedPositionStates[i][a] = UINT32_MAX;
+    }
+
+    // Use the address cached by an earlier scan so commands work without waiting for one
+    uint8_t address[6];
+    if (BedStore::loadAddress(config.bleName, address)) {
+        beds[i]->setAddress(address);
+        bedsDiscovered[i] = true;
+        addressFromCache[i] = true;
+        cachedAddressCount++;
+        LOG_INFO(NVS, "Using cached address for %s", config.friendlyName);
+    }
+
+    // Topic route, characteristic handle and travel times
+    bedWorker.attachBed(i);
+}
+
+// Tear down a slot's bed object and link, dropping anything still queued for it
+void destroyBed(size_t i) {
+    // The worker is parked on registryLock
+    bedWorker.detachBed(i);
+
+    bedPool.destroy(i);      // Disconnects
+    linkPool.destroy(i);
+    beds[i] = nullptr;
+    bleLinks[i] = nullptr;
+    reportedLinkUp[i] = false;
+    bedLinkUp[i] = false;
+    publishedLinkUp[i] = -1;
+    publishedAvailable[i] = -1;
+    bedsDiscovered[i] = false;
+    addressFromCache[i] = false;
+    bleNameHashes[i].store(0, std::memory_order_relaxed);
+}
+
+// Queue a bed config message for applyBedChanges(). A newer message for a
+// bed replaces one still queued.
+void queueBedChange(const char* id, const byte* payload, unsigned int length) {
+    BedChange change = {};
+    change.remove = length == 0;
+    if (change.remove) {
+        if (strlcpy(change.entry.id, id, sizeof(change.entry.id)) >= sizeof(change.entry.id)) return;
+    } else if (!parseBedEntry(id, strlen(id), reinterpret_cast<const char*>(payload), length, change.entry)) {
+        LOG_WARN(MQTT, "Bad config for bed %s: %.*s", id, (int)length, (const char*)payload);
+        return;
+    }
+
+    for (size_t c = 0; c < bedChangeCount; c++) {
+        if (strcmp(bedChanges[c].entry.id, change.entry.id) == 0) {
+            bedChanges[c] = change;
+            return;
+        }
+    }
+    if (bedChangeCount == sizeof(bedChanges) / sizeof(bedChanges[0])) {
+        LOG_WARN(MQTT, "Too many bed changes pending, dropping %s", id);
+        return;
+    }
+    bedChanges[bedChangeCount++] = change;
+}
+
+// Clear a removed bed's retained discovery configs and state topics
+void publishBedRemoval(const BedConfig& config) {
+    haDiscovery->removeBedDiscovery(config);
+    char topic[64];
+    snprintf(topic, sizeof(topic), "motosleep/%s/link", config.id);
+    mqtt.publish(topic, "", true);
+    snprintf(topic, sizeof(topic), "motosleep/%s/available", config.id);
+    mqtt.publish(topic, "", true);
+}
+
+// Keep a copy of a bed removed while MQTT is down, since its slot may be
+// reused before the broker is back
+void queueBedRemoval(const BedEntry& entry) {
+    for (size_t r = 0; r < pendingRemovalCount; r++) {
+        if (strcmp(pendingRemovals[r].id, entry.id) == 0) return;
+    }
+    if (pendingRemovalCount == MAX_BEDS) {
+        LOG_WARN(MQTT, "Too many bed removals pending, dropping %s", pendingRemovals[0].id);
+        memmove(pendingRemovals, pendingRemovals + 1, (MAX_BEDS - 1) * sizeof(BedEntry));
+        pendingRemovalCount--;
+    }
+    pendingRemovals[pendingRemovalCount++] = entry;
+}
+
+// Run from onMqttConnected(), before the discovery pass republishes the
+// beds still registered (a bed re-added under the same ID comes back then)
+void flushBedRemovals() {
+    for (size_t r = 0; r < pendingRemovalCount; r++) {
+        const BedEntry& entry = pendingRemovals[r];
+        LOG_INFO(MQTT, "Clearing retained topics of removed bed %s", entry.id);
+        publishBedRemoval({entry.bleName, entry.friendlyName, entry.id});
+    }
+    pendingRemovalCount = 0;
+}
+
+void applyBedChange(const BedChange& change) {
+    const BedEntry& entry = change.entry;
+    size_t i;
+
+    if (change.remove) {
+        i = bedRegistry.find(entry.id, strlen(entry.id));
+        if (i == MAX_BEDS) return;
+
+        // The slot's strings stay valid until the slot is reused
+        const BedConfig& config = bedRegistry.config(i);
+        LOG_INFO(BED, "Removing bed %s (%s)", config.friendlyName, config.bleName);
+        if (mqtt.connected()) {
+            publishBedRemoval(config);
+        } else {
+            queueBedRemoval(bedRegistry.entry(i));
+        }
+        BedStore::forget(config.bleName);
+        destroyBed(i);
+        bedRegistry.remove(entry.id, strlen(entry.id), i);
+        BedStore::saveRegistrySlot(i, nullptr);
+        return;
+    }
+
+    for (size_t g = 0; g < BED_GROUP_COUNT; g++) {
+        if (strcmp(BED_GROUPS[g].id, entry.id) == 0) {
+            LOG_WARN(BED, "Bed ID %s is taken by a group", entry.id);
+            return;
+        }
+    }
+
+    // set() overwrites the slot's strings, so keep the old BLE name
+    char oldBleName[sizeof(entry.bleName)] = "";
+    i = bedRegistry.find(entry.id, strlen(entry.id));
+    if (i < MAX_BEDS) {
+        strlcpy(oldBleName, bedRegistry.entry(i).bleName, sizeof(oldBleName));
+    }
+
+    RegistryResult result = bedRegistry.set(entry, i);
+    switch (result) {
+        case RegistryResult::UPDATED:
+            // Rebuild: a new BLE name needs a new address, and the old
+            // objects were made for the old strings
+            destroyBed(i);
+            if (strcmp(oldBleName, entry.bleName) != 0) {
+                // The old name's address and handle belong to another bed now
+                BedStore::forget(oldBleName);
+            }
+            // fall through
+        case RegistryResult::ADDED:
+            createBed(i);
+            BedStore::saveRegistrySlot(i, &bedRegistry.entry(i));
+            if (mqtt.connected()) {
+                haDiscovery->publishBedDiscovery(bedRegistry.config(i));
+            }
+            LOG_INFO(BED, "Bed %s %s: %s (%s)", entry.id, registryResultName(result), entry.friendlyName, entry.bleName);
+            break;
+        case RegistryResult::UNCHANGED:
+            break;
+        default:
+            LOG_WARN(BED, "Bed %s not registered: %s", entry.id, registryResultName(result));
+            break;
+    }
 }
 
-void startBleScan() {
-    if (allBedsFound) return;
+// Apply queued bed changes while the BLE worker sleeps. If it holds
+// registryLock, try again on the next loop().
+void applyBedChanges() {
+    if (!bedChangeCount || xSemaphoreTake(registryLock, 0) != pdTRUE) return;
+
+    // Events already queued belong to the slots as they were
+    drainBedEvents();
+
+    for (size_t c = 0; c < bedChangeCount; c++) {
+        applyBedChange(bedChanges[c]);
+    }
+    bedChangeCount = 0;
+    updateAllBedsFound();
+
+    // New beds are found by the worker's next scan
+    if (!allBedsFound) {
+        scanScheduler.searchNow();
+    }
+    xSemaphoreGive(registryLock);
 
-    Serial.println("[BLE] Starting scan...");
-    bleScan->start(BLE_SCAN_DURATION, false);
-    lastBleScan = millis();
+    // A pass in progress would publish a stale bed list
+    if (haDiscovery->passActive()) {
+        startDiscoveryPass(false);
+    }
+    xTaskNotifyGive(bleWorkerHandle);
 }
 
 // =============================================================================
@@ -375,16 +1146,46 @@ void setup() {
     Serial.println("================================");
     Serial.println("  MotoSleep ESP32 Controller");
     Serial.println("================================");
-    Serial.printf("Configured beds: %d\n", BED_COUNT);
-    for (size_t i = 0; i < BED_COUNT; i++) {
-        Serial.printf("  - %s (%s)\n", BEDS[i].friendlyName, BEDS[i].bleName);
-    }
     Serial.println();
 
-    // Initialize bed objects
-    for (size_t i = 0; i < BED_COUNT; i++) {
-        beds[i] = new MotoSleepBed(BEDS[i]);
+    // Everything after this logs through the queue
+    Log::begin();
+
+    // Restore the bed registry, or seed it from BEDS[] on first boot
+    if (BedStore::registrySaved()) {
+        for (size_t i = 0; i < MAX_BEDS; i++) {
+            BedEntry entry;
+            if (BedStore::loadRegistrySlot(i, entry) && validBedId(entry.id)) {
+                bedRegistry.restore(i, entry);
+            }
+        }
+    } else {
+        for (size_t i = 0; i < BED_COUNT; i++) {
+            BedEntry entry = {};
+            strlcpy(entry.id, BEDS[i].id, sizeof(entry.id));
+            strlcpy(entry.bleName, BEDS[i].bleName, sizeof(entry.bleName));
+            strlcpy(entry.friendlyName, BEDS[i].friendlyName, sizeof(entry.friendlyName));
+            size_t slot;
+            if (bedRegistry.set(entry, slot) == RegistryResult::ADDED) {
+                BedStore::saveRegistrySlot(slot, &bedRegistry.entry(slot));
+            }
+        }
+    }
+
+    registryLock = xSemaphoreCreateMutex();
+    bedWorker.begin();
+
+    // Bed objects, with whatever earlier scans and calibration runs cached
+    LOG_INFO(BED, "Registered beds: %u of %u", (unsigned)bedRegistry.count(), (unsigned)MAX_BEDS);
+    for (size_t i = 0; i < MAX_BEDS; i++) {
+        if (!bedRegistry.used(i)) continue;
+        LOG_INFO(BED, "  - %s (%s)", bedRegistry.config(i).friendlyName, bedRegistry.config(i).bleName);
+        createBed(i);
     }
+    memset(publishedPositionStates, 0xFF, sizeof(publishedPositionStates));
+    memset(publishedLinkUp, 0xFF, sizeof(publishedLinkUp));
+    memset(publishedAvailable, 0xFF, sizeof(publishedAvailable));
+    updateAllBedsFound();
 
     // Setup components
     setupWiFi();
@@ -394,39 +1195,70 @@ void setup() {
     // Create HA discovery helper
     haDiscovery = new HADiscovery(mqtt);
 
-    // Initial MQTT connection
-    connectMQTT();
+    // Start the BLE worker (runs the initial scan)
+    startBleWorker();
 
-    // Start initial BLE scan
-    startBleScan();
+    // MQTT connects from loop() once WiFi has an IP
 }
 
 // =============================================================================
 // Loop
 // =============================================================================
 void loop() {
-    // Maintain WiFi connection
-    if (WiFi.status() != WL_CONNECTED) {
-        Serial.println("[WiFi] Connection lost, reconnecting...");
-        setupWiFi();
-    }
+    uint32_t loopStart = micros();
+
+    // Maintain WiFi connection without blocking; BLE keeps running during outages
+    serviceWiFi();
 
     // Maintain MQTT connection
-    if (!mqtt.connected()) {
-        unsigned long now = millis();
-        if (now - lastMqttReconnect > MQTT_RECONNECT_INTERVAL) {
-            lastMqttReconnect = now;
-            connectMQTT();
-        }
+    serviceMQTT();
+
+    // Link changes from the BLE worker, then bed config messages received
+    // since the last iteration
+    drainBedEvents();
+    applyBedChanges();
+
+    // Home Assistant came online and asked for discovery
+    if (discoveryRequested && mqtt.connected()) {
+        discoveryRequested = false;
+        startDiscoveryPass(true);
     }
-    mqtt.loop();
 
-    // Periodic BLE scan if not all beds found
-    if (!allBedsFound) {
+    // One discovery device per iteration, so a pass never holds up loop()
+    if (mqtt.connected()) {
+        haDiscovery->servicePass();
+    }
+
+    // Periodic queue stats, latency metrics and position updates
+    if (mqtt.connected()) {
         unsigned long now = millis();
-        if (now - lastBleScan > (BLE_SCAN_DURATION * 1000 + 5000)) {
-            startBleScan();
+        if (now - lastStatsPublish > STATS_PUBLISH_INTERVAL) {
+            lastStatsPublish = now;
+            publishStats();
+        }
+        if (now - lastMetricsPublish > METRICS_PUBLISH_INTERVAL) {
+            lastMetricsPublish = now;
+            publishMetrics();
         }
+        if (now - lastPositionPublish > POSITION_PUBLISH_INTERVAL) {
+            lastPositionPublish = now;
+            publishPositions();
+        }
+        publishLinkStates();
+        publishAvailability();
+#if LOG_MQTT_MIRROR
+        if (now - lastLogMirror > LOG_MQTT_MIRROR_INTERVAL) {
+            lastLogMirror = now;
+            publishLogBatch();
+        }
+#endif
+    }
+
+    uint32_t loopUs = micros() - loopStart;
+    loopTimes.record(loopUs);
+    networkLoad.add(loopUs);
+    if (loopUs > LOOP_STALL_THRESHOLD * 1000UL) {
+        loopStalls++;
     }
 
     delay(10);
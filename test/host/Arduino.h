@@ -0,0 +1,91 @@
+#ifndef HOST_ARDUINO_H
+#define HOST_ARDUINO_H
+
+#include <inttypes.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// =============================================================================
+// Host stand-in for the parts of the Arduino core the shared sources use.
+// Time comes from a virtual clock that only moves when the simulation moves
+// it, so every run takes the same path and reports the same numbers.
+// =============================================================================
+
+typedef uint8_t byte;
+
+namespace HostClock {
+
+inline uint64_t nowUs = 0;
+
+// Called each time the clock moves, so a simulation can do what the other
+// core would have done meanwhile
+inline void (*onAdvance)() = nullptr;
+
+inline void advanceUs(uint64_t us) {
+    nowUs += us;
+    if (onAdvance) onAdvance();
+}
+inline void advanceMs(uint64_t ms) { advanceUs(ms * 1000); }
+
+} // namespace HostClock
+
+inline unsigned long millis() { return static_cast<unsigned long>(HostClock::nowUs / 1000); }
+inline unsigned long micros() { return static_cast<unsigned long>(HostClock::nowUs); }
+inline void delay(unsigned long ms) { HostClock::advanceMs(ms); }
+
+// Deterministic stand-in for the hardware RNG
+inline uint32_t esp_random() {
+    static uint32_t state = 2463534242u;
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state;
+}
+
+inline size_t strlcpy(char* dst, const char* src, size_t size) {
+    size_t length = strlen(src);
+    if (size) {
+        size_t n = length < size - 1 ? length : size - 1;
+        memcpy(dst, src, n);
+        dst[n] = '\0';
+    }
+    return length;
+}
+
+class Print {
+public:
+    virtual ~Print() {}
+
+    virtual size_t write(uint8_t c) = 0;
+
+    virtual size_t write(const uint8_t* data, size_t len) {
+        size_t written = 0;
+        while (len--) written += write(*data++);
+        return written;
+    }
+
+    size_t write(const char* text) {
+        return write(reinterpret_cast<const uint8_t*>(text), strlen(text));
+    }
+
+    size_t print(const char* text) { return write(text); }
+
+    size_t printf(const char* format, ...) __attribute__((format(printf, 2, 3))) {
+        char buffer[128];
+        va_list args;
+        va_start(args, format);
+        int length = vsnprintf(buffer, sizeof(buffer), format, args);
+        va_end(args);
+        if (length <= 0) return 0;
+        size_t n = static_cast<size_t>(length) < sizeof(buffer) ? length : sizeof(buffer) - 1;
+        return write(reinterpret_cast<const uint8_t*>(buffer), n);
+    }
+
+    virtual void flush() {}
+};
+
+#endif // HOST_ARDUINO_H
@@ -0,0 +1,69 @@
+#ifndef CONFIG_H
+#define CONFIG_H
+
+// =============================================================================
+// Configuration for the host build. Forced in ahead of every source file
+// (-include HostConfig.h), so it stands in for include/config.h even when a
+// developer's own config.h is present. Settings not listed here take their
+// defaults from ConfigDefaults.h. Skipped for C sources (Unity).
+// =============================================================================
+#ifdef __cplusplus
+#include <stddef.h>
+#include <stdint.h>
+
+#define CONFIG_VERSION 2
+
+#define DEVICE_NAME "motosleep_controller"
+#define DEVICE_FRIENDLY_NAME "MotoSleep Controller"
+
+struct BedConfig {
+    const char* bleName;
+    const char* friendlyName;
+    const char* id;
+};
+
+const BedConfig BEDS[] = {
+    {"HHC_SIM_BED_1", "Bed 1", "bed_1"},
+    {"HHC_SIM_BED_2", "Bed 2", "bed_2"},
+    {"HHC_SIM_BED_3", "Bed 3", "bed_3"},
+    {"HHC_SIM_BED_4", "Bed 4", "bed_4"},
+};
+
+const size_t BED_COUNT = sizeof(BEDS) / sizeof(BEDS[0]);
+
+struct BedGroupConfig {
+    const char* id;
+    const char* friendlyName;
+    uint32_t members;
+};
+
+#define BED_GROUP_ALL 0xFFFFFFFFu
+
+const BedGroupConfig BED_GROUPS[] = {
+    {"all", "All Beds", BED_GROUP_ALL},
+};
+
+const size_t BED_GROUP_COUNT = sizeof(BED_GROUPS) / sizeof(BED_GROUPS[0]);
+
+struct MacroConfig {
+    const char* id;
+    const char* friendlyName;
+    const char* steps;
+};
+
+const MacroConfig MACROS[] = {
+    {"wind_down", "Wind Down", "feet_up:4000, +500 massage_head_step, +600000 light_toggle"},
+};
+
+const size_t MACRO_COUNT = sizeof(MACROS) / sizeof(MACROS[0]);
+
+#define MAX_BEDS 4
+#define BLE_MAX_CONNECTIONS 3
+#define BLE_IDLE_TIMEOUT 30000
+#define BLE_CONNECT_TIMEOUT 5000
+#define HA_DISCOVERY_PREFIX "homeassistant"
+#define HA_DISCOVERY_DEVICE_MODE true
+#define LOG_LEVEL 4
+
+#endif // __cplusplus
+#endif // CONFIG_H
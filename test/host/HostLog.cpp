@@ -0,0 +1,38 @@
+#include "Log.h"
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+// =============================================================================
+// Host Log: lines go straight to stderr when MOTOSLEEP_HOST_LOG is set in the
+// environment, and are dropped otherwise so benchmarks stay quiet.
+// =============================================================================
+namespace Log {
+
+static bool enabled() {
+    static const bool on = getenv("MOTOSLEEP_HOST_LOG") != nullptr;
+    return on;
+}
+
+void begin() {}
+
+void write(const char* tag, const char* format, ...) {
+    if (!enabled()) return;
+
+    char text[LogRecord::TEXT_SIZE];
+    va_list args;
+    va_start(args, format);
+    vsnprintf(text, sizeof(text), format, args);
+    va_end(args);
+    fprintf(stderr, "[%s] %s\n", tag, text);
+}
+
+uint32_t dropped() {
+    return 0;
+}
+
+bool popMirrored(LogRecord& record) {
+    return false;
+}
+
+} // namespace Log
@@ -0,0 +1,94 @@
+#include "Preferences.h"
+#include <map>
+#include <string>
+#include <string.h>
+#include <vector>
+
+// Keyed by "namespace/key"
+static std::map<std::string, std::vector<uint8_t>>& store() {
+    static std::map<std::string, std::vector<uint8_t>> entries;
+    return entries;
+}
+
+static std::string fullKey(const char* name, const char* key) {
+    return std::string(name) + "/" + key;
+}
+
+bool Preferences::begin(const char* name, bool readOnly) {
+    strncpy(_namespace, name, sizeof(_namespace) - 1);
+    _open = true;
+    _readOnly = readOnly;
+    return true;
+}
+
+void Preferences::end() {
+    _open = false;
+}
+
+bool Preferences::remove(const char* key) {
+    if (!_open || _readOnly) return false;
+    return store().erase(fullKey(_namespace, key)) > 0;
+}
+
+bool Preferences::clear() {
+    if (!_open || _readOnly) return false;
+    std::string prefix = fullKey(_namespace, "");
+    for (auto it = store().begin(); it != store().end();) {
+        if (it->first.compare(0, prefix.size(), prefix) == 0) it = store().erase(it);
+        else ++it;
+    }
+    return true;
+}
+
+size_t Preferences::putBool(const char* key, bool value) {
+    uint8_t byte = value ? 1 : 0;
+    return putBytes(key, &byte, 1);
+}
+
+size_t Preferences::putUInt(const char* key, uint32_t value) {
+    return putBytes(key, &value, sizeof(value));
+}
+
+size_t Preferences::putBytes(const char* key, const void* value, size_t len) {
+    if (!_open || _readOnly) return 0;
+    const uint8_t* bytes = static_cast<const uint8_t*>(value);
+    store()[fullKey(_namespace, key)].assign(bytes, bytes + len);
+    return len;
+}
+
+bool Preferences::getBool(const char* key, bool defaultValue) {
+    uint8_t byte = 0;
+    return getBytesLength(key) == 1 && getBytes(key, &byte, 1) == 1 ? byte != 0 : defaultValue;
+}
+
+uint32_t Preferences::getUInt(const char* key, uint32_t defaultValue) {
+    uint32_t value = 0;
+    return getBytesLength(key) == sizeof(value) && getBytes(key, &value, sizeof(value)) == sizeof(value)
+        ? value : defaultValue;
+}
+
+size_t Preferences::getBytesLength(const char* key) {
+    if (!_open) return 0;
+    auto it = store().find(fullKey(_namespace, key));
+    return it == store().end() ? 0 : it->second.size();
+}
+
+size_t Preferences::getBytes(const char* key, void* buf, size_t maxLen) {
+    if (!_open) return 0;
+    auto it = store().find(fullKey(_namespace, key));
+    if (it == store().end() || it->second.size() > maxLen) return 0;
+    memcpy(buf, it->second.data(), it->second.size());
+    return it->second.size();
+}
+
+namespace HostNvs {
+
+void clear() {
+    store().clear();
+}
+
+size_t size() {
+    return store().size();
+}
+
+} // namespace HostNvs
@@ -0,0 +1,43 @@
+#ifndef HOST_PREFERENCES_H
+#define HOST_PREFERENCES_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// =============================================================================
+// Host stand-in for the ESP32 Preferences (NVS) API, kept in memory for the
+// life of the process. HostNvs::clear() wipes it between tests.
+// =============================================================================
+class Preferences {
+public:
+    bool begin(const char* name, bool readOnly = false);
+    void end();
+
+    bool remove(const char* key);
+    bool clear();
+
+    size_t putBool(const char* key, bool value);
+    size_t putUInt(const char* key, uint32_t value);
+    size_t putBytes(const char* key, const void* value, size_t len);
+
+    bool getBool(const char* key, bool defaultValue = false);
+    uint32_t getUInt(const char* key, uint32_t defaultValue = 0);
+    size_t getBytesLength(const char* key);
+    size_t getBytes(const char* key, void* buf, size_t maxLen);
+
+private:
+    char _namespace[16] = {};
+    bool _open = false;
+    bool _readOnly = false;
+};
+
+namespace HostNvs {
+
+void clear();
+
+// Entries across all namespaces
+size_t size();
+
+} // namespace HostNvs
+
+#endif // HOST_PREFERENCES_H
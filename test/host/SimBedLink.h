@@ -0,0 +1,171 @@
+#ifndef SIM_BED_LINK_H
+#define SIM_BED_LINK_H
+
+#include <Arduino.h>
+#include "BedLink.h"
+#include "MotoSleepCommands.h"
+
+// =============================================================================
+// Simulated MotoSleep peripheral
+// One bed exposing service 0000ffe0 with the command characteristic 0000ffe1,
+// seen through the BedLink interface. Every operation moves the host clock
+// forward by its configured latency, and connects and writes fail at the
+// configured rates, drawn from a seeded generator so a run is repeatable.
+// =============================================================================
+
+struct SimBedProfile {
+    uint32_t connectUs = 60000;         // Link establishment
+    uint32_t discoveryUs = 450000;      // Service and characteristic discovery
+    uint32_t writeUs = 2000;            // A write leaving the radio
+    uint32_t timeoutUs = 5000000;       // A connect that gets no answer (BLE_CONNECT_TIMEOUT)
+    uint16_t connectFailPermille = 0;   // Connects that time out
+    uint16_t writeFailPermille = 0;     // Writes that fail and drop the link
+    uint16_t handle = 0x002a;           // Value handle of 0000ffe1 in the bed's GATT table
+};
+
+struct SimBedStats {
+    uint32_t connects;
+    uint32_t connectFailures;
+    uint32_t discoveries;
+    uint32_t writes;                    // Commands the bed acted on
+    uint32_t writeFailures;
+    uint32_t rejectedHandles;           // Cached handles the bed refused on the first write
+    uint32_t ignoredWrites;             // Sent to a handle that is not 0000ffe1
+    uint32_t linkDrops;                 // Dropped by the bed or by a failed write
+};
+
+class SimBedLink : public BedLink {
+public:
+    explicit SimBedLink(uint32_t seed = 1) : _random(seed ? seed : 1) {}
+
+    SimBedProfile& profile() { return _profile; }
+
+    // The bed goes out of range or loses power: connects time out and an
+    // open link drops
+    void setUnplugged(bool unplugged) {
+        _unplugged = unplugged;
+        if (unplugged) dropLink();
+    }
+
+    // The bed ends the link (supervision timeout, power glitch)
+    void dropLink() {
+        if (_connected) _stats.linkDrops++;
+        _connected = false;
+    }
+
+    // Firmware update: the characteristic moves to another handle
+    void moveCharacteristic(uint16_t handle) { _profile.handle = handle; }
+
+    // What the bed's GATT table holds at a handle
+    const char* uuidAt(uint16_t handle) const {
+        return handle && handle == _profile.handle ? MOTOSLEEP_CHARACTERISTIC_UUID : nullptr;
+    }
+
+    const SimBedStats& stats() const { return _stats; }
+    uint32_t received(char cmdChar) const { return _received[static_cast<uint8_t>(cmdChar) & 0x7f]; }
+    char lastCommand() const { return _lastCommand; }
+    uint64_t lastCommandUs() const { return _lastCommandUs; }
+
+    bool connect(const uint8_t address[6]) override {
+        _connected = false;
+
+        uint64_t start = HostClock::nowUs;
+        if (_unplugged || chance(_profile.connectFailPermille)) {
+            HostClock::advanceUs(_profile.timeoutUs);
+            _stats.connectFailures++;
+            return false;
+        }
+        HostClock::advanceUs(_profile.connectUs);
+        uint64_t linked = HostClock::nowUs;
+        _timing.linkUs = static_cast<uint32_t>(linked - start);
+        _connected = true;
+        _stats.connects++;
+
+        _handleChecked = false;
+        if (_handle) {
+            _timing.discoveryUs = 0;
+            _timing.cachedHandle = true;
+            return true;
+        }
+
+        discover();
+        _timing.discoveryUs = static_cast<uint32_t>(HostClock::nowUs - linked);
+        _timing.cachedHandle = false;
+        return true;
+    }
+
+    void disconnect() override { _connected = false; }
+    bool isConnected() const override { return _connected; }
+    ConnectTiming lastConnectTiming() const override { return _timing; }
+
+    bool write(const uint8_t* data, size_t len) override {
+        if (!_connected) return false;
+
+        HostClock::advanceUs(_profile.writeUs);
+        if (chance(_profile.writeFailPermille)) {
+            _stats.writeFailures++;
+            dropLink();
+            return false;
+        }
+
+        // The first write through a cached handle goes with response, as on
+        // the ESP32; the bed rejects a handle that is not 0000ffe1 and the
+        // link rediscovers
+        if (!_handleChecked) {
+            HostClock::advanceUs(_profile.writeUs);
+            if (!uuidAt(_handle)) {
+                _stats.rejectedHandles++;
+                discover();
+            }
+            _handleChecked = true;
+        }
+
+        // Write without response: a stale handle is accepted and ignored
+        if (!uuidAt(_handle)) {
+            _stats.ignoredWrites++;
+            return true;
+        }
+
+        if (len == 2 && data[0] == MotoSleep::CMD_PREFIX) {
+            _lastCommand = static_cast<char>(data[1]);
+            _lastCommandUs = HostClock::nowUs;
+            _received[data[1] & 0x7f]++;
+        }
+        _stats.writes++;
+        return true;
+    }
+
+    uint16_t getHandle() const override { return _handle; }
+    void setHandle(uint16_t handle) override { _handle = handle; }
+    int64_t nowUs() const override { return static_cast<int64_t>(HostClock::nowUs); }
+
+private:
+    SimBedProfile _profile;
+    SimBedStats _stats = {};
+    ConnectTiming _timing = {};
+    uint32_t _random;
+    uint16_t _handle = 0;
+    bool _handleChecked = false;
+    bool _connected = false;
+    bool _unplugged = false;
+    char _lastCommand = 0;
+    uint64_t _lastCommandUs = 0;
+    uint32_t _received[128] = {};
+
+    void discover() {
+        HostClock::advanceUs(_profile.discoveryUs);
+        _stats.discoveries++;
+        _handle = _profile.handle;
+        _handleChecked = true;
+    }
+
+    bool chance(uint16_t permille) {
+        if (!permille) return false;
+        _random ^= _random << 13;
+        _random ^= _random >> 17;
+        _random ^= _random << 5;
+        return _random % 1000 < permille;
+    }
+};
+
+#endif // SIM_BED_LINK_H
@@ -0,0 +1,191 @@
+#ifndef SIM_CONTROLLER_H
+#define SIM_CONTROLLER_H
+
+#include <Arduino.h>
+#include "BedStore.h"
+#include "BedWorker.h"
+#include "ConfigDefaults.h"
+#include "HADiscovery.h"
+#include "MotoSleepBed.h"
+#include "WorkerPlatform.h"
+#include "SimBedLink.h"
+#include "SimMqtt.h"
+
+// =============================================================================
+// What the BLE worker needs from the platform, on the host: no scanner, no
+// advertisements and no task to wake. Heap blocks come from the test, if it
+// counts them.
+// =============================================================================
+class SimPlatform : public WorkerPlatform {
+public:
+    size_t (*heapBlocks)() = nullptr;
+
+    void notify() override {}
+    bool scanning() const override { return false; }
+    void stopScan() override {}
+    uint32_t lastSeenMs(size_t i) const override { return 0; }
+    void connectFailed(size_t i) override {}
+    void connected(size_t i) override {}
+    size_t allocatedBlocks() const override { return heapBlocks ? heapBlocks() : 0; }
+    int64_t nowUs() const override { return static_cast<int64_t>(HostClock::nowUs); }
+};
+
+// =============================================================================
+// Host model of the controller
+// The firmware's BedWorker, fed by the same MQTT callback path, with
+// SimBedLinks for the beds and a SimMqtt for the broker, all on the host's
+// virtual clock. work() is one wake of the BLE worker task, loop() one pass
+// of the network side. On the ESP32 the network side runs on the other
+// core, so messages scheduled with pressAt() are handed to the worker
+// whenever the clock moves, mid-connect included, stamped with their
+// arrival time. One controller may exist at a time (the MQTT callback is a
+// plain function).
+// =============================================================================
+
+template <size_t Beds>
+class SimController {
+    static_assert(Beds <= MAX_BEDS && Beds <= BED_COUNT, "More simulated beds than MAX_BEDS or BEDS[]");
+
+public:
+    static constexpr uint32_t BREAKER_MIN_MS = BLE_RECONNECT_INTERVAL;
+    static constexpr uint32_t BREAKER_MAX_MS = BLE_RECONNECT_INTERVAL_MAX;
+
+    SimBedLink links[Beds];
+    SimMqtt mqtt;
+    SimPlatform platform;
+
+    SimController() : _worker(_beds, _links, platform), _discovery(mqtt) {
+        _instance = this;
+        _worker.begin();
+        for (size_t i = 0; i < Beds; i++) {
+            links[i] = SimBedLink(static_cast<uint32_t>(i + 1));
+            _links[i] = &links[i];
+            _beds[i] = new MotoSleepBed(BEDS[i], links[i]);
+            const uint8_t address[6] = {0xc8, 0x47, 0x8c, 0x00, 0x00, static_cast<uint8_t>(i + 1)};
+            _beds[i]->setAddress(address);
+            BedStore::saveAddress(BEDS[i].bleName, address);
+            _worker.attachBed(i);
+        }
+        HostClock::onAdvance = onClockAdvanced;
+    }
+
+    ~SimController() {
+        HostClock::onAdvance = nullptr;
+        for (size_t i = 0; i < Beds; i++) {
+            _worker.detachBed(i);
+            delete _beds[i];
+        }
+        _instance = nullptr;
+    }
+
+    void start() {
+        mqtt.begin("sim", 1883, onMessage);
+        connectMqtt();
+    }
+
+    // One pass of loop(): keep the broker connection, deliver messages and
+    // publish the next discovery device
+    void loop() {
+        if (!mqtt.connected()) {
+            connectMqtt();
+        }
+        mqtt.loop();
+        _discovery.servicePass();
+    }
+
+    // One wake of the BLE worker: everything queued, then what fell due
+    void work() {
+        _worker.drain();
+        _worker.service(1000);
+    }
+
+    // Run loop() and the worker until the queues are empty, moving the clock
+    // at least stepMs per round so idle time passes
+    void settle(uint32_t stepMs = 1) {
+        do {
+            loop();
+            work();
+            HostClock::advanceMs(stepMs);
+        } while (busy());
+    }
+
+    // Run for a stretch of virtual time
+    void runFor(uint32_t ms, uint32_t stepMs = 10) {
+        uint64_t until = HostClock::nowUs + ms * 1000ULL;
+        while (HostClock::nowUs < until) {
+            loop();
+            work();
+            HostClock::advanceMs(stepMs);
+        }
+    }
+
+    // Press a command on a bed as Home Assistant would
+    bool press(size_t bed, const char* command, const char* payload = "PRESS") {
+        char topic[96];
+        formatTopic(topic, sizeof(topic), BEDS[bed].id, command);
+        return mqtt.inject(topic, payload);
+    }
+
+    // Press a command that reaches the controller at atUs
+    void pressAt(uint64_t atUs, size_t bed, const char* command, const char* payload = "PRESS") {
+        char topic[96];
+        formatTopic(topic, sizeof(topic), BEDS[bed].id, command);
+        mqtt.injectAt(atUs, topic, payload);
+    }
+
+    // Press a command on a group, by its ID, as Home Assistant would
+    bool pressGroup(const char* group, const char* command, const char* payload = "PRESS") {
+        char topic[96];
+        formatTopic(topic, sizeof(topic), group, command);
+        return mqtt.inject(topic, payload);
+    }
+
+    // Press a command on a group that reaches the controller at atUs
+    void pressGroupAt(uint64_t atUs, const char* group, const char* command, const char* payload = "PRESS") {
+        char topic[96];
+        formatTopic(topic, sizeof(topic), group, command);
+        mqtt.injectAt(atUs, topic, payload);
+    }
+
+    bool busy() const {
+        return _worker.pending() || mqtt.scheduledCount() > 0;
+    }
+
+    MotoSleepBed& bed(size_t i) { return *_beds[i]; }
+    BedWorker& worker() { return _worker; }
+    ConnectionPool& pool() { return _worker.pool(); }
+    CircuitBreaker& breaker(size_t i) { return _worker.breaker(i); }
+    HADiscovery& discovery() { return _discovery; }
+    StageLatencies& latencies(size_t i) { return _worker.latencies(i); }
+    CommandQueueStats queueStats(size_t i) const { return _worker.queueStats(i); }
+    CommandQueueStats stopStats(size_t i) const { return _worker.stopStats(i); }
+
+private:
+    static inline SimController* _instance = nullptr;
+
+    MotoSleepBed* _beds[MAX_BEDS] = {};
+    BedLink* _links[MAX_BEDS] = {};
+    BedWorker _worker;
+    HADiscovery _discovery;
+
+    static void formatTopic(char* topic, size_t size, const char* id, const char* command) {
+        snprintf(topic, size, "motosleep/%s/%s/set", id, command);
+    }
+
+    void connectMqtt() {
+        if (!mqtt.connect(DEVICE_NAME, "", "", "motosleep/status", "offline")) return;
+        mqtt.publish("motosleep/status", "online", true);
+        mqtt.subscribe(MOTOSLEEP_COMMAND_FILTER);
+        _discovery.startPass(BEDS, Beds, BED_GROUPS, BED_GROUP_COUNT, true);
+    }
+
+    static void onMessage(char* topic, uint8_t* payload, unsigned int length) {
+        if (_instance) _instance->_worker.onCommand(topic, payload, length);
+    }
+
+    static void onClockAdvanced() {
+        if (_instance) _instance->mqtt.deliverArrived();
+    }
+};
+
+#endif // SIM_CONTROLLER_H
@@ -0,0 +1,263 @@
+#ifndef SIM_MQTT_H
+#define SIM_MQTT_H
+
+#include <Arduino.h>
+#include <map>
+#include <string>
+#include <string.h>
+#include "CommandQueue.h"
+#include "MqttTransport.h"
+
+// =============================================================================
+// In-process MQTT stand-in
+// Plays both the transport the controller talks to and the broker behind it:
+// retained messages are kept and replayed on subscribe, + and # filters are
+// matched, and the broker can be taken down to exercise reconnects. Messages
+// from other clients are injected with inject() and delivered from loop(), as
+// the real backends do; injectAt() schedules one for a point on the virtual
+// clock, and deliverArrived() hands over those that are due. The
+// controller's own publishes are not looped back.
+// =============================================================================
+class SimMqtt : public MqttTransport {
+public:
+    static constexpr size_t MAX_TOPIC_LENGTH = 127;
+    static constexpr size_t MAX_PAYLOAD = 255;
+    static constexpr size_t MAX_SUBSCRIPTIONS = 16;
+    static constexpr size_t MAX_PUBLISH = 16384;
+
+    void begin(const char* host, uint16_t port, MessageCallback callback) override {
+        _callback = callback;
+    }
+
+    bool connect(const char* clientId, const char* user, const char* password,
+                 const char* willTopic, const char* willPayload) override {
+        _willTopic = willTopic;
+        _willPayload = willPayload;
+        _connectAttempts++;
+        if (_brokerDown) return false;
+        _connected = true;
+        _subscriptionCount = 0;
+        return true;
+    }
+
+    bool connected() override { return _connected; }
+
+    void loop() override {
+        Inbound message;
+        while (_connected && _inbox.pop(message)) {
+            _messageUs = HostClock::nowUs;
+            if (_callback) {
+                _callback(message.topic, reinterpret_cast<uint8_t*>(message.payload), message.length);
+            }
+        }
+
+        deliverArrived();
+    }
+
+    bool subscribe(const char* filter) override {
+        if (!_connected || _subscriptionCount == MAX_SUBSCRIPTIONS || strlen(filter) > MAX_TOPIC_LENGTH) return false;
+        strcpy(_subscriptions[_subscriptionCount++], filter);
+
+        // New subscriptions get the retained messages they match
+        for (const auto& entry : _retained) {
+            if (topicMatches(filter, entry.first.c_str())) {
+                queue(entry.first.c_str(), entry.second.data(), entry.second.size());
+            }
+        }
+        return true;
+    }
+
+    bool publish(const char* topic, const char* payload, bool retained) override {
+        return deliver(topic, payload, strlen(payload), retained);
+    }
+
+    bool beginPublish(const char* topic, size_t length, bool retained) override {
+        if (!_connected || length > MAX_PUBLISH || strlen(topic) > MAX_TOPIC_LENGTH) return false;
+        strcpy(_publishTopic, topic);
+        _publishExpected = length;
+        _publishLength = 0;
+        _publishRetained = retained;
+        return true;
+    }
+
+    size_t write(const uint8_t* data, size_t len) override {
+        if (_publishLength + len > _publishExpected) len = _publishExpected - _publishLength;
+        memcpy(_publishBuffer + _publishLength, data, len);
+        _publishLength += len;
+        return len;
+    }
+
+    bool endPublish() override {
+        if (_publishLength != _publishExpected) {
+            _malformedPublishes++;
+            return false;
+        }
+        return deliver(_publishTopic, _publishBuffer, _publishLength, _publishRetained);
+    }
+
+    int state() override { return _connected ? 0 : -1; }
+
+    // ---- Broker side ----
+
+    // A message from another client, such as Home Assistant pressing a button
+    bool inject(const char* topic, const char* payload, bool retained = false) {
+        size_t length = strlen(payload);
+        if (retained) retain(topic, payload, length);
+        return subscribed(topic) && queue(topic, payload, length);
+    }
+
+    // A message from another client that reaches the controller at atUs.
+    // Unlike inject() there is no inbox limit: the simulation decides how
+    // fast messages arrive.
+    void injectAt(uint64_t atUs, const char* topic, const char* payload) {
+        _scheduled.emplace(atUs, std::make_pair(std::string(topic), std::string(payload)));
+    }
+
+    size_t scheduledCount() const { return _scheduled.size(); }
+
+    // Deliver the injectAt() messages due by now, each with the clock set
+    // back to its arrival time, as the network side would have taken them
+    // in while the rest of the controller was busy
+    void deliverArrived() {
+        uint64_t now = HostClock::nowUs;
+        while (_connected && !_scheduled.empty() && _scheduled.begin()->first <= now) {
+            auto next = _scheduled.begin();
+            std::string topic = next->second.first;
+            std::string payload = next->second.second;
+            _messageUs = next->first;
+            _scheduled.erase(next);
+            if (_callback && subscribed(topic.c_str())) {
+                HostClock::nowUs = _messageUs;
+                _callback(&topic[0], reinterpret_cast<uint8_t*>(&payload[0]), payload.size());
+                HostClock::nowUs = now;
+            }
+        }
+    }
+
+    // When the message being delivered reached the controller: its injectAt()
+    // time, or the delivering loop() for inject()
+    uint64_t messageUs() const { return _messageUs; }
+
+    // The broker goes away: the client is disconnected and its will published
+    void setBrokerDown(bool down) {
+        _brokerDown = down;
+        if (down && _connected) {
+            _connected = false;
+            if (_willTopic) retain(_willTopic, _willPayload, strlen(_willPayload));
+        }
+    }
+
+    // Retained payload on a topic, nullptr if none
+    const char* retained(const char* topic) const {
+        auto it = _retained.find(topic);
+        return it == _retained.end() ? nullptr : it->second.c_str();
+    }
+
+    size_t retainedCount(const char* filter) const {
+        size_t count = 0;
+        for (const auto& entry : _retained) {
+            if (topicMatches(filter, entry.first.c_str())) count++;
+        }
+        return count;
+    }
+
+    uint32_t publishes() const { return _publishes; }
+    uint64_t publishedBytes() const { return _publishedBytes; }
+    size_t largestPublish() const { return _largestPublish; }
+    uint32_t connectAttempts() const { return _connectAttempts; }
+    uint32_t malformedPublishes() const { return _malformedPublishes; }
+    uint32_t droppedInbound() const { return _droppedInbound; }
+
+    // MQTT filter matching: + is one level, a trailing # any number of levels
+    static bool topicMatches(const char* filter, const char* topic) {
+        while (*filter) {
+            if (*filter == '#') return true;
+            if (*filter == '+') {
+                while (*topic && *topic != '/') topic++;
+                filter++;
+                continue;
+            }
+            if (*filter != *topic) return false;
+            filter++;
+            topic++;
+        }
+        return *topic == '\0';
+    }
+
+private:
+    struct Inbound {
+        char topic[MAX_TOPIC_LENGTH + 1];
+        char payload[MAX_PAYLOAD + 1];
+        unsigned int length;
+    };
+
+    MessageCallback _callback = nullptr;
+    bool _connected = false;
+    bool _brokerDown = false;
+    const char* _willTopic = nullptr;
+    const char* _willPayload = nullptr;
+
+    char _subscriptions[MAX_SUBSCRIPTIONS][MAX_TOPIC_LENGTH + 1] = {};
+    size_t _subscriptionCount = 0;
+    SpscRing<Inbound, 64> _inbox;
+    std::multimap<uint64_t, std::pair<std::string, std::string>> _scheduled;
+    uint64_t _messageUs = 0;
+    std::map<std::string, std::string> _retained;
+
+    char _publishTopic[MAX_TOPIC_LENGTH + 1] = {};
+    char _publishBuffer[MAX_PUBLISH];
+    size_t _publishExpected = 0;
+    size_t _publishLength = 0;
+    bool _publishRetained = false;
+
+    uint32_t _publishes = 0;
+    uint64_t _publishedBytes = 0;
+    size_t _largestPublish = 0;
+    uint32_t _connectAttempts = 0;
+    uint32_t _malformedPublishes = 0;
+    uint32_t _droppedInbound = 0;
+
+    bool subscribed(const char* topic) const {
+        for (size_t i = 0; i < _subscriptionCount; i++) {
+            if (topicMatches(_subscriptions[i], topic)) return true;
+        }
+        return false;
+    }
+
+    bool queue(const char* topic, const char* payload, size_t length) {
+        Inbound message;
+        if (strlen(topic) > MAX_TOPIC_LENGTH || length > MAX_PAYLOAD) {
+            _droppedInbound++;
+            return false;
+        }
+        strcpy(message.topic, topic);
+        memcpy(message.payload, payload, length);
+        message.payload[length] = '\0';
+        message.length = length;
+        if (!_inbox.push(message)) {
+            _droppedInbound++;
+            return false;
+        }
+        return true;
+    }
+
+    bool deliver(const char* topic, const char* payload, size_t length, bool retained) {
+        if (!_connected) return false;
+        _publishes++;
+        _publishedBytes += length;
+        if (length > _largestPublish) _largestPublish = length;
+        if (retained) retain(topic, payload, length);
+        return true;
+    }
+
+    // An empty retained payload clears the topic
+    void retain(const char* topic, const char* payload, size_t length) {
+        if (!length) {
+            _retained.erase(topic);
+        } else {
+            _retained[topic].assign(payload, length);
+        }
+    }
+};
+
+#endif // SIM_MQTT_H
@@ -0,0 +1,4 @@
+// Host builds take their settings from HostConfig.h, forced in ahead of
+// every source file; this only satisfies #include "config.h" when the
+// project has no config.h of its own
+#include "HostConfig.h"
@@ -0,0 +1,179 @@
+// =============================================================================
+// CircuitBreaker host tests
+// Run with: pio test -e native -f test_circuit_breaker
+// =============================================================================
+#include <unity.h>
+#include "CircuitBreaker.h"
+
+static constexpr uint32_t MIN_MS = 30000;
+static constexpr uint32_t MAX_MS = 300000;
+
+static CircuitBreaker breaker;
+
+void setUp() {
+    breaker.setTiming(3, MIN_MS, MAX_MS);
+    breaker.reset();
+}
+
+void tearDown() {}
+
+// Fail threshold connects at nowMs
+static void trip(uint32_t nowMs, uint32_t random = 0) {
+    for (int i = 0; i < 3; i++) breaker.failure(nowMs, random);
+}
+
+static void test_opens_after_threshold() {
+    breaker.failure(0, 0);
+    breaker.failure(0, 0);
+    TEST_ASSERT_EQUAL(BreakerState::CLOSED, breaker.state());
+    TEST_ASSERT_TRUE(breaker.allow(0, 0));
+
+    breaker.failure(0, 0);
+    TEST_ASSERT_EQUAL(BreakerState::OPEN, breaker.state());
+    TEST_ASSERT_EQUAL_UINT32(1, breaker.getStats().opens);
+}
+
+static void test_success_resets_the_count() {
+    breaker.failure(0, 0);
+    breaker.failure(0, 0);
+    breaker.success();
+    breaker.failure(0, 0);
+    breaker.failure(0, 0);
+    TEST_ASSERT_EQUAL(BreakerState::CLOSED, breaker.state());
+    TEST_ASSERT_EQUAL_UINT32(0, breaker.getStats().closes);
+}
+
+static void test_open_fails_fast() {
+    trip(1000);
+    TEST_ASSERT_FALSE(breaker.allow(1000, 0));
+    TEST_ASSERT_FALSE(breaker.allow(2000, 0));
+    TEST_ASSERT_EQUAL_UINT32(2, breaker.getStats().fastFails);
+    TEST_ASSERT_EQUAL(BreakerState::OPEN, breaker.state());
+}
+
+static uint32_t openMsFor(uint32_t random) {
+    breaker.reset();
+    trip(0, random);
+    return breaker.getStats().openMs;
+}
+
+static void test_wait_is_jittered_within_a_quarter() {
+    // The spread is half the wait: random picks one of spread + 1 steps
+    const uint32_t spread = MIN_MS / 2;
+    TEST_ASSERT_EQUAL_UINT32(MIN_MS - MIN_MS / 4, openMsFor(0));
+    TEST_ASSERT_EQUAL_UINT32(MIN_MS + MIN_MS / 4, openMsFor(spread));
+    TEST_ASSERT_EQUAL_UINT32(MIN_MS - MIN_MS / 4, openMsFor(spread + 1));
+
+    for (uint32_t random = 1; random < UINT32_MAX / 2; random = random * 3 + 1) {
+        uint32_t openMs = openMsFor(random);
+        TEST_ASSERT_TRUE(openMs >= MIN_MS - MIN_MS / 4 && openMs <= MIN_MS + MIN_MS / 4);
+    }
+}
+
+static void test_trial_after_the_wait() {
+    trip(1000);
+    uint32_t openMs = breaker.getStats().openMs;
+    TEST_ASSERT_EQUAL_UINT32(openMs, breaker.untilTrialMs(1000, 0));
+    TEST_ASSERT_EQUAL_UINT32(1, breaker.untilTrialMs(1000 + openMs - 1, 0));
+    TEST_ASSERT_FALSE(breaker.allow(1000 + openMs - 1, 0));
+
+    TEST_ASSERT_EQUAL_UINT32(0, breaker.untilTrialMs(1000 + openMs, 0));
+    TEST_ASSERT_TRUE(breaker.allow(1000 + openMs, 0));
+    TEST_ASSERT_EQUAL(BreakerState::HALF_OPEN, breaker.state());
+    TEST_ASSERT_EQUAL_UINT32(1, breaker.getStats().halfOpens);
+
+    breaker.success();
+    TEST_ASSERT_EQUAL(BreakerState::CLOSED, breaker.state());
+    TEST_ASSERT_EQUAL_UINT32(1, breaker.getStats().closes);
+}
+
+static void test_failed_trial_doubles_the_wait_up_to_max() {
+    uint32_t nowMs = 0;
+    trip(nowMs);
+    uint32_t expected = MIN_MS;
+    for (int round = 0; round < 8; round++) {
+        // random 0 picks the shortest wait: three quarters of the backoff
+        TEST_ASSERT_EQUAL_UINT32(expected - expected / 4, breaker.getStats().openMs);
+        nowMs += breaker.getStats().openMs;
+        TEST_ASSERT_TRUE(breaker.allow(nowMs, 0));
+        breaker.failure(nowMs, 0);
+        expected = expected > MAX_MS / 2 ? MAX_MS : expected * 2;
+    }
+    TEST_ASSERT_EQUAL_UINT32(MAX_MS - MAX_MS / 4, breaker.getStats().openMs);
+    TEST_ASSERT_EQUAL_UINT32(1, breaker.getStats().opens);
+    TEST_ASSERT_EQUAL_UINT32(8, breaker.getStats().halfOpens);
+
+    // A good trial starts the next outage from the shortest wait again
+    nowMs += breaker.getStats().openMs;
+    TEST_ASSERT_TRUE(breaker.allow(nowMs, 0));
+    breaker.success();
+    trip(nowMs);
+    TEST_ASSERT_EQUAL_UINT32(MIN_MS - MIN_MS / 4, breaker.getStats().openMs);
+}
+
+static void test_advertisement_ends_the_wait() {
+    trip(10000);
+    // Heard before the breaker opened: still waiting
+    TEST_ASSERT_FALSE(breaker.allow(11000, 9000));
+    TEST_ASSERT_TRUE(breaker.untilTrialMs(11000, 10000) > 0);
+
+    TEST_ASSERT_EQUAL_UINT32(0, breaker.untilTrialMs(11000, 10500));
+    TEST_ASSERT_TRUE(breaker.allow(11000, 10500));
+    TEST_ASSERT_EQUAL(BreakerState::HALF_OPEN, breaker.state());
+}
+
+static void test_cancelled_trial_stays_due() {
+    trip(0);
+    uint32_t openMs = breaker.getStats().openMs;
+    TEST_ASSERT_TRUE(breaker.allow(openMs, 0));
+
+    // No connection slot: back to open with the wait still over, so the
+    // worker's trial connect picks it up again
+    breaker.cancelTrial();
+    TEST_ASSERT_EQUAL(BreakerState::OPEN, breaker.state());
+    TEST_ASSERT_EQUAL_UINT32(0, breaker.getStats().halfOpens);
+    TEST_ASSERT_EQUAL_UINT32(openMs, breaker.getStats().openMs);
+    TEST_ASSERT_EQUAL_UINT32(0, breaker.untilTrialMs(openMs + 5, 0));
+
+    TEST_ASSERT_TRUE(breaker.allow(openMs + 5, 0));
+    breaker.failure(openMs + 5, 0);
+    TEST_ASSERT_EQUAL_UINT32(2 * MIN_MS - MIN_MS / 2, breaker.getStats().openMs);
+}
+
+static void test_cancel_only_undoes_a_trial() {
+    breaker.cancelTrial();
+    TEST_ASSERT_EQUAL(BreakerState::CLOSED, breaker.state());
+
+    trip(0);
+    breaker.cancelTrial();
+    TEST_ASSERT_EQUAL(BreakerState::OPEN, breaker.state());
+    TEST_ASSERT_TRUE(breaker.untilTrialMs(0, 0) > 0);
+}
+
+static void test_reset() {
+    trip(0);
+    breaker.allow(0, 0);
+    breaker.reset();
+
+    BreakerStats stats = breaker.getStats();
+    TEST_ASSERT_EQUAL(BreakerState::CLOSED, stats.state);
+    TEST_ASSERT_EQUAL_UINT32(0, stats.opens);
+    TEST_ASSERT_EQUAL_UINT32(0, stats.fastFails);
+    TEST_ASSERT_TRUE(breaker.allow(0, 0));
+    TEST_ASSERT_EQUAL_STRING("closed", breakerStateName(stats.state));
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_opens_after_threshold);
+    RUN_TEST(test_success_resets_the_count);
+    RUN_TEST(test_open_fails_fast);
+    RUN_TEST(test_wait_is_jittered_within_a_quarter);
+    RUN_TEST(test_trial_after_the_wait);
+    RUN_TEST(test_failed_trial_doubles_the_wait_up_to_max);
+    RUN_TEST(test_advertisement_ends_the_wait);
+    RUN_TEST(test_cancelled_trial_stays_due);
+    RUN_TEST(test_cancel_only_undoes_a_trial);
+    RUN_TEST(test_reset);
+    return UNITY_END();
+}
@@ -0,0 +1,134 @@
+// =============================================================================
+// Burst coalescing host tests
+// Run with: pio test -e native -f test_command_coalescer
+// =============================================================================
+#include <unity.h>
+#include "CommandCoalescer.h"
+
+using namespace MotoSleep;
+
+static constexpr uint32_t WINDOW_US = 300000;
+
+typedef CommandQueue<16> Queue;
+
+void setUp() {}
+
+void tearDown() {}
+
+// Take the oldest press off the queue and fold its followers into it
+static uint32_t next(Queue& queue, QueuedCommand& cmd) {
+    queue.dequeue(cmd);
+    return coalesce(queue, cmd, WINDOW_US);
+}
+
+static void test_motor_presses_repeat() {
+    Queue queue;
+    queue.enqueue(Motor::HEAD_UP, 0);
+    queue.enqueue(Motor::HEAD_UP, 100000);
+    queue.enqueue(Motor::HEAD_UP, 200000);
+
+    QueuedCommand cmd;
+    TEST_ASSERT_EQUAL_UINT32(3, next(queue, cmd));
+    TEST_ASSERT_EQUAL_CHAR(Motor::HEAD_UP, cmd.cmdChar);
+    TEST_ASSERT_EQUAL_UINT32(0, queue.getStats().depth);
+    TEST_ASSERT_EQUAL_UINT32(2, queue.getStats().coalesced);
+}
+
+static void test_window_counts_from_the_previous_press() {
+    Queue queue;
+    // Each gap is inside the window even though the last is not within
+    // WINDOW_US of the first; the fourth comes after a pause
+    queue.enqueue(Motor::FEET_DOWN, 0);
+    queue.enqueue(Motor::FEET_DOWN, WINDOW_US);
+    queue.enqueue(Motor::FEET_DOWN, 2 * WINDOW_US);
+    queue.enqueue(Motor::FEET_DOWN, 3 * WINDOW_US + 1);
+
+    QueuedCommand cmd;
+    TEST_ASSERT_EQUAL_UINT32(3, next(queue, cmd));
+    TEST_ASSERT_EQUAL_UINT32(1, next(queue, cmd));
+    TEST_ASSERT_EQUAL_UINT32(3 * WINDOW_US + 1, cmd.enqueuedUs);
+}
+
+static void test_merging_stops_at_a_different_command() {
+    Queue queue;
+    queue.enqueue(Motor::HEAD_UP, 0);
+    queue.enqueue(Motor::HEAD_DOWN, 1000);
+    queue.enqueue(Motor::HEAD_UP, 2000);
+
+    QueuedCommand cmd;
+    TEST_ASSERT_EQUAL_UINT32(1, next(queue, cmd));
+    TEST_ASSERT_EQUAL_UINT32(2, queue.getStats().depth);
+    TEST_ASSERT_EQUAL_UINT32(1, next(queue, cmd));
+    TEST_ASSERT_EQUAL_CHAR(Motor::HEAD_DOWN, cmd.cmdChar);
+    TEST_ASSERT_EQUAL_UINT32(0, queue.getStats().coalesced);
+}
+
+static void test_toggles_cancel_in_pairs() {
+    Queue queue;
+    queue.enqueue(Light::TOGGLE, 0);
+    queue.enqueue(Light::TOGGLE, 1000);
+
+    QueuedCommand cmd;
+    TEST_ASSERT_EQUAL_UINT32(0, next(queue, cmd));
+    TEST_ASSERT_EQUAL_UINT32(1, queue.getStats().coalesced);
+
+    queue.enqueue(Light::TOGGLE, 10000000);
+    queue.enqueue(Light::TOGGLE, 10001000);
+    queue.enqueue(Light::TOGGLE, 10002000);
+    TEST_ASSERT_EQUAL_UINT32(1, next(queue, cmd));
+    TEST_ASSERT_EQUAL_UINT32(0, queue.getStats().depth);
+}
+
+static void test_newest_preset_supersedes() {
+    Queue queue;
+    queue.enqueue(Preset::HOME, 0);
+    queue.enqueue(Preset::ZERO_G, 1000);
+    queue.enqueue(Preset::TV, 2000);
+    queue.enqueue(Motor::HEAD_UP, 3000);
+
+    QueuedCommand cmd;
+    TEST_ASSERT_EQUAL_UINT32(1, next(queue, cmd));
+    TEST_ASSERT_EQUAL_CHAR(Preset::TV, cmd.cmdChar);
+    TEST_ASSERT_EQUAL_UINT32(2000, cmd.enqueuedUs);
+    TEST_ASSERT_EQUAL_UINT32(2, queue.getStats().coalesced);
+
+    // The motor press after the presets still runs, in order
+    TEST_ASSERT_EQUAL_UINT32(1, next(queue, cmd));
+    TEST_ASSERT_EQUAL_CHAR(Motor::HEAD_UP, cmd.cmdChar);
+}
+
+static void test_other_commands_are_sent_as_is() {
+    Queue queue;
+    queue.enqueue(Massage::HEAD_STEP, 0);
+    queue.enqueue(Massage::HEAD_STEP, 1000);
+
+    QueuedCommand cmd;
+    TEST_ASSERT_EQUAL_UINT32(1, next(queue, cmd));
+    TEST_ASSERT_EQUAL_UINT32(1, queue.getStats().depth);
+    queue.dequeue(cmd);
+
+    // Holds aren't presses: a hold isn't merged, and a press doesn't
+    // swallow the hold behind it
+    queue.enqueue(Motor::HEAD_UP, 0, CommandAction::HOLD_START);
+    queue.enqueue(Motor::HEAD_UP, 1000, CommandAction::HOLD_START);
+    TEST_ASSERT_EQUAL_UINT32(1, next(queue, cmd));
+    queue.dequeue(cmd);
+
+    queue.enqueue(Motor::HEAD_UP, 2000);
+    queue.enqueue(Motor::HEAD_UP, 3000, CommandAction::HOLD_STOP);
+    TEST_ASSERT_EQUAL_UINT32(1, next(queue, cmd));
+    TEST_ASSERT_EQUAL(CommandAction::PRESS, cmd.action);
+    TEST_ASSERT_EQUAL_UINT32(1, queue.getStats().depth);
+    TEST_ASSERT_EQUAL_UINT32(0, queue.getStats().coalesced);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_motor_presses_repeat);
+    RUN_TEST(test_window_counts_from_the_previous_press);
+    RUN_TEST(test_merging_stops_at_a_different_command);
+    RUN_TEST(test_toggles_cancel_in_pairs);
+    RUN_TEST(test_newest_preset_supersedes);
+    RUN_TEST(test_other_commands_are_sent_as_is);
+    return UNITY_END();
+}
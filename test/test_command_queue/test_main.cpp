@@ -0,0 +1,240 @@
+// =============================================================================
+// SpscRing / CommandQueue host tests and benchmark
+// The benchmark times the ring against the mutex-guarded queue it stands in
+// for between the network and BLE tasks.
+// Run with: pio test -e native -f test_command_queue -v
+// =============================================================================
+#include <unity.h>
+#include <stdio.h>
+#include <chrono>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include "CommandQueue.h"
+
+void setUp() {}
+void tearDown() {}
+
+static void test_ring_fifo_and_bounds() {
+    SpscRing<uint32_t, 4> ring;
+    uint32_t value = 0;
+
+    TEST_ASSERT_TRUE(ring.empty());
+    TEST_ASSERT_FALSE(ring.pop(value));
+    TEST_ASSERT_FALSE(ring.peek(value));
+
+    for (uint32_t i = 0; i < 4; i++) {
+        TEST_ASSERT_TRUE(ring.push(i));
+    }
+    TEST_ASSERT_FALSE(ring.push(99));
+    TEST_ASSERT_EQUAL_UINT32(4, ring.size());
+
+    TEST_ASSERT_TRUE(ring.peek(value));
+    TEST_ASSERT_EQUAL_UINT32(0, value);
+    for (uint32_t i = 0; i < 4; i++) {
+        TEST_ASSERT_TRUE(ring.pop(value));
+        TEST_ASSERT_EQUAL_UINT32(i, value);
+    }
+    TEST_ASSERT_TRUE(ring.empty());
+}
+
+static void test_ring_wraps() {
+    SpscRing<uint32_t, 2> ring;
+    uint32_t value = 0;
+
+    for (uint32_t i = 0; i < 1000; i++) {
+        TEST_ASSERT_TRUE(ring.push(i));
+        TEST_ASSERT_TRUE(ring.pop(value));
+        TEST_ASSERT_EQUAL_UINT32(i, value);
+    }
+    TEST_ASSERT_TRUE(ring.empty());
+}
+
+static void test_queue_counters() {
+    CommandQueue<4> queue;
+    QueuedCommand cmd;
+
+    for (uint32_t i = 0; i < 6; i++) {
+        queue.enqueue('A', 1000 + i);
+    }
+    CommandQueueStats stats = queue.getStats();
+    TEST_ASSERT_EQUAL_UINT32(4, stats.enqueued);
+    TEST_ASSERT_EQUAL_UINT32(2, stats.dropped);
+    TEST_ASSERT_EQUAL_UINT32(4, stats.depth);
+    TEST_ASSERT_EQUAL_UINT32(4, stats.highWater);
+
+    TEST_ASSERT_TRUE(queue.dequeue(cmd));
+    TEST_ASSERT_EQUAL_CHAR('A', cmd.cmdChar);
+    TEST_ASSERT_EQUAL_UINT32(1000, cmd.enqueuedUs);
+    queue.recordWrite(cmd, 1300);
+    TEST_ASSERT_TRUE(queue.dequeue(cmd));
+    queue.recordWrite(cmd, 1101);
+    TEST_ASSERT_TRUE(queue.dequeue(cmd));
+    queue.recordFailure();
+    TEST_ASSERT_TRUE(queue.dequeue(cmd));
+    queue.recordCoalesced();
+
+    stats = queue.getStats();
+    TEST_ASSERT_EQUAL_UINT32(2, stats.written);
+    TEST_ASSERT_EQUAL_UINT32(1, stats.failed);
+    TEST_ASSERT_EQUAL_UINT32(1, stats.coalesced);
+    TEST_ASSERT_EQUAL_UINT32(0, stats.depth);
+    TEST_ASSERT_EQUAL_UINT32(100, stats.lastLatencyUs);
+    TEST_ASSERT_EQUAL_UINT32(300, stats.maxLatencyUs);
+    TEST_ASSERT_EQUAL_UINT32(200, stats.avgLatencyUs);
+}
+
+static void test_queue_keeps_action_and_arg() {
+    CommandQueue<2> queue;
+    QueuedCommand cmd;
+
+    queue.enqueue(0, 5, CommandAction::POSITION_SET, 42);
+    TEST_ASSERT_TRUE(queue.peek(cmd));
+    TEST_ASSERT_TRUE(cmd.action == CommandAction::POSITION_SET);
+    TEST_ASSERT_EQUAL_UINT8(42, cmd.arg);
+    TEST_ASSERT_EQUAL_UINT32(1, queue.depth());
+}
+
+// One producer and one consumer thread hammering a small ring: every item
+// must arrive exactly once and in order, and nothing may be dropped that the
+// producer saw as accepted.
+static void test_ring_under_load() {
+    static SpscRing<uint32_t, 8> ring;
+    const uint32_t items = 2000000;
+    uint32_t received = 0;
+    uint32_t outOfOrder = 0;
+    uint32_t retries = 0;
+    auto start = std::chrono::steady_clock::now();
+
+    std::thread producer([&]() {
+        for (uint32_t i = 0; i < items; i++) {
+            while (!ring.push(i)) {
+                retries++;
+                std::this_thread::yield();
+            }
+        }
+    });
+
+    uint32_t value = 0;
+    while (received < items) {
+        if (!ring.pop(value)) {
+            std::this_thread::yield();
+            continue;
+        }
+        if (value != received) outOfOrder++;
+        received++;
+    }
+    producer.join();
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    char msg[128];
+    snprintf(msg, sizeof(msg), "%u items through an 8-slot ring in %.2f s (%.1f M/s), %u full-ring retries",
+             static_cast<unsigned>(items), seconds, items / seconds / 1e6, static_cast<unsigned>(retries));
+    TEST_MESSAGE(msg);
+    TEST_ASSERT_EQUAL_UINT32(0, outOfOrder);
+    TEST_ASSERT_TRUE(ring.empty());
+}
+
+// The same under load through CommandQueue: accepted + dropped = offered, and
+// every accepted command is dequeued with its own timestamp.
+static void test_queue_under_load() {
+    static CommandQueue<8> queue;
+    const uint32_t offered = 500000;
+    uint32_t accepted = 0;
+    std::atomic<bool> done{false};
+
+    std::thread producer([&]() {
+        for (uint32_t i = 0; i < offered; i++) {
+            if (queue.enqueue('A' + (i % 26), i)) accepted++;
+        }
+        done.store(true, std::memory_order_release);
+    });
+
+    uint32_t dequeued = 0;
+    uint32_t lastStamp = 0;
+    bool ordered = true;
+    QueuedCommand cmd;
+    for (;;) {
+        bool finished = done.load(std::memory_order_acquire);
+        while (queue.dequeue(cmd)) {
+            if (dequeued && cmd.enqueuedUs <= lastStamp) ordered = false;
+            if (cmd.cmdChar != 'A' + static_cast<char>(cmd.enqueuedUs % 26)) ordered = false;
+            lastStamp = cmd.enqueuedUs;
+            queue.recordWrite(cmd, cmd.enqueuedUs);
+            dequeued++;
+        }
+        if (finished) break;
+        std::this_thread::yield();
+    }
+    producer.join();
+
+    CommandQueueStats stats = queue.getStats();
+    TEST_ASSERT_TRUE(ordered);
+    TEST_ASSERT_EQUAL_UINT32(accepted, dequeued);
+    TEST_ASSERT_EQUAL_UINT32(offered, stats.enqueued + stats.dropped);
+    TEST_ASSERT_EQUAL_UINT32(accepted, stats.written);
+    TEST_ASSERT_LESS_OR_EQUAL_UINT32(8, stats.highWater);
+}
+
+template <typename F>
+static double nsPerItem(uint32_t items, F body) {
+    auto start = std::chrono::steady_clock::now();
+    body();
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    return std::chrono::duration<double, std::nano>(elapsed).count() / items;
+}
+
+// Push and pop cost with no contention, the common case: a command crosses
+// from the network task to the BLE task and the ring is otherwise idle
+static void test_ring_benchmark() {
+    static SpscRing<QueuedCommand, 8> ring;
+    std::deque<QueuedCommand> locked;
+    std::mutex lock;
+    const uint32_t items = 2000000;
+    volatile uint32_t sink = 0;
+
+    double ringNs = nsPerItem(items, [&]() {
+        QueuedCommand cmd = {};
+        for (uint32_t i = 0; i < items; i++) {
+            cmd.enqueuedUs = i;
+            ring.push(cmd);
+            ring.pop(cmd);
+            sink = sink + cmd.enqueuedUs;
+        }
+    });
+
+    double lockedNs = nsPerItem(items, [&]() {
+        QueuedCommand cmd = {};
+        for (uint32_t i = 0; i < items; i++) {
+            cmd.enqueuedUs = i;
+            {
+                std::lock_guard<std::mutex> guard(lock);
+                if (locked.size() < 8) locked.push_back(cmd);
+            }
+            {
+                std::lock_guard<std::mutex> guard(lock);
+                cmd = locked.front();
+                locked.pop_front();
+            }
+            sink = sink + cmd.enqueuedUs;
+        }
+    });
+
+    char msg[128];
+    snprintf(msg, sizeof(msg), "Push + pop: SPSC ring %.1f ns, mutex + deque %.1f ns (%.1fx)",
+             ringNs, lockedNs, lockedNs / ringNs);
+    TEST_MESSAGE(msg);
+    TEST_ASSERT_TRUE(ringNs < lockedNs);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_ring_fifo_and_bounds);
+    RUN_TEST(test_ring_wraps);
+    RUN_TEST(test_queue_counters);
+    RUN_TEST(test_queue_keeps_action_and_arg);
+    RUN_TEST(test_ring_under_load);
+    RUN_TEST(test_queue_under_load);
+    RUN_TEST(test_ring_benchmark);
+    return UNITY_END();
+}
@@ -0,0 +1,143 @@
+// =============================================================================
+// CommandTable host tests and benchmark
+// Checks the perfect hash against every command table, then times it against
+// the five linear scans it replaced.
+// Run with: pio test -e native -f test_command_table -v
+// =============================================================================
+#include <unity.h>
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+#include "CommandTable.h"
+
+using namespace MotoSleep;
+
+void setUp() {}
+void tearDown() {}
+
+struct Table {
+    const Command* commands;
+    size_t count;
+    Category category;
+};
+
+static const Table TABLES[] = {
+    {MOTOR_COMMANDS, MOTOR_COMMAND_COUNT, Category::MOTOR},
+    {PRESET_COMMANDS, PRESET_COMMAND_COUNT, Category::PRESET},
+    {PROGRAM_COMMANDS, PROGRAM_COMMAND_COUNT, Category::PROGRAM},
+    {MASSAGE_COMMANDS, MASSAGE_COMMAND_COUNT, Category::MASSAGE},
+    {LIGHT_COMMANDS, LIGHT_COMMAND_COUNT, Category::LIGHT},
+};
+
+// The lookup mqttCallback used before the table: each table in turn, one
+// string compare per entry
+static const Command* linearFind(const char* name, Category& category) {
+    for (const Table& table : TABLES) {
+        for (size_t i = 0; i < table.count; i++) {
+            if (strcmp(table.commands[i].name, name) == 0) {
+                category = table.category;
+                return &table.commands[i];
+            }
+        }
+    }
+    return nullptr;
+}
+
+static void test_finds_every_command() {
+    size_t found = 0;
+    for (const Table& table : TABLES) {
+        for (size_t i = 0; i < table.count; i++) {
+            const Command& cmd = table.commands[i];
+            const CommandEntry* entry = findCommand(cmd.name, strlen(cmd.name));
+            TEST_ASSERT_NOT_NULL(entry);
+            TEST_ASSERT_TRUE(entry->command == &cmd);
+            TEST_ASSERT_TRUE(entry->category == table.category);
+            TEST_ASSERT_EQUAL_CHAR(cmd.cmdChar, entry->command->cmdChar);
+            found++;
+        }
+    }
+    TEST_ASSERT_EQUAL_UINT32(23, found);
+}
+
+static void test_rejects_unknown_names() {
+    static const char* const UNKNOWN[] = {
+        "", "head", "head_up_", "Head_up", "preset_memory_3", "massage", "light_toggl", "set",
+    };
+    for (const char* name : UNKNOWN) {
+        TEST_ASSERT_NULL(findCommand(name, strlen(name)));
+    }
+}
+
+static void test_matches_on_length_not_terminator() {
+    // Topic segments are not null-terminated: "head_up/set"
+    const char* segment = "head_up/set";
+    const CommandEntry* entry = findCommand(segment, 7);
+    TEST_ASSERT_NOT_NULL(entry);
+    TEST_ASSERT_EQUAL_CHAR(Motor::HEAD_UP, entry->command->cmdChar);
+    TEST_ASSERT_NULL(findCommand(segment, 8));
+}
+
+static void test_stop_priority() {
+    TEST_ASSERT_TRUE(findCommand("massage_stop", 12)->priority == Priority::STOP);
+    TEST_ASSERT_TRUE(findCommand("massage_head_off", 16)->priority == Priority::STOP);
+    TEST_ASSERT_TRUE(findCommand("massage_foot_off", 16)->priority == Priority::STOP);
+    TEST_ASSERT_TRUE(findCommand("massage_head_step", 17)->priority == Priority::NORMAL);
+    TEST_ASSERT_TRUE(findCommand("head_up", 7)->priority == Priority::NORMAL);
+}
+
+// Every name once per round, copied into writable buffers so the compiler
+// cannot fold the lookups away. Best of several runs, in ns per lookup.
+static double timeLookups(bool hashed, uint32_t rounds) {
+    static char names[23][24];
+    static size_t lengths[23];
+    size_t count = 0;
+    for (const Table& table : TABLES) {
+        for (size_t i = 0; i < table.count; i++) {
+            strcpy(names[count], table.commands[i].name);
+            lengths[count] = strlen(names[count]);
+            count++;
+        }
+    }
+
+    volatile uintptr_t sink = 0;
+    double best = 1e30;
+    for (int run = 0; run < 5; run++) {
+        auto start = std::chrono::steady_clock::now();
+        for (uint32_t r = 0; r < rounds; r++) {
+            for (size_t i = 0; i < count; i++) {
+                if (hashed) {
+                    sink = sink + reinterpret_cast<uintptr_t>(findCommand(names[i], lengths[i]));
+                } else {
+                    Category category;
+                    sink = sink + reinterpret_cast<uintptr_t>(linearFind(names[i], category));
+                }
+            }
+        }
+        auto elapsed = std::chrono::steady_clock::now() - start;
+        double ns = std::chrono::duration<double, std::nano>(elapsed).count() / (static_cast<double>(rounds) * count);
+        if (ns < best) best = ns;
+    }
+    return best;
+}
+
+static void test_benchmark_against_linear_scan() {
+    const uint32_t rounds = 20000;
+    double scan = timeLookups(false, rounds);
+    double hashed = timeLookups(true, rounds);
+
+    char msg[128];
+    snprintf(msg, sizeof(msg), "23 commands: linear scan %.1f ns/lookup, perfect hash %.1f ns/lookup (%.1fx)",
+             scan, hashed, scan / hashed);
+    TEST_MESSAGE(msg);
+    TEST_ASSERT_TRUE(hashed < scan);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_finds_every_command);
+    RUN_TEST(test_rejects_unknown_names);
+    RUN_TEST(test_matches_on_length_not_terminator);
+    RUN_TEST(test_stop_priority);
+    RUN_TEST(test_benchmark_against_linear_scan);
+    return UNITY_END();
+}
@@ -0,0 +1,153 @@
+// =============================================================================
+// Allocation-free steady state
+// Counts live heap blocks through a global operator new, as allocatedBlocks()
+// does on the ESP32, and runs thousands of commands through the simulated
+// controller once it has settled: connects, evictions, reconnects and writes
+// must leave the block count where they found it. The count is also the
+// simulated platform's, so the worker's own per-command accounting is checked
+// against the same numbers.
+// Run with: pio test -e native -f test_heap_soak -v
+// =============================================================================
+#include <unity.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <new>
+#include "HeapStats.h"
+#include "Preferences.h"
+#include "SimController.h"
+
+static size_t liveBlocks = 0;
+static size_t allocations = 0;
+
+void* operator new(size_t size) {
+    void* p = malloc(size ? size : 1);
+    if (!p) throw std::bad_alloc();
+    liveBlocks++;
+    allocations++;
+    return p;
+}
+
+void operator delete(void* p) noexcept {
+    if (!p) return;
+    liveBlocks--;
+    free(p);
+}
+
+void operator delete(void* p, size_t) noexcept { operator delete(p); }
+
+static size_t countLiveBlocks() { return liveBlocks; }
+
+static const size_t SIM_BEDS = 4;
+
+void setUp() {
+    HostClock::nowUs = 0;
+    HostNvs::clear();
+}
+
+void tearDown() {}
+
+static void test_tracker_counts() {
+    CommandHeapTracker tracker;
+    tracker.record(100, 100);
+    tracker.record(100, 103);
+    tracker.record(103, 101);
+    tracker.record(101, 102);
+
+    CommandHeapStats stats = tracker.getStats();
+    TEST_ASSERT_EQUAL_UINT32(4, stats.commands);
+    TEST_ASSERT_EQUAL_INT32(2, stats.netBlocks);
+    TEST_ASSERT_EQUAL_INT32(1, stats.lastBlocks);
+    TEST_ASSERT_EQUAL_INT32(3, stats.maxBlocks);
+    TEST_ASSERT_EQUAL_UINT32(2, stats.growingCommands);
+}
+
+// Run rounds of commands on every bed, sampling the heap around each one
+static CommandHeapStats soak(SimController<SIM_BEDS>& sim, uint32_t rounds, size_t& allocated) {
+    static const char* const COMMANDS[] = {
+        "preset_tv", "head_up", "light_toggle", "massage_head_step", "preset_home", "massage_stop"
+    };
+    CommandHeapTracker tracker;
+    size_t start = allocations;
+
+    for (uint32_t r = 0; r < rounds; r++) {
+        for (size_t i = 0; i < SIM_BEDS; i++) {
+            size_t before = liveBlocks;
+            sim.press(i, COMMANDS[(r + i) % 6]);
+            sim.settle();
+            tracker.record(before, liveBlocks);
+        }
+    }
+    allocated = allocations - start;
+    return tracker.getStats();
+}
+
+// Every queued command the worker ran was sampled, and the soak since before
+// left no blocks behind in its sampling either. Stops skip the queues and
+// aren't sampled.
+static void checkWorkerHeap(SimController<SIM_BEDS>& sim, const CommandHeapStats& before) {
+    uint32_t ran = 0;
+    for (size_t i = 0; i < SIM_BEDS; i++) {
+        ran += sim.queueStats(i).written + sim.queueStats(i).failed;
+    }
+    CommandHeapStats after = sim.worker().heapStats();
+    TEST_ASSERT_EQUAL_UINT32(ran, after.commands);
+    TEST_ASSERT_GREATER_THAN_UINT32(before.commands, after.commands);
+    TEST_ASSERT_EQUAL_INT32(before.netBlocks, after.netBlocks);
+    TEST_ASSERT_EQUAL_UINT32(before.growingCommands, after.growingCommands);
+}
+
+static void test_steady_state_soak() {
+    SimController<SIM_BEDS> sim;
+    sim.platform.heapBlocks = countLiveBlocks;
+    sim.start();
+    sim.runFor(100);
+    size_t allocated = 0;
+    soak(sim, 10, allocated);   // First connects and handle caching may write NVS
+
+    CommandHeapStats worker = sim.worker().heapStats();
+    CommandHeapStats stats = soak(sim, 2500, allocated);
+    TEST_ASSERT_EQUAL_UINT32(10000, stats.commands);
+    TEST_ASSERT_EQUAL_INT32(0, stats.netBlocks);
+    TEST_ASSERT_EQUAL_UINT32(0, stats.growingCommands);
+    TEST_ASSERT_EQUAL_UINT32(0, allocated);
+    TEST_ASSERT_EQUAL_UINT32(2510, sim.queueStats(0).written + sim.stopStats(0).written);
+    checkWorkerHeap(sim, worker);
+
+    char msg[128];
+    snprintf(msg, sizeof(msg), "%" PRIu32 " commands: %u allocations, net %" PRId32 " blocks",
+             stats.commands, (unsigned)allocated, stats.netBlocks);
+    TEST_MESSAGE(msg);
+}
+
+// Failed connects and writes take the breaker, backoff and reconnect paths;
+// those must not allocate either
+static void test_lossy_soak() {
+    SimController<SIM_BEDS> sim;
+    for (size_t i = 0; i < SIM_BEDS; i++) {
+        sim.links[i].profile().connectFailPermille = 50;
+        sim.links[i].profile().writeFailPermille = 30;
+    }
+    sim.platform.heapBlocks = countLiveBlocks;
+    sim.start();
+    sim.runFor(100);
+    size_t allocated = 0;
+    soak(sim, 10, allocated);
+
+    CommandHeapStats worker = sim.worker().heapStats();
+    CommandHeapStats stats = soak(sim, 500, allocated);
+    uint32_t failed = 0;
+    for (size_t i = 0; i < SIM_BEDS; i++) failed += sim.queueStats(i).failed;
+
+    TEST_ASSERT_GREATER_THAN_UINT32(0, failed);
+    TEST_ASSERT_EQUAL_INT32(0, stats.netBlocks);
+    TEST_ASSERT_EQUAL_UINT32(0, allocated);
+    checkWorkerHeap(sim, worker);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_tracker_counts);
+    RUN_TEST(test_steady_state_soak);
+    RUN_TEST(test_lossy_soak);
+    return UNITY_END();
+}
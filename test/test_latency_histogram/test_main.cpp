@@ -0,0 +1,122 @@
+// =============================================================================
+// LatencyHistogram host tests
+// Run with: pio test -e native -f test_latency_histogram
+// =============================================================================
+#include <unity.h>
+#include <thread>
+#include "LatencyHistogram.h"
+
+void setUp() {}
+void tearDown() {}
+
+// Every value lands in the bucket whose bounds contain it
+static void test_bucket_bounds() {
+    TEST_ASSERT_EQUAL_UINT32(0, LatencyHistogram::bucketFor(0));
+    TEST_ASSERT_EQUAL_UINT32(1, LatencyHistogram::bucketFor(1));
+    TEST_ASSERT_EQUAL_UINT32(LatencyHistogram::BUCKETS - 1, LatencyHistogram::bucketFor(UINT32_MAX));
+    TEST_ASSERT_EQUAL_UINT32(UINT32_MAX, LatencyHistogram::bucketUpperBound(LatencyHistogram::BUCKETS - 1));
+
+    for (uint32_t us = 1; us < 200000; us++) {
+        size_t bucket = LatencyHistogram::bucketFor(us);
+        TEST_ASSERT_TRUE(bucket < LatencyHistogram::BUCKETS);
+        TEST_ASSERT_TRUE(us <= LatencyHistogram::bucketUpperBound(bucket));
+        TEST_ASSERT_TRUE(us > LatencyHistogram::bucketUpperBound(bucket - 1));
+    }
+}
+
+static void test_percentiles() {
+    LatencyHistogram histogram;
+    for (int i = 0; i < 90; i++) histogram.record(100);
+    for (int i = 0; i < 9; i++) histogram.record(1000);
+    histogram.record(50000);
+
+    LatencySnapshot s = histogram.takeSnapshot();
+    TEST_ASSERT_EQUAL_UINT32(100, s.count);
+    TEST_ASSERT_EQUAL_UINT32(127, s.p50Us);
+    TEST_ASSERT_EQUAL_UINT32(1023, s.p95Us);
+    TEST_ASSERT_EQUAL_UINT32(1023, s.p99Us);
+    TEST_ASSERT_EQUAL_UINT32(50000, s.maxUs);
+}
+
+// A bucket bound above the largest sample is reported as the sample
+static void test_percentile_capped_at_max() {
+    LatencyHistogram histogram;
+    for (int i = 0; i < 10; i++) histogram.record(1000);
+
+    LatencySnapshot s = histogram.takeSnapshot();
+    TEST_ASSERT_EQUAL_UINT32(1000, s.p50Us);
+    TEST_ASSERT_EQUAL_UINT32(1000, s.p99Us);
+    TEST_ASSERT_EQUAL_UINT32(1000, s.maxUs);
+}
+
+static void test_snapshot_drains() {
+    LatencyHistogram histogram;
+    histogram.record(500);
+    TEST_ASSERT_EQUAL_UINT32(1, histogram.takeSnapshot().count);
+
+    LatencySnapshot s = histogram.takeSnapshot();
+    TEST_ASSERT_EQUAL_UINT32(0, s.count);
+    TEST_ASSERT_EQUAL_UINT32(0, s.p50Us);
+    TEST_ASSERT_EQUAL_UINT32(0, s.maxUs);
+
+    histogram.record(20);
+    s = histogram.takeSnapshot();
+    TEST_ASSERT_EQUAL_UINT32(1, s.count);
+    TEST_ASSERT_EQUAL_UINT32(20, s.maxUs);
+}
+
+// Recording from several tasks at once loses no samples and keeps the max
+static void test_concurrent_record() {
+    static const int THREADS = 4;
+    static const uint32_t PER_THREAD = 20000;
+    LatencyHistogram histogram;
+
+    std::thread threads[THREADS];
+    for (int t = 0; t < THREADS; t++) {
+        threads[t] = std::thread([&histogram, t] {
+            for (uint32_t i = 0; i < PER_THREAD; i++) {
+                histogram.record((i * 7919u + t) % 100000);
+                if (i % 1000 == 0) std::this_thread::yield();
+            }
+        });
+    }
+    for (int t = 0; t < THREADS; t++) threads[t].join();
+
+    uint32_t expectedMax = 0;
+    for (int t = 0; t < THREADS; t++) {
+        for (uint32_t i = 0; i < PER_THREAD; i++) {
+            uint32_t us = (i * 7919u + t) % 100000;
+            if (us > expectedMax) expectedMax = us;
+        }
+    }
+    LatencySnapshot s = histogram.takeSnapshot();
+    TEST_ASSERT_EQUAL_UINT32(THREADS * PER_THREAD, s.count);
+    TEST_ASSERT_EQUAL_UINT32(expectedMax, s.maxUs);
+}
+
+static void test_stage_latencies() {
+    StageLatencies stages;
+    stages.record(LatencyStage::CONNECT, 60000);
+    stages.record(LatencyStage::WRITE, 2000);
+    stages.record(LatencyStage::WRITE, 3000);
+
+    TEST_ASSERT_EQUAL_UINT32(0, stages[static_cast<size_t>(LatencyStage::PARSE)].takeSnapshot().count);
+    TEST_ASSERT_EQUAL_UINT32(60000, stages[static_cast<size_t>(LatencyStage::CONNECT)].takeSnapshot().maxUs);
+    TEST_ASSERT_EQUAL_UINT32(2, stages[static_cast<size_t>(LatencyStage::WRITE)].takeSnapshot().count);
+
+    TEST_ASSERT_EQUAL_STRING("connect", latencyStageName(static_cast<size_t>(LatencyStage::CONNECT)));
+    TEST_ASSERT_EQUAL_STRING("first_write_discovered",
+                             latencyStageName(static_cast<size_t>(LatencyStage::FIRST_WRITE_DISCOVERED)));
+    TEST_ASSERT_EQUAL_STRING("unknown", latencyStageName(LATENCY_STAGE_COUNT));
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_bucket_bounds);
+    RUN_TEST(test_percentiles);
+    RUN_TEST(test_percentile_capped_at_max);
+    RUN_TEST(test_snapshot_drains);
+    RUN_TEST(test_concurrent_record);
+    RUN_TEST(test_stage_latencies);
+    return UNITY_END();
+}
@@ -0,0 +1,119 @@
+// =============================================================================
+// MpscRing host tests
+// Run with: pio test -e native -f test_mpsc_ring
+// =============================================================================
+#include <unity.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <atomic>
+#include <thread>
+#include "MpscRing.h"
+
+void setUp() {}
+void tearDown() {}
+
+struct Record {
+    uint32_t producer;
+    uint32_t sequence;
+    char text[24];
+};
+
+static void test_fifo_and_bounds() {
+    MpscRing<uint32_t, 4> ring;
+    uint32_t value = 0;
+
+    TEST_ASSERT_FALSE(ring.consume([&](const uint32_t& item) { value = item; }));
+
+    for (uint32_t i = 0; i < 4; i++) {
+        TEST_ASSERT_TRUE(ring.emplace([i](uint32_t& item) { item = i; }));
+    }
+    bool filled = false;
+    TEST_ASSERT_FALSE(ring.emplace([&](uint32_t& item) { filled = true; }));
+    TEST_ASSERT_FALSE(filled);
+
+    for (uint32_t i = 0; i < 4; i++) {
+        TEST_ASSERT_TRUE(ring.consume([&](const uint32_t& item) { value = item; }));
+        TEST_ASSERT_EQUAL_UINT32(i, value);
+    }
+    TEST_ASSERT_FALSE(ring.consume([&](const uint32_t& item) { value = item; }));
+}
+
+static void test_wraps() {
+    MpscRing<Record, 2> ring;
+
+    for (uint32_t i = 0; i < 1000; i++) {
+        TEST_ASSERT_TRUE(ring.emplace([i](Record& r) {
+            r.producer = 0;
+            r.sequence = i;
+            snprintf(r.text, sizeof(r.text), "line %u", (unsigned)i);
+        }));
+        char expected[24];
+        snprintf(expected, sizeof(expected), "line %u", (unsigned)i);
+        TEST_ASSERT_TRUE(ring.consume([&](const Record& r) {
+            TEST_ASSERT_EQUAL_UINT32(i, r.sequence);
+            TEST_ASSERT_EQUAL_STRING(expected, r.text);
+        }));
+    }
+}
+
+// Several tasks logging at once: nothing accepted is lost or duplicated,
+// each producer's records come out in the order it wrote them, and a full
+// ring turns producers away instead of blocking them
+static void test_producers_under_load() {
+    static const uint32_t PRODUCERS = 4;
+    static const uint32_t PER_PRODUCER = 200000;
+    MpscRing<Record, 16> ring;
+    std::atomic<uint32_t> accepted[PRODUCERS] = {};
+    std::atomic<uint32_t> running{PRODUCERS};
+
+    std::thread producers[PRODUCERS];
+    for (uint32_t p = 0; p < PRODUCERS; p++) {
+        producers[p] = std::thread([&, p] {
+            uint32_t next = 0;
+            for (uint32_t i = 0; i < PER_PRODUCER; i++) {
+                if (ring.emplace([&](Record& r) { r.producer = p; r.sequence = next; })) {
+                    next++;
+                }
+                if (i % 64 == 0) std::this_thread::yield();
+            }
+            accepted[p].store(next);
+            running.fetch_sub(1);
+        });
+    }
+
+    uint32_t received[PRODUCERS] = {};
+    bool ordered = true;
+    for (;;) {
+        bool finished = running.load() == 0;
+        while (ring.consume([&](const Record& r) {
+            if (r.producer >= PRODUCERS || r.sequence != received[r.producer]) ordered = false;
+            else received[r.producer]++;
+        })) {
+        }
+        if (finished) break;
+        std::this_thread::yield();
+    }
+    for (uint32_t p = 0; p < PRODUCERS; p++) producers[p].join();
+
+    uint32_t total = 0;
+    uint32_t rejected = 0;
+    TEST_ASSERT_TRUE(ordered);
+    for (uint32_t p = 0; p < PRODUCERS; p++) {
+        TEST_ASSERT_EQUAL_UINT32(accepted[p].load(), received[p]);
+        total += received[p];
+        rejected += PER_PRODUCER - received[p];
+    }
+
+    char msg[128];
+    snprintf(msg, sizeof(msg), "%u producers: %" PRIu32 " records through a 16-slot ring, %" PRIu32 " turned away",
+             (unsigned)PRODUCERS, total, rejected);
+    TEST_MESSAGE(msg);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_fifo_and_bounds);
+    RUN_TEST(test_wraps);
+    RUN_TEST(test_producers_under_load);
+    return UNITY_END();
+}
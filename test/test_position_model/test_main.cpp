@@ -0,0 +1,136 @@
+// =============================================================================
+// ActuatorEstimate host tests
+// Run with: pio test -e native -f test_position_model
+// =============================================================================
+#include <unity.h>
+#include "PositionModel.h"
+
+static constexpr uint32_t UP_MS = 20000;
+static constexpr uint32_t DOWN_MS = 16000;
+static constexpr uint32_t SLOP_MS = 300;
+
+// One start/stop pair's worth of uncertainty on an upward run
+static constexpr uint16_t UP_SLOP = SLOP_MS * ActuatorEstimate::FULL / UP_MS;
+
+static ActuatorEstimate estimate;
+
+void setUp() {
+    estimate = ActuatorEstimate();
+    estimate.setTravel(UP_MS, DOWN_MS);
+    estimate.setSlop(SLOP_MS);
+}
+
+void tearDown() {}
+
+// Run dir for runMs starting at nowMs
+static void run(MotorDirection dir, uint32_t nowMs, uint32_t runMs) {
+    estimate.start(dir, nowMs);
+    estimate.stop(nowMs + runMs);
+}
+
+static void test_unknown_until_an_end_stop() {
+    TEST_ASSERT_EQUAL_UINT16(ActuatorEstimate::FULL, estimate.uncertainty());
+
+    // Half of a full travel down can't prove the actuator reached the bottom
+    run(MotorDirection::DOWN, 0, DOWN_MS / 2);
+    TEST_ASSERT_EQUAL_UINT16(0, estimate.position(DOWN_MS));
+    TEST_ASSERT_EQUAL_UINT16(ActuatorEstimate::FULL, estimate.uncertainty());
+}
+
+static void test_full_travel_past_the_end_resyncs() {
+    run(MotorDirection::DOWN, 0, DOWN_MS);
+    TEST_ASSERT_EQUAL_UINT16(0, estimate.position(DOWN_MS));
+    TEST_ASSERT_EQUAL_UINT16(0, estimate.uncertainty());
+
+    run(MotorDirection::UP, DOWN_MS, 2 * UP_MS);
+    TEST_ASSERT_EQUAL_UINT16(ActuatorEstimate::FULL, estimate.position(DOWN_MS + 2 * UP_MS));
+    TEST_ASSERT_EQUAL_UINT16(0, estimate.uncertainty());
+}
+
+static void test_overrun_short_of_the_uncertainty_keeps_it() {
+    estimate.setPosition(900);
+    for (int i = 0; i < 4; i++) {
+        run(MotorDirection::DOWN, 0, 0);
+    }
+    uint16_t uncertainty = estimate.uncertainty();
+    TEST_ASSERT_TRUE(uncertainty > 0);
+
+    // Ends at the top, but overran it by less than the estimate could be off
+    run(MotorDirection::UP, 0, UP_MS / 10 + 1);
+    TEST_ASSERT_EQUAL_UINT16(ActuatorEstimate::FULL, estimate.position(0));
+    TEST_ASSERT_EQUAL_UINT16(uncertainty + UP_SLOP, estimate.uncertainty());
+}
+
+static void test_every_start_and_stop_adds_uncertainty() {
+    estimate.setPosition(500);
+    run(MotorDirection::UP, 0, UP_MS / 10);
+    TEST_ASSERT_EQUAL_UINT16(600, estimate.position(UP_MS / 10));
+    TEST_ASSERT_EQUAL_UINT16(UP_SLOP, estimate.uncertainty());
+
+    run(MotorDirection::UP, UP_MS, UP_MS / 10);
+    TEST_ASSERT_EQUAL_UINT16(700, estimate.position(UP_MS));
+    TEST_ASSERT_EQUAL_UINT16(2 * UP_SLOP, estimate.uncertainty());
+
+    // A preset moved it somewhere unknown
+    estimate.forget(2 * UP_MS);
+    TEST_ASSERT_EQUAL_UINT16(ActuatorEstimate::FULL, estimate.uncertainty());
+}
+
+static void test_position_follows_a_timed_run() {
+    estimate.setPosition(0);
+    estimate.start(MotorDirection::UP, 1000, UP_MS / 4);
+    TEST_ASSERT_EQUAL(MotorDirection::UP, estimate.direction(1000));
+    TEST_ASSERT_EQUAL_UINT16(125, estimate.position(1000 + UP_MS / 8));
+
+    // The run ends on its own; settle() folds it in, capped at its duration
+    TEST_ASSERT_EQUAL(MotorDirection::NONE, estimate.direction(1000 + UP_MS));
+    TEST_ASSERT_EQUAL_UINT16(250, estimate.position(1000 + UP_MS));
+    estimate.settle(1000 + UP_MS);
+    TEST_ASSERT_EQUAL_UINT16(250, estimate.position(1000 + UP_MS));
+    TEST_ASSERT_EQUAL_UINT16(UP_SLOP, estimate.uncertainty());
+}
+
+static void test_plan_within_slop_is_nothing() {
+    // The slop is counted against the slower direction
+    estimate.setPosition(500);
+    MotorDirection dir = MotorDirection::NONE;
+    TEST_ASSERT_EQUAL_UINT32(0, estimate.plan(500 + UP_SLOP, dir));
+    TEST_ASSERT_EQUAL_UINT32(0, estimate.plan(500 - UP_SLOP, dir));
+    TEST_ASSERT_EQUAL(MotorDirection::NONE, dir);
+
+    TEST_ASSERT_EQUAL_UINT32(20 * UP_MS / 1000, estimate.plan(520, dir));
+    TEST_ASSERT_EQUAL(MotorDirection::UP, dir);
+    TEST_ASSERT_EQUAL_UINT32(20 * DOWN_MS / 1000, estimate.plan(480, dir));
+    TEST_ASSERT_EQUAL(MotorDirection::DOWN, dir);
+}
+
+static void test_plan_to_an_end_overruns_it() {
+    estimate.setPosition(0);
+    MotorDirection dir = MotorDirection::NONE;
+    TEST_ASSERT_EQUAL_UINT32(0, estimate.plan(0, dir));
+
+    // Past the end by the uncertainty plus the margin, so the run re-syncs
+    estimate.setPosition(200);
+    run(MotorDirection::UP, 0, 0);
+    uint32_t overrun = estimate.uncertainty() + ActuatorEstimate::END_MARGIN;
+    TEST_ASSERT_EQUAL_UINT32((200 + overrun) * DOWN_MS / 1000, estimate.plan(0, dir));
+    TEST_ASSERT_EQUAL(MotorDirection::DOWN, dir);
+    TEST_ASSERT_EQUAL_UINT32((800 + overrun) * UP_MS / 1000, estimate.plan(1000, dir));
+    TEST_ASSERT_EQUAL(MotorDirection::UP, dir);
+
+    run(MotorDirection::DOWN, 0, estimate.plan(0, dir));
+    TEST_ASSERT_EQUAL_UINT16(0, estimate.position(0));
+    TEST_ASSERT_EQUAL_UINT16(0, estimate.uncertainty());
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_unknown_until_an_end_stop);
+    RUN_TEST(test_full_travel_past_the_end_resyncs);
+    RUN_TEST(test_overrun_short_of_the_uncertainty_keeps_it);
+    RUN_TEST(test_every_start_and_stop_adds_uncertainty);
+    RUN_TEST(test_position_follows_a_timed_run);
+    RUN_TEST(test_plan_within_slop_is_nothing);
+    RUN_TEST(test_plan_to_an_end_overruns_it);
+    return UNITY_END();
+}
@@ -0,0 +1,433 @@
+// =============================================================================
+// End-to-end simulation: MQTT command in, BLE write out
+// Simulated beds and broker on a virtual clock, so throughput, latency
+// percentiles and reconnect behaviour come out the same on every run.
+// Run with: pio test -e native -f test_simulation -v
+// =============================================================================
+#include <unity.h>
+#include <stdio.h>
+#include "SimController.h"
+#include "BedStore.h"
+#include "Preferences.h"
+
+static const size_t SIM_BEDS = 4;
+
+void setUp() {
+    HostClock::nowUs = 0;
+    HostNvs::clear();
+}
+
+void tearDown() {}
+
+static void report(const char* label, LatencyHistogram& histogram) {
+    LatencySnapshot s = histogram.takeSnapshot();
+    char msg[160];
+    snprintf(msg, sizeof(msg), "%s: %" PRIu32 " samples, p50 %" PRIu32 " us, p95 %" PRIu32 " us, p99 %" PRIu32
+             " us, max %" PRIu32 " us", label, s.count, s.p50Us, s.p95Us, s.p99Us, s.maxUs);
+    TEST_MESSAGE(msg);
+}
+
+// MQTT receive to BLE write, from the command queues' own counters
+static void reportEndToEnd(SimController<SIM_BEDS>& sim) {
+    uint64_t totalUs = 0;
+    uint32_t written = 0;
+    uint32_t maxUs = 0;
+    for (size_t i = 0; i < SIM_BEDS; i++) {
+        CommandQueueStats stats = sim.queueStats(i);
+        totalUs += static_cast<uint64_t>(stats.avgLatencyUs) * stats.written;
+        written += stats.written;
+        if (stats.maxLatencyUs > maxUs) maxUs = stats.maxLatencyUs;
+    }
+    char msg[128];
+    snprintf(msg, sizeof(msg), "End to end: %" PRIu32 " commands, avg %" PRIu32 " us, max %" PRIu32 " us",
+             written, written ? static_cast<uint32_t>(totalUs / written) : 0, maxUs);
+    TEST_MESSAGE(msg);
+}
+
+static void test_discovery_reaches_broker() {
+    SimController<SIM_BEDS> sim;
+    sim.start();
+    sim.runFor(100);
+
+    TEST_ASSERT_EQUAL_STRING("online", sim.mqtt.retained("motosleep/status"));
+    TEST_ASSERT_NOT_NULL(sim.mqtt.retained("homeassistant/device/motosleep_controller_bed_1/config"));
+    TEST_ASSERT_NOT_NULL(sim.mqtt.retained("homeassistant/device/motosleep_controller_bed_4/config"));
+    TEST_ASSERT_NOT_NULL(sim.mqtt.retained("homeassistant/device/motosleep_controller_all/config"));
+    TEST_ASSERT_EQUAL_UINT32(0, sim.mqtt.malformedPublishes());
+    TEST_ASSERT_FALSE(sim.discovery().passActive());
+
+    // The async backend drops anything larger than its publish buffer
+    char msg[96];
+    snprintf(msg, sizeof(msg), "Largest discovery config: %u bytes (MQTT_PUBLISH_BUFFER_SIZE %u)",
+             (unsigned)sim.mqtt.largestPublish(), (unsigned)MQTT_PUBLISH_BUFFER_SIZE);
+    TEST_MESSAGE(msg);
+    TEST_ASSERT_LESS_OR_EQUAL_UINT32(MQTT_PUBLISH_BUFFER_SIZE, sim.mqtt.largestPublish());
+}
+
+static void test_command_reaches_bed() {
+    SimController<SIM_BEDS> sim;
+    sim.start();
+
+    TEST_ASSERT_TRUE(sim.press(1, "preset_zero_g"));
+    sim.settle();
+
+    TEST_ASSERT_EQUAL_UINT32(1, sim.links[1].received(MotoSleep::Preset::ZERO_G));
+    TEST_ASSERT_EQUAL_UINT32(0, sim.links[0].stats().writes);
+    TEST_ASSERT_EQUAL_UINT32(1, sim.links[1].stats().discoveries);
+    TEST_ASSERT_EQUAL_UINT32(0x002a, sim.links[1].getHandle());
+    TEST_ASSERT_EQUAL_UINT32(1, sim.queueStats(1).written);
+}
+
+// Only the pool connects: a write to a closed link fails without touching
+// the radio, so the pool's limit and the breaker can't be bypassed
+static void test_write_needs_connection() {
+    SimController<SIM_BEDS> sim;
+    sim.start();
+
+    TEST_ASSERT_FALSE(sim.bed(0).sendCommand(MotoSleep::Preset::TV));
+    TEST_ASSERT_EQUAL_UINT32(0, sim.links[0].stats().connects);
+    TEST_ASSERT_EQUAL_UINT32(0, sim.links[0].stats().connectFailures);
+}
+
+// Steady load across four beds with room for three links: evictions force
+// reconnects, which skip discovery once the handle is known
+static void test_throughput_and_latency() {
+    SimController<SIM_BEDS> sim;
+    sim.start();
+    sim.runFor(100);
+
+    static const char* const COMMANDS[] = {"preset_tv", "preset_home", "light_toggle", "massage_head_step"};
+    const uint32_t rounds = 500;
+    uint64_t startUs = HostClock::nowUs;
+
+    for (uint32_t r = 0; r < rounds; r++) {
+        for (size_t i = 0; i < SIM_BEDS; i++) {
+            sim.press(i, COMMANDS[(r + i) % 4]);
+        }
+        sim.settle();
+    }
+
+    double seconds = (HostClock::nowUs - startUs) / 1e6;
+    uint32_t written = 0;
+    for (size_t i = 0; i < SIM_BEDS; i++) {
+        CommandQueueStats stats = sim.queueStats(i);
+        TEST_ASSERT_EQUAL_UINT32(rounds, stats.written);
+        TEST_ASSERT_EQUAL_UINT32(0, stats.failed);
+        TEST_ASSERT_EQUAL_UINT32(rounds, sim.links[i].stats().writes);
+        TEST_ASSERT_EQUAL_UINT32(1, sim.links[i].stats().discoveries);
+        written += stats.written;
+    }
+    TEST_ASSERT_LESS_OR_EQUAL_UINT32(BLE_MAX_CONNECTIONS, sim.pool().connectedCount());
+
+    char msg[128];
+    snprintf(msg, sizeof(msg), "%" PRIu32 " commands in %.1f s simulated: %.1f commands/s",
+             written, seconds, written / seconds);
+    TEST_MESSAGE(msg);
+    reportEndToEnd(sim);
+    report("Bed 1 queue wait", sim.latencies(0)[static_cast<size_t>(LatencyStage::QUEUE)]);
+    report("Bed 1 connect", sim.latencies(0)[static_cast<size_t>(LatencyStage::CONNECT)]);
+}
+
+// Lossy radio: every command is either written or counted as failed, and
+// links that drop are re-established
+static void test_drops_are_accounted() {
+    SimController<SIM_BEDS> sim;
+    for (size_t i = 0; i < SIM_BEDS; i++) {
+        sim.links[i].profile().connectFailPermille = 100;
+        sim.links[i].profile().writeFailPermille = 50;
+    }
+    sim.start();
+
+    const uint32_t rounds = 300;
+    for (uint32_t r = 0; r < rounds; r++) {
+        for (size_t i = 0; i < SIM_BEDS; i++) {
+            sim.press(i, "preset_tv");
+        }
+        sim.settle();
+        // Let open breakers reach their trial connect
+        if (r % 50 == 49) sim.runFor(SimController<SIM_BEDS>::BREAKER_MAX_MS);
+    }
+
+    uint32_t written = 0;
+    uint32_t failed = 0;
+    uint32_t reconnects = 0;
+    for (size_t i = 0; i < SIM_BEDS; i++) {
+        CommandQueueStats stats = sim.queueStats(i);
+        TEST_ASSERT_EQUAL_UINT32(rounds, stats.enqueued);
+        TEST_ASSERT_EQUAL_UINT32(stats.enqueued, stats.written + stats.failed);
+        TEST_ASSERT_EQUAL_UINT32(stats.written, sim.links[i].stats().writes);
+        written += stats.written;
+        failed += stats.failed;
+        reconnects += sim.links[i].stats().connects - 1;
+    }
+    TEST_ASSERT_GREATER_THAN_UINT32(0, reconnects);
+    TEST_ASSERT_GREATER_THAN_UINT32(failed, written);
+
+    char msg[128];
+    snprintf(msg, sizeof(msg), "10%% connect / 5%% write failures: %" PRIu32 " written, %" PRIu32
+             " failed, %" PRIu32 " reconnects", written, failed, reconnects);
+    TEST_MESSAGE(msg);
+    reportEndToEnd(sim);
+}
+
+// An unplugged bed costs a connect timeout per command only until its
+// breaker opens; then commands fail at once, and a trial connect after the
+// wait brings it back
+static void test_unplugged_bed_recovers() {
+    SimController<SIM_BEDS> sim;
+    sim.start();
+    sim.press(2, "preset_tv");
+    sim.settle();
+    sim.links[2].setUnplugged(true);
+
+    for (int n = 0; n < 3; n++) {
+        sim.press(2, "preset_tv");
+        sim.settle();
+    }
+    TEST_ASSERT_TRUE(sim.breaker(2).state() == BreakerState::OPEN);
+    TEST_ASSERT_EQUAL_UINT32(3, sim.links[2].stats().connectFailures);
+
+    uint64_t before = HostClock::nowUs;
+    sim.press(2, "preset_tv");
+    sim.press(0, "preset_tv");
+    sim.settle();
+    TEST_ASSERT_EQUAL_UINT32(3, sim.links[2].stats().connectFailures);
+    TEST_ASSERT_LESS_THAN_UINT32(BLE_CONNECT_TIMEOUT * 1000UL, static_cast<uint32_t>(HostClock::nowUs - before));
+    TEST_ASSERT_EQUAL_UINT32(1, sim.links[0].stats().writes);
+
+    sim.links[2].setUnplugged(false);
+    sim.runFor(SimController<SIM_BEDS>::BREAKER_MIN_MS * 2);
+    sim.press(2, "preset_home");
+    sim.settle();
+    TEST_ASSERT_TRUE(sim.breaker(2).state() == BreakerState::CLOSED);
+    TEST_ASSERT_EQUAL_UINT32(1, sim.links[2].received(MotoSleep::Preset::HOME));
+    TEST_ASSERT_EQUAL_UINT32(1, sim.links[2].stats().discoveries);
+}
+
+// The handle cached in NVS skips discovery after a restart; when a firmware
+// update moves the characteristic, the bed rejects the first write and the
+// link rediscovers and caches the new handle
+static void test_cached_handle_checked() {
+    {
+        SimController<SIM_BEDS> sim;
+        sim.start();
+        sim.press(0, "preset_tv");
+        sim.settle();
+        TEST_ASSERT_EQUAL_UINT32(1, sim.links[0].stats().discoveries);
+    }
+    TEST_ASSERT_EQUAL_UINT32(0x002a, BedStore::loadHandle(BEDS[0].bleName));
+
+    SimController<SIM_BEDS> sim;
+    sim.start();
+    sim.press(0, "preset_tv");
+    sim.settle();
+    TEST_ASSERT_EQUAL_UINT32(0, sim.links[0].stats().discoveries);
+    TEST_ASSERT_EQUAL_UINT32(1, sim.links[0].received(MotoSleep::Preset::TV));
+
+    sim.links[0].dropLink();
+    sim.links[0].moveCharacteristic(0x0030);
+    sim.press(0, "preset_home");
+    sim.settle();
+    TEST_ASSERT_EQUAL_UINT32(1, sim.links[0].stats().rejectedHandles);
+    TEST_ASSERT_EQUAL_UINT32(1, sim.links[0].stats().discoveries);
+    TEST_ASSERT_EQUAL_UINT32(0, sim.links[0].stats().ignoredWrites);
+    TEST_ASSERT_EQUAL_UINT32(1, sim.links[0].received(MotoSleep::Preset::HOME));
+    TEST_ASSERT_EQUAL_UINT32(0x0030, BedStore::loadHandle(BEDS[0].bleName));
+}
+
+// Commands for every bed arrive faster than the radio can write them, so the
+// queues stay full and drop, while stops arrive at odd times in between.
+// Returns how many stops were sent.
+static uint32_t saturate(SimController<SIM_BEDS>& sim, uint64_t spanUs) {
+    static const char* const COMMANDS[] = {"preset_tv", "preset_home", "light_toggle", "massage_head_step"};
+    uint64_t start = HostClock::nowUs;
+    uint32_t n = 0;
+    for (uint64_t t = 0; t < spanUs; t += 25000) {
+        for (size_t i = 0; i < SIM_BEDS; i++) {
+            sim.pressAt(start + t + i * 5000, i, COMMANDS[n++ % 4]);
+        }
+    }
+
+    uint32_t stops = 0;
+    for (uint64_t t = 1000000; t < spanUs; t += 1733000) {
+        sim.pressAt(start + t, stops % SIM_BEDS, "massage_stop");
+        stops++;
+    }
+    sim.settle();
+    return stops;
+}
+
+// Every stop is written or, for a bed that can't be reached, failed; none
+// is dropped behind queued commands. stopMaxUs is the longest a stop took
+// from reaching the controller to its write.
+static void reportStops(const char* label, SimController<SIM_BEDS>& sim, uint32_t sent, uint32_t& stopMaxUs) {
+    uint32_t written = 0;
+    uint32_t failed = 0;
+    uint64_t totalUs = 0;
+    uint32_t commandMaxUs = 0;
+    uint32_t dropped = 0;
+    stopMaxUs = 0;
+    for (size_t i = 0; i < SIM_BEDS; i++) {
+        CommandQueueStats stops = sim.stopStats(i);
+        written += stops.written;
+        failed += stops.failed;
+        totalUs += static_cast<uint64_t>(stops.avgLatencyUs) * stops.written;
+        if (stops.maxLatencyUs > stopMaxUs) stopMaxUs = stops.maxLatencyUs;
+        dropped += sim.queueStats(i).dropped;
+        if (sim.queueStats(i).maxLatencyUs > commandMaxUs) commandMaxUs = sim.queueStats(i).maxLatencyUs;
+    }
+    TEST_ASSERT_EQUAL_UINT32(sent, written + failed);
+    TEST_ASSERT_GREATER_THAN_UINT32(0, dropped);
+
+    char msg[192];
+    snprintf(msg, sizeof(msg), "%s: %" PRIu32 " stops written, %" PRIu32 " failed; avg %" PRIu32 " us, max %"
+             PRIu32 " us. Other commands waited up to %" PRIu32 " us, %" PRIu32 " dropped", label, written, failed,
+             written ? static_cast<uint32_t>(totalUs / written) : 0, stopMaxUs, commandMaxUs, dropped);
+    TEST_MESSAGE(msg);
+}
+
+// A stop waits for at most the operation in progress: a cold connect to
+// another bed, then its own connect if its link is closed. Queued commands
+// never hold it up.
+static void test_stop_latency_under_load() {
+    SimController<SIM_BEDS> sim;
+    sim.start();
+    sim.runFor(100);
+    uint32_t sent = saturate(sim, 120000000);
+
+    uint32_t maxUs;
+    reportStops("Saturated, all beds healthy", sim, sent, maxUs);
+    const SimBedProfile& bed = sim.links[0].profile();
+    uint32_t written = 0;
+    for (size_t i = 0; i < SIM_BEDS; i++) written += sim.stopStats(i).written;
+    TEST_ASSERT_EQUAL_UINT32(sent, written);
+    TEST_ASSERT_LESS_OR_EQUAL_UINT32(2 * (bed.connectUs + bed.discoveryUs + 2 * bed.writeUs), maxUs);
+}
+
+// Worst case: an unplugged bed blocks the worker for a whole connect
+// timeout until its breaker opens, and again on each trial connect
+static void test_stop_latency_with_unplugged_bed() {
+    SimController<SIM_BEDS> sim;
+    sim.start();
+    sim.runFor(100);
+    sim.links[3].setUnplugged(true);
+    uint32_t sent = saturate(sim, 120000000);
+
+    uint32_t maxUs;
+    reportStops("Saturated, one bed unplugged", sim, sent, maxUs);
+    const SimBedProfile& bed = sim.links[0].profile();
+    TEST_ASSERT_LESS_OR_EQUAL_UINT32(bed.timeoutUs + bed.connectUs + bed.discoveryUs + 2 * bed.writeUs, maxUs);
+}
+
+// A hold's STOP skips the queue: it waits for the connect under way, not
+// for bed 1's queued commands, and the preset queued before it never runs
+static void test_stop_during_hold() {
+    SimController<SIM_BEDS> sim;
+    sim.start();
+    sim.runFor(100);
+    TEST_ASSERT_TRUE(sim.press(0, "head_up", "START"));
+    sim.runFor(500);
+    TEST_ASSERT_TRUE(sim.worker().anyHoldActive());
+
+    // Cold connects to the other beds keep the worker busy
+    uint64_t start = HostClock::nowUs;
+    for (size_t n = 0; n < 3; n++) {
+        for (size_t i = 1; i < SIM_BEDS; i++) {
+            sim.pressAt(start + n * 1000 + i * 100, i, "light_toggle");
+        }
+        sim.pressAt(start + n * 1000 + 500, 0, "massage_head_step");
+    }
+    sim.pressAt(start + 3000, 0, "preset_tv");
+    sim.pressAt(start + 4000, 0, "head_up", "STOP");
+    sim.settle();
+    uint32_t holdWrites = sim.links[0].received(MotoSleep::Motor::HEAD_UP);
+    sim.runFor(1000);
+
+    const SimBedProfile& bed = sim.links[0].profile();
+    CommandQueueStats stops = sim.stopStats(0);
+    TEST_ASSERT_EQUAL_UINT32(1, stops.written);
+    TEST_ASSERT_LESS_OR_EQUAL_UINT32(bed.connectUs + bed.discoveryUs + 2 * bed.writeUs, stops.maxLatencyUs);
+    TEST_ASSERT_FALSE(sim.worker().anyHoldActive());
+    TEST_ASSERT_EQUAL_UINT32(holdWrites, sim.links[0].received(MotoSleep::Motor::HEAD_UP));
+
+    TEST_ASSERT_EQUAL_UINT32(1, sim.queueStats(0).preempted);
+    TEST_ASSERT_EQUAL_UINT32(0, sim.links[0].received(MotoSleep::Preset::TV));
+    TEST_ASSERT_EQUAL_UINT32(3, sim.links[0].received(MotoSleep::Massage::HEAD_STEP));
+
+    char msg[96];
+    snprintf(msg, sizeof(msg), "Hold STOP behind a busy worker: %" PRIu32 " us", stops.maxLatencyUs);
+    TEST_MESSAGE(msg);
+}
+
+// A group STOP that arrives while the group's START is still connecting
+// members reaches every member at once: members already connected are not
+// written, and the rest are never connected
+static void test_stop_during_group_fan_out() {
+    SimController<SIM_BEDS> sim;
+    sim.start();
+    sim.runFor(100);
+
+    const SimBedProfile& bed = sim.links[0].profile();
+    uint64_t start = HostClock::nowUs;
+    sim.pressGroupAt(start, "all", "head_up", "START");
+    sim.pressGroupAt(start + bed.connectUs + bed.discoveryUs + 10000, "all", "head_up", "STOP");
+    sim.settle();
+    sim.runFor(1000);
+
+    uint32_t stopMaxUs = 0;
+    for (size_t i = 0; i < SIM_BEDS; i++) {
+        TEST_ASSERT_EQUAL_UINT32(0, sim.links[i].received(MotoSleep::Motor::HEAD_UP));
+        TEST_ASSERT_EQUAL_UINT32(1, sim.stopStats(i).written);
+        if (sim.stopStats(i).maxLatencyUs > stopMaxUs) stopMaxUs = sim.stopStats(i).maxLatencyUs;
+    }
+    TEST_ASSERT_EQUAL_UINT32(1, sim.links[0].stats().connects);
+    TEST_ASSERT_EQUAL_UINT32(1, sim.links[1].stats().connects);
+    TEST_ASSERT_EQUAL_UINT32(0, sim.links[2].stats().connects);
+    TEST_ASSERT_EQUAL_UINT32(0, sim.links[3].stats().connects);
+    TEST_ASSERT_LESS_OR_EQUAL_UINT32(bed.connectUs + bed.discoveryUs, stopMaxUs);
+    TEST_ASSERT_FALSE(sim.worker().anyHoldActive());
+    TEST_ASSERT_EQUAL_UINT32(1, sim.worker().groupStats(0).preempted);
+
+    char msg[96];
+    snprintf(msg, sizeof(msg), "Group STOP during fan-out: %" PRIu32 " us", stopMaxUs);
+    TEST_MESSAGE(msg);
+}
+
+// The broker goes away and comes back: the will marks the controller
+// offline, and commands flow again after the reconnect
+static void test_broker_restart() {
+    SimController<SIM_BEDS> sim;
+    sim.start();
+    sim.runFor(100);
+
+    sim.mqtt.setBrokerDown(true);
+    TEST_ASSERT_EQUAL_STRING("offline", sim.mqtt.retained("motosleep/status"));
+    sim.runFor(1000);
+    TEST_ASSERT_FALSE(sim.mqtt.connected());
+
+    sim.mqtt.setBrokerDown(false);
+    sim.runFor(100);
+    TEST_ASSERT_TRUE(sim.mqtt.connected());
+    TEST_ASSERT_EQUAL_STRING("online", sim.mqtt.retained("motosleep/status"));
+
+    TEST_ASSERT_TRUE(sim.press(3, "light_toggle"));
+    sim.settle();
+    TEST_ASSERT_EQUAL_UINT32(1, sim.links[3].received(MotoSleep::Light::TOGGLE));
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_discovery_reaches_broker);
+    RUN_TEST(test_command_reaches_bed);
+    RUN_TEST(test_write_needs_connection);
+    RUN_TEST(test_throughput_and_latency);
+    RUN_TEST(test_drops_are_accounted);
+    RUN_TEST(test_unplugged_bed_recovers);
+    RUN_TEST(test_cached_handle_checked);
+    RUN_TEST(test_stop_latency_under_load);
+    RUN_TEST(test_stop_latency_with_unplugged_bed);
+    RUN_TEST(test_stop_during_hold);
+    RUN_TEST(test_stop_during_group_fan_out);
+    RUN_TEST(test_broker_restart);
+    return UNITY_END();
+}
@@ -0,0 +1,58 @@
+// =============================================================================
+// TaskLoad host tests
+// Run with: pio test -e native -f test_task_load
+// =============================================================================
+#include <unity.h>
+#include "TaskLoad.h"
+
+void setUp() {}
+void tearDown() {}
+
+static void test_share_of_wall_time() {
+    TaskLoad load;
+    load.takePermille(1000000);
+
+    load.add(150000);
+    load.add(100000);
+    TEST_ASSERT_EQUAL_UINT32(250, load.takePermille(2000000));
+
+    // Each report covers only the interval since the previous one
+    TEST_ASSERT_EQUAL_UINT32(0, load.takePermille(3000000));
+    load.add(500000);
+    TEST_ASSERT_EQUAL_UINT32(1000, load.takePermille(3500000));
+}
+
+static void test_no_elapsed_time() {
+    TaskLoad load;
+    load.takePermille(5000);
+    load.add(100);
+    TEST_ASSERT_EQUAL_UINT32(0, load.takePermille(5000));
+}
+
+// Busy time past the wall time (a report came late) is capped
+static void test_capped() {
+    TaskLoad load;
+    load.takePermille(0);
+    load.add(3000);
+    TEST_ASSERT_EQUAL_UINT32(1000, load.takePermille(2000));
+}
+
+// micros() wraps after ~71 minutes; differences still come out right
+static void test_counters_wrap() {
+    TaskLoad load;
+    uint32_t start = UINT32_MAX - 400000;
+    load.add(UINT32_MAX - 100000);
+    load.takePermille(start);
+
+    load.add(300000);
+    TEST_ASSERT_EQUAL_UINT32(300, load.takePermille(start + 1000000));
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_share_of_wall_time);
+    RUN_TEST(test_no_elapsed_time);
+    RUN_TEST(test_capped);
+    RUN_TEST(test_counters_wrap);
+    return UNITY_END();
+}
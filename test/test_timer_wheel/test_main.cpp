@@ -0,0 +1,267 @@
+// =============================================================================
+// TimerWheel and MacroEngine host tests
+// Run with: pio test -e native -f test_timer_wheel
+// =============================================================================
+#include <unity.h>
+#include <stdio.h>
+#include "MacroEngine.h"
+#include "TimerWheel.h"
+
+void setUp() {}
+void tearDown() {}
+
+static const uint32_t TICK_US = 1000;
+
+static void test_fires_on_time() {
+    TimerWheel<16> wheel(TICK_US);
+    WheelTimer timer;
+    wheel.begin(0);
+
+    wheel.schedule(timer, 2500);
+    TEST_ASSERT_TRUE(timer.armed());
+    TEST_ASSERT_EQUAL_UINT32(1, wheel.size());
+
+    uint32_t fired = 0;
+    uint64_t firedAt = 0;
+    for (uint64_t now = 100; now <= 5000; now += 100) {
+        wheel.advance(now, [&](WheelTimer& t) { fired++; firedAt = now; });
+    }
+    TEST_ASSERT_EQUAL_UINT32(1, fired);
+    TEST_ASSERT_EQUAL_UINT64(3000, firedAt);
+    TEST_ASSERT_FALSE(timer.armed());
+    TEST_ASSERT_EQUAL_UINT32(0, wheel.size());
+}
+
+// More than a revolution ahead: the timer sits out the laps in between
+static void test_beyond_one_revolution() {
+    TimerWheel<16> wheel(TICK_US);
+    WheelTimer timer;
+    wheel.begin(0);
+    wheel.schedule(timer, 100000);
+
+    uint64_t firedAt = 0;
+    for (uint64_t now = 1000; now <= 120000; now += 1000) {
+        wheel.advance(now, [&](WheelTimer& t) { firedAt = now; });
+    }
+    TEST_ASSERT_EQUAL_UINT64(100000, firedAt);
+}
+
+static void test_cancel() {
+    TimerWheel<16> wheel(TICK_US);
+    WheelTimer a, b;
+    wheel.begin(0);
+    wheel.schedule(a, 3000);
+    wheel.schedule(b, 3000);
+    wheel.cancel(a);
+    wheel.cancel(a);
+    TEST_ASSERT_FALSE(a.armed());
+    TEST_ASSERT_EQUAL_UINT32(1, wheel.size());
+
+    WheelTimer* fired = nullptr;
+    wheel.advance(10000, [&](WheelTimer& t) { fired = &t; });
+    TEST_ASSERT_EQUAL_PTR(&b, fired);
+}
+
+// A timer rescheduled from its own expiry runs as a periodic timer, and a
+// due time already past fires on the next advance
+static void test_reschedule_from_expiry() {
+    TimerWheel<16> wheel(TICK_US);
+    WheelTimer timer;
+    wheel.begin(0);
+    wheel.schedule(timer, 5000);
+
+    uint32_t fired = 0;
+    for (uint64_t now = 1000; now <= 100000; now += 1000) {
+        wheel.advance(now, [&](WheelTimer& t) {
+            fired++;
+            wheel.schedule(t, t.dueUs() + 5000);
+        });
+    }
+    TEST_ASSERT_EQUAL_UINT32(20, fired);
+
+    WheelTimer late;
+    wheel.schedule(late, 50000);
+    bool lateFired = false;
+    wheel.advance(101000, [&](WheelTimer& t) { if (&t == &late) lateFired = true; });
+    TEST_ASSERT_TRUE(lateFired);
+}
+
+// After a long gap (the worker was busy) everything overdue fires at once
+static void test_long_gap() {
+    TimerWheel<16> wheel(TICK_US);
+    WheelTimer timers[8];
+    wheel.begin(0);
+    for (size_t i = 0; i < 8; i++) {
+        wheel.schedule(timers[i], 1000 + i * 7000);
+    }
+
+    uint32_t fired = 0;
+    wheel.advance(1000000, [&](WheelTimer& t) { fired++; });
+    TEST_ASSERT_EQUAL_UINT32(8, fired);
+    TEST_ASSERT_EQUAL_UINT32(0, wheel.size());
+}
+
+static void test_until_next() {
+    TimerWheel<16> wheel(TICK_US);
+    WheelTimer near, far;
+    wheel.begin(0);
+    TEST_ASSERT_EQUAL_UINT32(UINT32_MAX, wheel.untilNextUs(0));
+
+    wheel.schedule(far, 200000);
+    TEST_ASSERT_EQUAL_UINT32(16 * TICK_US, wheel.untilNextUs(0));
+
+    wheel.schedule(near, 4200);
+    TEST_ASSERT_EQUAL_UINT32(4700, wheel.untilNextUs(300));
+}
+
+// Many timers scheduled, cancelled and fired in random order against a
+// plain list: each fires once, never early and at most a tick late
+static void test_random_against_reference() {
+    static const size_t COUNT = 64;
+    TimerWheel<32> wheel(TICK_US);
+    WheelTimer timers[COUNT];
+    uint64_t due[COUNT] = {};
+    bool live[COUNT] = {};
+    uint32_t fires[COUNT] = {};
+    uint32_t seed = 12345;
+    auto next = [&seed]() {
+        seed ^= seed << 13;
+        seed ^= seed >> 17;
+        seed ^= seed << 5;
+        return seed;
+    };
+
+    wheel.begin(0);
+    uint64_t now = 0;
+    bool early = false;
+    bool late = false;
+    for (uint32_t round = 0; round < 20000; round++) {
+        size_t i = next() % COUNT;
+        if (next() % 4) {
+            due[i] = now + next() % 200000;
+            live[i] = true;
+            wheel.schedule(timers[i], due[i]);
+        } else if (live[i]) {
+            live[i] = false;
+            wheel.cancel(timers[i]);
+        }
+
+        now += next() % 3000;
+        wheel.advance(now, [&](WheelTimer& t) {
+            size_t k = &t - timers;
+            fires[k]++;
+            if (!live[k]) early = true;
+            if (now < due[k]) early = true;
+            if (now - due[k] >= 3000 + TICK_US) late = true;
+            live[k] = false;
+        });
+    }
+    TEST_ASSERT_FALSE(early);
+    TEST_ASSERT_FALSE(late);
+
+    size_t armed = 0;
+    for (size_t i = 0; i < COUNT; i++) {
+        TEST_ASSERT_EQUAL(live[i], timers[i].armed());
+        if (live[i]) armed++;
+    }
+    TEST_ASSERT_EQUAL_UINT32(armed, wheel.size());
+}
+
+static void test_macro_parse() {
+    MacroProgram<4> program;
+    TEST_ASSERT_EQUAL(MacroParseError::NONE,
+                      program.parse("feet_up:4000, +500 massage_head_step, +600000 light_toggle"));
+    TEST_ASSERT_EQUAL_UINT32(3, program.count);
+    TEST_ASSERT_EQUAL(MotoSleep::Motor::FEET_UP, program.steps[0].cmdChar);
+    TEST_ASSERT_EQUAL_UINT32(4000, program.steps[0].holdMs);
+    TEST_ASSERT_EQUAL_UINT32(500, program.steps[1].delayMs);
+    TEST_ASSERT_EQUAL_UINT32(600000, program.steps[2].delayMs);
+
+    const char* errorAt = nullptr;
+    const char* text = "preset_tv, +x light_toggle";
+    TEST_ASSERT_EQUAL(MacroParseError::BAD_NUMBER, program.parse(text, &errorAt));
+    TEST_ASSERT_EQUAL_PTR(text + 11, errorAt);
+    TEST_ASSERT_EQUAL_UINT32(0, program.count);
+
+    TEST_ASSERT_EQUAL(MacroParseError::EMPTY, program.parse("  "));
+    TEST_ASSERT_EQUAL(MacroParseError::UNKNOWN_COMMAND, program.parse("preset_couch"));
+    TEST_ASSERT_EQUAL(MacroParseError::HOLD_NOT_MOTOR, program.parse("light_toggle:100"));
+    TEST_ASSERT_EQUAL(MacroParseError::BAD_NUMBER, program.parse("head_up:99999999999"));
+    TEST_ASSERT_EQUAL(MacroParseError::TOO_MANY_STEPS, program.parse("preset_tv,preset_tv,preset_tv,preset_tv,preset_tv"));
+}
+
+// Steps start at their offsets from the macro start, holds included, even
+// when the worker services the engine late
+static void test_macro_timing() {
+    MacroProgram<4> program;
+    program.parse("head_up:2000, +500 preset_tv, +1000 light_toggle");
+    MacroEngine<2, 64> engine(TICK_US);
+    engine.begin(0);
+    engine.start(1, program.steps, program.count, 0);
+    TEST_ASSERT_TRUE(engine.active(1));
+
+    uint64_t startedAt[3] = {};
+    size_t step = 0;
+    size_t otherBed = 0;
+    for (uint64_t now = 0; now <= 10000000; now += 7000) {
+        engine.service(now, [&](size_t bed, const MacroStep& s) {
+            if (bed != 1) otherBed++;
+            if (step < 3) startedAt[step] = now;
+            step++;
+            return true;
+        });
+    }
+    TEST_ASSERT_EQUAL_UINT32(0, otherBed);
+    TEST_ASSERT_EQUAL_UINT32(3, step);
+    TEST_ASSERT_TRUE(startedAt[0] <= 7000);
+    TEST_ASSERT_TRUE(startedAt[1] >= 2500000 && startedAt[1] < 2507000);
+    TEST_ASSERT_TRUE(startedAt[2] >= 3500000 && startedAt[2] < 3507000);
+    TEST_ASSERT_FALSE(engine.active(1));
+
+    MacroStats stats = engine.getStats();
+    TEST_ASSERT_EQUAL_UINT32(1, stats.started);
+    TEST_ASSERT_EQUAL_UINT32(1, stats.completed);
+    TEST_ASSERT_EQUAL_UINT32(3, stats.steps);
+    TEST_ASSERT_EQUAL_UINT32(3, engine.takeLatenessSnapshot().count);
+}
+
+static void test_macro_cancel_and_failure() {
+    MacroProgram<4> program;
+    program.parse("preset_tv, +1000 preset_home");
+    MacroEngine<2, 64> engine(TICK_US);
+    engine.begin(0);
+
+    uint32_t written = 0;
+    auto write = [&](size_t bed, const MacroStep& s) { written++; return true; };
+    engine.start(0, program.steps, program.count, 0);
+    engine.service(1000, write);
+    engine.cancel(0);
+    engine.service(5000000, write);
+    TEST_ASSERT_EQUAL_UINT32(1, written);
+    TEST_ASSERT_EQUAL_UINT32(UINT32_MAX, engine.untilNextUs(5000000));
+
+    engine.start(0, program.steps, program.count, 5000000);
+    engine.service(5001000, [](size_t bed, const MacroStep& s) { return false; });
+    TEST_ASSERT_FALSE(engine.active(0));
+
+    MacroStats stats = engine.getStats();
+    TEST_ASSERT_EQUAL_UINT32(2, stats.started);
+    TEST_ASSERT_EQUAL_UINT32(1, stats.cancelled);
+    TEST_ASSERT_EQUAL_UINT32(1, stats.failed);
+    TEST_ASSERT_EQUAL_UINT32(0, stats.completed);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_fires_on_time);
+    RUN_TEST(test_beyond_one_revolution);
+    RUN_TEST(test_cancel);
+    RUN_TEST(test_reschedule_from_expiry);
+    RUN_TEST(test_long_gap);
+    RUN_TEST(test_until_next);
+    RUN_TEST(test_random_against_reference);
+    RUN_TEST(test_macro_parse);
+    RUN_TEST(test_macro_timing);
+    RUN_TEST(test_macro_cancel_and_failure);
+    return UNITY_END();
+}
@@ -0,0 +1,190 @@
+// =============================================================================
+// TopicRouter host tests and benchmark
+// Counts heap allocations through a global operator new, to show the receive
+// path never touches the heap, and times it against the String/substring
+// parsing mqttCallback used to do.
+// Run with: pio test -e native -f test_topic_router -v
+// =============================================================================
+#include <unity.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <new>
+#include <string>
+#include "TopicRouter.h"
+
+static size_t allocations = 0;
+
+void* operator new(size_t size) {
+    allocations++;
+    void* p = malloc(size ? size : 1);
+    if (!p) throw std::bad_alloc();
+    return p;
+}
+
+void operator delete(void* p) noexcept { free(p); }
+void operator delete(void* p, size_t) noexcept { free(p); }
+
+static const char* const BED_IDS[] = {"bedroom", "guest", "master_suite", "kids"};
+static const size_t ID_COUNT = sizeof(BED_IDS) / sizeof(BED_IDS[0]);
+
+static TopicRouter<4> router;
+
+void setUp() {
+    for (size_t i = 0; i < ID_COUNT; i++) {
+        router.setBed(i, BED_IDS[i]);
+    }
+}
+
+void tearDown() {}
+
+static void test_routes_command_topic() {
+    TopicRoute route;
+    TEST_ASSERT_TRUE(router.route("motosleep/guest/preset_zero_g/set", route) == RouteResult::OK);
+    TEST_ASSERT_EQUAL_UINT32(1, route.bedIndex);
+    TEST_ASSERT_EQUAL_CHAR(MotoSleep::Preset::ZERO_G, route.command->command->cmdChar);
+    TEST_ASSERT_EQUAL_UINT32(5, route.bedIdLength);
+    TEST_ASSERT_EQUAL_UINT32(0, memcmp(route.bedId, "guest", 5));
+    TEST_ASSERT_EQUAL_UINT32(13, route.commandLength);
+}
+
+static void test_rejects_other_topics() {
+    TopicRoute route;
+    TEST_ASSERT_TRUE(router.route("homeassistant/status", route) == RouteResult::NOT_COMMAND);
+    TEST_ASSERT_TRUE(router.route("motosleep/guest/head_up", route) == RouteResult::NOT_COMMAND);
+    TEST_ASSERT_TRUE(router.route("motosleep/guest/head_up/state", route) == RouteResult::NOT_COMMAND);
+    TEST_ASSERT_TRUE(router.route("motosleep//head_up/set", route) == RouteResult::NOT_COMMAND);
+    TEST_ASSERT_TRUE(router.route("motosleep/guest//set", route) == RouteResult::NOT_COMMAND);
+    TEST_ASSERT_TRUE(router.route("motosleep/attic/head_up/set", route) == RouteResult::UNKNOWN_BED);
+    TEST_ASSERT_TRUE(router.route("motosleep/gues/head_up/set", route) == RouteResult::UNKNOWN_BED);
+    TEST_ASSERT_TRUE(router.route("motosleep/guest/head_sideways/set", route) == RouteResult::UNKNOWN_COMMAND);
+}
+
+static void test_cleared_bed_is_unknown() {
+    TopicRoute route;
+    router.clearBed(2);
+    TEST_ASSERT_TRUE(router.route("motosleep/master_suite/head_up/set", route) == RouteResult::UNKNOWN_BED);
+    router.setBed(2, "loft");
+    TEST_ASSERT_TRUE(router.route("motosleep/loft/head_up/set", route) == RouteResult::OK);
+    TEST_ASSERT_EQUAL_UINT32(2, route.bedIndex);
+}
+
+// What mqttCallback did before the router: a String of the topic, two
+// substrings, and a linear compare over the beds and the command tables
+static bool legacyRoute(const char* topic, size_t& bedIndex, char& cmdChar) {
+    std::string topicStr(topic);
+    std::string prefix = "motosleep/";
+    if (topicStr.compare(0, prefix.size(), prefix) != 0) return false;
+    size_t bedEnd = topicStr.find('/', prefix.size());
+    if (bedEnd == std::string::npos) return false;
+    size_t cmdEnd = topicStr.find('/', bedEnd + 1);
+    if (cmdEnd == std::string::npos) return false;
+    std::string bedId = topicStr.substr(prefix.size(), bedEnd - prefix.size());
+    std::string command = topicStr.substr(bedEnd + 1, cmdEnd - bedEnd - 1);
+
+    bedIndex = ID_COUNT;
+    for (size_t i = 0; i < ID_COUNT; i++) {
+        if (bedId == BED_IDS[i]) bedIndex = i;
+    }
+    if (bedIndex == ID_COUNT) return false;
+
+    const MotoSleep::Command* tables[] = {
+        MotoSleep::MOTOR_COMMANDS, MotoSleep::PRESET_COMMANDS, MotoSleep::PROGRAM_COMMANDS,
+        MotoSleep::MASSAGE_COMMANDS, MotoSleep::LIGHT_COMMANDS,
+    };
+    const size_t counts[] = {
+        MotoSleep::MOTOR_COMMAND_COUNT, MotoSleep::PRESET_COMMAND_COUNT, MotoSleep::PROGRAM_COMMAND_COUNT,
+        MotoSleep::MASSAGE_COMMAND_COUNT, MotoSleep::LIGHT_COMMAND_COUNT,
+    };
+    for (size_t t = 0; t < 5; t++) {
+        for (size_t i = 0; i < counts[t]; i++) {
+            if (command == tables[t][i].name) {
+                cmdChar = tables[t][i].cmdChar;
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+static const char* const TOPICS[] = {
+    "motosleep/bedroom/head_up/set",
+    "motosleep/guest/preset_zero_g/set",
+    "motosleep/master_suite/massage_head_step/set",
+    "motosleep/kids/light_toggle/set",
+    "motosleep/bedroom/program_anti_snore/set",
+    "motosleep/guest/massage_stop/set",
+};
+static const size_t TOPIC_COUNT = sizeof(TOPICS) / sizeof(TOPICS[0]);
+
+static void test_receive_path_never_allocates() {
+    TopicRoute route;
+    allocations = 0;
+    for (uint32_t r = 0; r < 1000; r++) {
+        for (size_t i = 0; i < TOPIC_COUNT; i++) {
+            TEST_ASSERT_TRUE(router.route(TOPICS[i], route) == RouteResult::OK);
+        }
+    }
+    TEST_ASSERT_EQUAL_UINT32(0, allocations);
+}
+
+static void test_benchmark_against_string_parsing() {
+    const uint32_t rounds = 20000;
+    volatile size_t sink = 0;
+
+    // Results must agree before the timings mean anything
+    for (size_t i = 0; i < TOPIC_COUNT; i++) {
+        TopicRoute route;
+        size_t bedIndex = 0;
+        char cmdChar = 0;
+        TEST_ASSERT_TRUE(legacyRoute(TOPICS[i], bedIndex, cmdChar));
+        TEST_ASSERT_TRUE(router.route(TOPICS[i], route) == RouteResult::OK);
+        TEST_ASSERT_EQUAL_UINT32(bedIndex, route.bedIndex);
+        TEST_ASSERT_EQUAL_CHAR(cmdChar, route.command->command->cmdChar);
+    }
+
+    allocations = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t r = 0; r < rounds; r++) {
+        for (size_t i = 0; i < TOPIC_COUNT; i++) {
+            size_t bedIndex = 0;
+            char cmdChar = 0;
+            legacyRoute(TOPICS[i], bedIndex, cmdChar);
+            sink = sink + bedIndex + cmdChar;
+        }
+    }
+    double legacyNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+    size_t legacyAllocations = allocations;
+
+    allocations = 0;
+    start = std::chrono::steady_clock::now();
+    for (uint32_t r = 0; r < rounds; r++) {
+        for (size_t i = 0; i < TOPIC_COUNT; i++) {
+            TopicRoute route;
+            router.route(TOPICS[i], route);
+            sink = sink + route.bedIndex + route.command->command->cmdChar;
+        }
+    }
+    double routerNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+    size_t routerAllocations = allocations;
+
+    double messages = static_cast<double>(rounds) * TOPIC_COUNT;
+    char msg[160];
+    snprintf(msg, sizeof(msg), "String parsing %.1f ns and %.2f allocations per message, router %.1f ns and %.2f",
+             legacyNs / messages, legacyAllocations / messages, routerNs / messages, routerAllocations / messages);
+    TEST_MESSAGE(msg);
+    TEST_ASSERT_EQUAL_UINT32(0, routerAllocations);
+    TEST_ASSERT_TRUE(legacyAllocations > 0);
+    TEST_ASSERT_TRUE(routerNs < legacyNs);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_routes_command_topic);
+    RUN_TEST(test_rejects_other_topics);
+    RUN_TEST(test_cleared_bed_is_unknown);
+    RUN_TEST(test_receive_path_never_allocates);
+    RUN_TEST(test_benchmark_against_string_parsing);
+    return UNITY_END();
+}